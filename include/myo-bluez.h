@@ -9,6 +9,17 @@
 #include <gio/gio.h>
 
 #include "myo-bluetooth/myohw.h"
+#include "myo-bluez_rate.h"
+#include "myo-bluez_gesture.h"
+#include "myo-bluez_fuse.h"
+#include "myo-bluez_ahrs.h"
+#include "myo-bluez_quality.h"
+#include "myo-bluez_spectrum.h"
+#include "myo-bluez_history.h"
+#include "myo-bluez_link.h"
+#include "myo-bluez_clock.h"
+#include "myo-bluez_budget.h"
+#include "myo-bluez_event.h"
 
 #ifdef DEBUG
 #define debug(M, ...) fprintf(stderr, "DEBUG %s:%d: " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
@@ -24,10 +35,23 @@
 #define MYOBLUEZ_ERROR 1
 #define MYOBLUEZ_OK 0
 
+#define MYOBLUEZ_KEEPALIVE_S 30
+#define MYOBLUEZ_STATS_BUCKETS 16
+
 typedef void* myobluez_myo_t;
 typedef void (*imu_cb_t)(myohw_imu_data_t);
 typedef void (*arm_cb_t)(myohw_classifier_event_t);
 typedef void (*emg_cb_t)(int16_t*, uint8_t);
+typedef void (*adapt_cb_t)(myobluez_myo_t, myohw_emg_mode_t, myohw_imu_mode_t, int);
+//Subscriber callbacks get the myo, the decoded data, valid during the call
+//and shared by all subscribers, and their user_data. EMG comes as one sample
+//of 8 channels and the moving mask, whether added or subscribed at a rate.
+typedef void (*imu_sub_cb_t)(myobluez_myo_t, const myohw_imu_data_t*, void*);
+typedef void (*arm_sub_cb_t)(myobluez_myo_t, const myohw_classifier_event_t*, void*);
+typedef void (*emg_sub_cb_t)(myobluez_myo_t, const int16_t*, uint8_t, void*);
+typedef void (*fused_cb_t)(myobluez_myo_t, const MyoFusedFrame*, void*);
+typedef void (*ahrs_cb_t)(myobluez_myo_t, const MyoAhrsSample*, void*);
+typedef void (*spectrum_cb_t)(myobluez_myo_t, const MyoSpectrumFeatures*, void*);
 
 typedef enum {
 	DISCONNECTED,
@@ -35,23 +59,291 @@ typedef enum {
 	CONNECTED
 } ConnectionStatus;
 
+typedef enum {
+	//GATT through bluetoothd over D-Bus
+	MYOBLUEZ_TRANSPORT_DBUS,
+	//LE L2CAP ATT socket straight to the myo, bluetoothd is only used to
+	//find devices
+	MYOBLUEZ_TRANSPORT_ATT
+} myobluez_transport_t;
+
+//Characteristics a myo has to have before it is handed to myo_init
+typedef enum {
+	MYOBLUEZ_NEED_BATTERY = 1 << 0,
+	MYOBLUEZ_NEED_INFO = 1 << 1,
+	MYOBLUEZ_NEED_VERSION = 1 << 2,
+	//mode, sleep and vibrate commands
+	MYOBLUEZ_NEED_COMMAND = 1 << 3,
+	MYOBLUEZ_NEED_IMU = 1 << 4,
+	MYOBLUEZ_NEED_MOTION = 1 << 5,
+	MYOBLUEZ_NEED_CLASSIFIER = 1 << 6,
+	MYOBLUEZ_NEED_EMG = 1 << 7,
+	MYOBLUEZ_NEED_ALL = 0xFF
+} myobluez_need_t;
+
+//Library state lives in a context, a process can run several of them.
+//
+//Threading: a context belongs to the GMainContext that was thread-default
+//when it was created, discovery, initialization and all callbacks run in
+//whichever thread iterates that context. Everything below that takes a
+//myobluez_myo_t may be called from any thread, calls on the same myo are
+//serialized and calls on different myos run in parallel. Callback
+//registration takes effect for the next notification. A context must be
+//freed from its main context's thread, or after it has stopped iterating,
+//once no other thread uses its myos.
+typedef struct MyoBluezCtx *myobluez_ctx_t;
+
+//Scanning for myos bluez does not know yet
+typedef struct {
+	//stop once this many myos are found, 0 for as many as fit
+	int target;
+	//ignore advertisements weaker than this many dBm, 0 for any
+	int16_t rssi;
+	//only pick up these addresses ("C8:2F:..."), NULL terminated, or NULL
+	//for any
+	const char *const *allowlist;
+} MyoDiscovery;
+
+//Counters of one context since it was created
+typedef struct {
+	//notifications delivered per characteristic
+	uint64_t emg;
+	uint64_t imu;
+	uint64_t arm;
+	uint64_t motion;
+	uint64_t battery;
+	//their payload
+	uint64_t bytes;
+	uint64_t connects;
+	uint64_t disconnects;
+	uint64_t connect_failures;
+	//time spent in callbacks per notification, bucket 0 under 1us and
+	//bucket i from 2^(i-1) to 2^i us, the last one everything slower
+	uint64_t delivery_us[MYOBLUEZ_STATS_BUCKETS];
+} MyoBluezStats;
+
+//What the library holds across all contexts, all 0 once every context is
+//freed and the objects it let go of are finalized
+typedef struct {
+	int contexts;
+	//D-Bus connections, managers and proxies
+	int objects;
+	int signal_handlers;
+	//timers and initialization sources
+	int sources;
+} MyoBluezResources;
+
+//Calls return MYOBLUEZ_OK or MYOBLUEZ_ERROR, or a length where noted, and
+//never share error state with calls in other threads
 int myo_get_name(myobluez_myo_t myo, char *str);
 int myo_get_version(myobluez_myo_t myo, myohw_fw_version_t *ver);
 int myo_get_info(myobluez_myo_t myo, myohw_fw_info_t *info);
-void myo_EMG_notify_enable(myobluez_myo_t myo, bool enable);
-void myo_IMU_notify_enable(myobluez_myo_t myo, bool enable);
-void myo_arm_indicate_enable(myobluez_myo_t myo, bool enable);
+int myo_EMG_notify_enable(myobluez_myo_t myo, bool enable);
+int myo_IMU_notify_enable(myobluez_myo_t myo, bool enable);
+int myo_arm_indicate_enable(myobluez_myo_t myo, bool enable);
+//Tap events and battery level, both only reported through the event queue
+int myo_motion_indicate_enable(myobluez_myo_t myo, bool enable);
+int myo_battery_notify_enable(myobluez_myo_t myo, bool enable);
+//Any number of subscribers per stream, each callback and user_data pair
+//once. Called in the order they were added, adding and removing never
+//blocks delivery. A removed subscriber may still get a notification that
+//was being delivered meanwhile.
+int myo_imu_cb_add(myobluez_myo_t myo, imu_sub_cb_t callback, void *user_data);
+int myo_imu_cb_remove(myobluez_myo_t myo, imu_sub_cb_t callback, void *user_data);
+int myo_arm_cb_add(myobluez_myo_t myo, arm_sub_cb_t callback, void *user_data);
+int myo_arm_cb_remove(myobluez_myo_t myo, arm_sub_cb_t callback, void *user_data);
+int myo_emg_cb_add(myobluez_myo_t myo, emg_sub_cb_t callback, void *user_data);
+int myo_emg_cb_remove(myobluez_myo_t myo, emg_sub_cb_t callback, void *user_data);
+//One callback each without user_data, registering again replaces it and
+//NULL removes it. IMU and arm take a subscriber slot. EMG gets the 16 bytes
+//of a notification as they came, copied into 8 shorts, and its last byte.
 void myo_imu_cb_register(myobluez_myo_t myo, imu_cb_t callback);
 void myo_arm_cb_register(myobluez_myo_t myo, arm_cb_t callback);
 void myo_emg_cb_register(myobluez_myo_t myo, emg_cb_t callback);
-void myo_update_enable(
+//Calls back at rate Hz instead of for every notification. EMG runs at
+//MYO_EMG_RATE and IMU at MYO_IMU_RATE, rate has to be one of those divided
+//by a whole factor of at most 8. Consumers at the same rate share one
+//anti-aliasing decimator. Subscribed EMG callbacks get one 8 channel
+//sample per call. Unsubscribing takes the same rate, callback and
+//user_data.
+int myo_emg_subscribe(myobluez_myo_t myo, unsigned int rate, emg_sub_cb_t callback,
+		void *user_data);
+int myo_emg_unsubscribe(myobluez_myo_t myo, unsigned int rate, emg_sub_cb_t callback,
+		void *user_data);
+int myo_imu_subscribe(myobluez_myo_t myo, unsigned int rate, imu_sub_cb_t callback,
+		void *user_data);
+int myo_imu_unsubscribe(myobluez_myo_t myo, unsigned int rate, imu_sub_cb_t callback,
+		void *user_data);
+//Copies the newest samples, at most max and with a sequence number of at
+//least since, oldest first into one array per channel and their arrival
+//times (g_get_monotonic_time), or acquisition times under myo_clock_enable,
+//into timestamps, which may be NULL. EMG has 8
+//channels, IMU 10: orientation w, x, y, z, accelerometer x, y, z and
+//gyroscope x, y, z. Never blocks. Returns the number of samples copied and
+//the first one's sequence number in first, so first + count as the next
+//since serves every sample once. At most 512 are served per call and only
+//the last 1024 are kept. The float variants scale IMU values to a unit
+//quaternion, g and deg/s.
+int myo_emg_poll(myobluez_myo_t myo, uint64_t since, unsigned int max,
+		int16_t *const *channels, int64_t *timestamps, uint64_t *first);
+int myo_emg_poll_float(myobluez_myo_t myo, uint64_t since, unsigned int max,
+		float *const *channels, int64_t *timestamps, uint64_t *first);
+int myo_imu_poll(myobluez_myo_t myo, uint64_t since, unsigned int max,
+		int16_t *const *channels, int64_t *timestamps, uint64_t *first);
+int myo_imu_poll_float(myobluez_myo_t myo, uint64_t since, unsigned int max,
+		float *const *channels, int64_t *timestamps, uint64_t *first);
+int myo_update_enable(
 		myobluez_myo_t myo,
 		myohw_emg_mode_t emg,
 		myohw_imu_mode_t imu,
 		myohw_classifier_mode_t arm);
+//Classifies raw EMG on the host and reports poses through the arm callback
+//as myohw_classifier_event_pose, decided over window_ms of samples every
+//stride_ms. window_ms is clamped to MYO_GESTURE_MIN_WINDOW_MS through
+//MYO_GESTURE_MAX_WINDOW_MS. Needs EMG notifications and myohw_emg_mode_send_emg. A NULL
+//model turns it off.
+int myo_gesture_enable(myobluez_myo_t myo, const MyoGestureModel *model,
+		unsigned int window_ms, unsigned int stride_ms);
+//Calls back once per EMG sample with the IMU resampled to its arrival time,
+//orientation by slerp and the rest linearly. A frame waits for the IMU
+//sample after it, or about MYO_FUSE_MAX_LATENCY_US, and is valid during
+//the call. Needs EMG and IMU notifications. NULL turns it off.
+int myo_fuse_enable(myobluez_myo_t myo, fused_cb_t callback, void *user_data);
+//Runs a Madgwick or Mahony filter on the raw accelerometer and gyroscope
+//and calls back once per IMU sample with its orientation next to the
+//myo's. NULL config is Madgwick with the default gain and a bias
+//calibration over the first MYO_AHRS_CALIBRATION_SAMPLES. Needs IMU
+//notifications. NULL callback turns it off.
+int myo_ahrs_enable(myobluez_myo_t myo, const MyoAhrsConfig *config, ahrs_cb_t callback,
+		void *user_data);
+//Averages the gyroscope bias again over the next samples, hold the myo still
+int myo_ahrs_calibrate_bias(myobluez_myo_t myo, unsigned int samples);
+//Watches every raw EMG channel for saturation, clipping bursts, lost contact
+//and line noise, and puts a MYO_EVENT_QUALITY into the event queue whenever
+//a channel's flags change. Needs EMG notifications and
+//myohw_emg_mode_send_emg. Turning it on starts the statistics over.
+int myo_quality_enable(myobluez_myo_t myo, bool enable);
+//Copies the statistics of the 8 channels, fails while it is off
+int myo_quality_get(myobluez_myo_t myo, MyoQualityChannel *channels);
+//Keeps a sliding DFT of the last MYO_SPECTRUM_WINDOW raw EMG samples per
+//channel and calls back every hop with median and mean frequency and band
+//powers, valid during the call. NULL config is
+//myo_spectrum_config_default. Needs EMG notifications and
+//myohw_emg_mode_send_emg. NULL callback turns it off.
+int myo_spectrum_enable(myobluez_myo_t myo, const MyoSpectrumConfig *config,
+		spectrum_cb_t callback, void *user_data);
+//Keeps the last MYO_HISTORY_RAW EMG and IMU samples and min, max and mean
+//over coarser and coarser buckets going back much further, updated as
+//samples arrive. Turning it on starts over.
+int myo_history_enable(myobluez_myo_t myo, bool enable);
+//Fills width columns of points, each channels wide, with min, max and mean
+//of stream over [from, to) in arrival time (g_get_monotonic_time), reading
+//a few buckets per column however long the range. Fails while off.
+int myo_history_query(myobluez_myo_t myo, myo_history_stream_t stream, int64_t from,
+		int64_t to, unsigned int width, MyoHistoryPoint *points);
+//Copies the link telemetry: RSSI and TxPower while bluez reports them,
+//notification interval, jitter, bursts and gaps per stream and the last
+//connection drops. Gaps also go into the event queue as MYO_EVENT_LINK,
+//told apart into host stalls, which a burst made up for, and radio losses.
+int myo_link_get(myobluez_myo_t myo, MyoLinkStats *stats);
+//Stamps EMG and IMU samples with their acquisition time estimated from a
+//fit of arrival times against sample count, instead of when they arrived,
+//for polling, fusion, the orientation filter, spectral features and the
+//history. Samples lost over the air are skipped once it is clear they were
+//not just held up, and the fit starts over after a second of silence.
+//Turning it on starts over.
+int myo_clock_enable(myobluez_myo_t myo, bool enable);
+//Fitted period, drift and gaps of a stream, fails while off
+int myo_clock_get(myobluez_myo_t myo, myo_clock_stream_t stream, MyoClockStats *stats);
+//Steps the modes last set with myo_update_enable down when consumers fall
+//behind or notifications go missing, and back up once that has passed.
+//Every change is reported to the adapt callback with its level, 0 being the
+//requested modes. Turning it off restores the requested modes.
+int myo_adapt_enable(myobluez_myo_t myo, bool enable);
+void myo_adapt_cb_register(myobluez_myo_t myo, adapt_cb_t callback);
+//Share of the bandwidth budget, higher goes first under
+//MYO_BUDGET_PRIORITY and gives last under MYO_BUDGET_FAIR_SHARE. 0 by default.
+int myo_set_priority(myobluez_myo_t myo, int priority);
 char* pose2str(myohw_pose_t pose);
 
+myobluez_ctx_t myobluez_ctx_new();
+void myobluez_ctx_set_transport(myobluez_ctx_t ctx, myobluez_transport_t transport);
+//Keep attribute layout and static values on disk so a known myo streams
+//without rediscovery, on by default
+void myobluez_ctx_set_cache(myobluez_ctx_t ctx, bool enable);
+//Keep streaming myos from sleeping or locking: while EMG or IMU is set
+//through myo_update_enable they are told never to sleep and to stay
+//unlocked, repeated every MYOBLUEZ_KEEPALIVE_S. Turning streams off or
+//freeing the context puts them back to normal sleep and locked. On by default.
+void myobluez_ctx_set_keepalive(myobluez_ctx_t ctx, bool enable);
+//myobluez_need_t bits of what myo_init relies on. Init waits only for these,
+//services without any are not resolved up front and the rest resolve the
+//first time they are used. MYOBLUEZ_NEED_ALL by default. Applies to myos
+//found afterwards.
+void myobluez_ctx_set_required(myobluez_ctx_t ctx, unsigned int needs);
+//Talks to bluez on the bus at address (a D-Bus address like
+//"unix:path=/tmp/bus") instead of the system bus, e.g. a private bus with
+//simulated myos. MYOBLUEZ_BUS_ADDRESS does the same. Set before starting.
+int myobluez_ctx_set_bus_address(myobluez_ctx_t ctx, const char *address);
+//Besides the myos bluez already knows, scan for ones advertising the myo
+//service over LE and connect as they show up. The allowlist also applies to
+//known myos. NULL turns it off, which is the default. Set before starting.
+int myobluez_ctx_set_discovery(myobluez_ctx_t ctx, const MyoDiscovery *discovery);
+//Shares each adapter's notification capacity between its connected myos:
+//myo_update_enable then only requests modes, and every myo gets at most what
+//it asked for, stepped down like the stream mode controller does until the
+//adapter's myos fit. Reassigns as myos connect, disconnect and change
+//requests. A capacity of 0 is MYO_BUDGET_CAPACITY. NULL turns it off, which
+//is the default, and hands every myo what it asked for.
+int myobluez_ctx_set_budget(myobluez_ctx_t ctx, const MyoBudgetConfig *config);
+//Requested, assigned, projected and achieved rates of up to max connected
+//myos, returns how many. Any thread.
+int myobluez_ctx_get_budget(myobluez_ctx_t ctx, MyoBudgetReport *reports, int max);
+//Connects to bluez and starts looking for myos, myo_init is called from the
+//context's main context once a myo is ready
+int myobluez_ctx_start(myobluez_ctx_t ctx, int (*myo_init)(myobluez_myo_t), GError **error);
+//Connection, classifier, motion and battery events of every myo in the
+//context, oldest first. Moves up to max events into events and returns how
+//many. The queue keeps the last 256, dropped (may be NULL) gets how many
+//were lost to that since the last drain. Any thread.
+int myobluez_ctx_drain_events(myobluez_ctx_t ctx, MyoEvent *events, int max,
+		unsigned int *dropped);
+//Snapshot of the context's counters, any thread
+void myobluez_ctx_get_stats(myobluez_ctx_t ctx, MyoBluezStats *stats);
+//Drives the context from an outside poll loop instead of a GMainLoop, from
+//one thread. Fills fds with the descriptors to wait on and timeout with how
+//long to wait at most in ms, -1 for no limit. Returns how many fds there
+//are, call again with more room when that is over max_fds, or -1 when
+//another thread owns the main context. The set can change between calls.
+int myobluez_ctx_prepare(myobluez_ctx_t ctx, GPollFD *fds, int max_fds, int *timeout);
+//Takes the fds back with revents set from the wait and runs one round of
+//whatever is ready, without blocking
+int myobluez_ctx_dispatch(myobluez_ctx_t ctx, GPollFD *fds, int num_fds);
+//Turns off streaming on initialized myos and disconnects
+void myobluez_ctx_free(myobluez_ctx_t ctx);
+
+//For leak checks over many connect/disconnect cycles, any thread
+void myobluez_get_resources(MyoBluezResources *resources);
+
+//Hot path trace events into per-thread rings, decoded by myo-bluez-tracecat.
+//The dump only uses write(2), so it can be called from a signal handler.
+void myobluez_trace_enable(bool enable);
+int myobluez_trace_dump(int fd);
+
+//Same as above on a process wide default context
+void myobluez_set_transport(myobluez_transport_t transport);
+void myobluez_set_cache(bool enable);
+void myobluez_set_keepalive(bool enable);
+void myobluez_set_required(unsigned int needs);
+int myobluez_set_discovery(const MyoDiscovery *discovery);
+int myobluez_set_bus_address(const char *address);
+int myobluez_set_budget(const MyoBudgetConfig *config);
+int myobluez_get_budget(MyoBudgetReport *reports, int max);
 int myobluez_init(int (*myo_init)(myobluez_myo_t));
+int myobluez_drain_events(MyoEvent *events, int max, unsigned int *dropped);
+void myobluez_get_stats(MyoBluezStats *stats);
+int myobluez_prepare(GPollFD *fds, int max_fds, int *timeout);
+int myobluez_dispatch(GPollFD *fds, int num_fds);
 void myobluez_deinit();
 
 #endif
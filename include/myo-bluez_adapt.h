@@ -0,0 +1,59 @@
+#ifndef MYO_BLUEZ_ADAPT_H
+#define MYO_BLUEZ_ADAPT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myo-bluetooth/myohw.h"
+#include "myo-bluez_rate.h"
+
+#define MYO_ADAPT_MAX_LEVELS 5
+#define MYO_ADAPT_TICK_MS 500
+
+//pressure is 1 when any of these is reached
+//share of the main loop spent in consumer callbacks
+#define MYO_ADAPT_LOAD_HIGH 0.5
+//notifications waiting behind a blocking request, as a share of the queue
+#define MYO_ADAPT_DEPTH_HIGH 0.5
+//delivered share of what the current modes should send
+#define MYO_ADAPT_DELIVERED_LOW 0.8
+
+//step down after this many ticks at or over full pressure, back up after
+//this many under half of it
+#define MYO_ADAPT_DOWN_TICKS 2
+#define MYO_ADAPT_UP_TICKS 10
+#define MYO_ADAPT_LOW_PRESSURE 0.5
+
+typedef struct {
+	myohw_emg_mode_t emg;
+	myohw_imu_mode_t imu;
+} MyoAdaptLevel;
+
+//What was seen over one tick
+typedef struct {
+	double load;
+	double depth;
+	//-1 when nothing was expected
+	double delivered;
+} MyoAdaptStats;
+
+//Steps down a ladder of stream modes built from the requested ones, level 0
+//is what was asked for
+typedef struct {
+	MyoAdaptLevel levels[MYO_ADAPT_MAX_LEVELS];
+	int num_levels;
+	int level;
+	int high_ticks;
+	int low_ticks;
+	double pressure;
+} MyoAdapt;
+
+void myo_adapt_init(MyoAdapt *adapt, myohw_emg_mode_t emg, myohw_imu_mode_t imu);
+double myo_adapt_pressure(const MyoAdaptStats *stats);
+//Returns true when the level changed
+bool myo_adapt_update(MyoAdapt *adapt, const MyoAdaptStats *stats);
+const MyoAdaptLevel* myo_adapt_current(const MyoAdapt *adapt);
+//Notifications per second the level should deliver on the given streams
+unsigned int myo_adapt_expected_rate(const MyoAdaptLevel *level, bool emg, bool imu);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef MYO_BLUEZ_AHRS_H
+#define MYO_BLUEZ_AHRS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myo-bluetooth/myohw.h"
+#include "myo-bluez_rate.h"
+
+#define MYO_AHRS_MADGWICK_GAIN 0.1f
+#define MYO_AHRS_MAHONY_KP 1.0f
+#define MYO_AHRS_MAHONY_KI 0.0f
+//two seconds held still
+#define MYO_AHRS_CALIBRATION_SAMPLES (2 * MYO_IMU_RATE)
+//s, a step is kept to this around the nominal IMU period so a late or
+//repeated timestamp, or a gap over a reconnect, cannot throw the filter off
+#define MYO_AHRS_MIN_DT (0.25f / MYO_IMU_RATE)
+#define MYO_AHRS_MAX_DT (4.0f / MYO_IMU_RATE)
+
+typedef enum {
+	//gradient descent step towards gravity, one gain
+	MYO_AHRS_MADGWICK,
+	//PI controller on the gravity error, corrects gyro bias with the integral
+	MYO_AHRS_MAHONY
+} myo_ahrs_filter_t;
+
+typedef struct {
+	myo_ahrs_filter_t filter;
+	//Madgwick beta or Mahony proportional gain
+	float gain;
+	//Mahony integral gain, Madgwick ignores it
+	float integral_gain;
+	//deg/s taken off the gyroscope before filtering
+	float gyro_bias[3];
+	//averages the gyroscope over this many samples into gyro_bias, the myo
+	//has to be still meanwhile, 0 keeps gyro_bias as it is
+	unsigned int calibration_samples;
+} MyoAhrsConfig;
+
+//The filter's orientation next to the myo's own, both unit quaternions
+//(w, x, y, z) in the myo's reference frame
+typedef struct {
+	int64_t timestamp;
+	float orientation[4];
+	float device[4];
+} MyoAhrsSample;
+
+//Filter state, updating never allocates
+typedef struct {
+	MyoAhrsConfig config;
+	float q[4];
+	//Mahony integral term, rad/s
+	float integral[3];
+	float bias_sum[3];
+	unsigned int bias_count;
+	//the first sample seeds q with the myo's orientation
+	bool seeded;
+	//us, 0 until a timestamped sample came in
+	int64_t last_timestamp;
+} MyoAhrs;
+
+void myo_ahrs_config_default(MyoAhrsConfig *config, myo_ahrs_filter_t filter);
+void myo_ahrs_init(MyoAhrs *ahrs, const MyoAhrsConfig *config);
+//Starts over averaging the gyroscope bias over the next samples
+void myo_ahrs_calibrate(MyoAhrs *ahrs, unsigned int samples);
+//One step of dt seconds from accelerometer in g and gyroscope in deg/s
+void myo_ahrs_update(MyoAhrs *ahrs, const float *accelerometer, const float *gyroscope, float dt);
+//One raw sample in the order myo_imu_poll uses: orientation w, x, y, z,
+//accelerometer x, y, z, gyroscope x, y, z. Steps over the time since the
+//previous sample's timestamp in us, within MYO_AHRS_MIN_DT through
+//MYO_AHRS_MAX_DT, or one IMU period without a timestamp.
+void myo_ahrs_push(MyoAhrs *ahrs, const int16_t *imu, int64_t timestamp, MyoAhrsSample *out);
+//count samples in myo_imu_poll's channel layout, timestamps may be NULL
+void myo_ahrs_process(MyoAhrs *ahrs, const int16_t *const *channels, const int64_t *timestamps,
+		int count, MyoAhrsSample *out);
+
+#endif
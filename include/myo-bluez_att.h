@@ -0,0 +1,76 @@
+#ifndef MYO_BLUEZ_ATT_H
+#define MYO_BLUEZ_ATT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#define ATT_CID 4
+#define ATT_DEFAULT_MTU 23
+#define ATT_MAX_MTU 247
+#define ATT_TIMEOUT_MS 5000
+
+//notifications that arrive while a request is being waited on are held here
+//and delivered from the link's context so callbacks never nest inside a
+//request
+#define ATT_PENDING 16
+
+#define ATT_CCCD_NOTIFY 0x0001
+#define ATT_CCCD_INDICATE 0x0002
+
+//connection interval in 1.25ms units, supervision timeout in 10ms units
+#define ATT_CONN_INTERVAL_MIN 6
+#define ATT_CONN_INTERVAL_MAX 6
+#define ATT_CONN_LATENCY 0
+#define ATT_SUPERVISION_TIMEOUT 100
+
+//the request timed out or the link went down, outside the range of ATT
+//error codes
+#define ATT_ERR_LINK (-0x100)
+
+typedef struct AttLink AttLink;
+
+typedef void (*att_connect_cb_t)(AttLink *link, int err, void *user_data);
+typedef void (*att_notify_cb_t)(AttLink *link, uint16_t handle, const uint8_t *value, size_t len, void *user_data);
+typedef void (*att_disconnect_cb_t)(AttLink *link, void *user_data);
+//err is 0, a negative ATT error code or ATT_ERR_LINK, value is only set for
+//reads
+typedef void (*att_done_cb_t)(AttLink *link, int err, const uint8_t *value, size_t len, void *user_data);
+
+//Starts a non-blocking LE connection on the ATT fixed channel, connect_cb
+//is called from ctx once it has completed or failed. Requests may be made
+//from any thread, callbacks always run in ctx.
+AttLink* att_link_connect(const char *address, bool random_address, GMainContext *ctx,
+		att_connect_cb_t connect_cb, void *user_data);
+void att_link_free(AttLink *link);
+
+void att_link_set_handlers(AttLink *link, att_notify_cb_t notify_cb,
+		att_disconnect_cb_t disconnect_cb, void *user_data);
+
+//Requests are queued and go out one at a time. These return at once and
+//call back from ctx when the response is in, cb may be NULL. A request
+//that times out takes the link down, as ATT allows nothing else after it.
+int att_link_exchange_mtu(AttLink *link, uint16_t mtu, att_done_cb_t cb, void *user_data);
+//Finds every characteristic and the CCCD of those that notify
+int att_link_discover(AttLink *link, att_done_cb_t cb, void *user_data);
+int att_link_read_async(AttLink *link, uint16_t handle, att_done_cb_t cb, void *user_data);
+int att_link_write_async(AttLink *link, uint16_t handle, const uint8_t *value, size_t len,
+		att_done_cb_t cb, void *user_data);
+
+//Same, waiting for the response. Only reads the socket from the calling
+//thread while waiting, never needs ctx to run.
+int att_link_read(AttLink *link, uint16_t handle, uint8_t *value, size_t len);
+int att_link_write(AttLink *link, uint16_t handle, const uint8_t *value, size_t len);
+
+uint16_t att_link_get_mtu(AttLink *link);
+//Most notifications that were queued at once since the last call
+int att_link_take_max_pending(AttLink *link);
+uint16_t att_link_find_char(AttLink *link, const char *uuid, uint16_t *cccd_handle);
+
+//Sends the update to the adapter the link goes through without waiting for
+//the controller's answer
+int att_link_set_conn_params(AttLink *link, uint16_t min_interval, uint16_t max_interval,
+		uint16_t latency, uint16_t supervision_timeout);
+
+#endif
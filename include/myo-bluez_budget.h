@@ -0,0 +1,67 @@
+#ifndef MYO_BLUEZ_BUDGET_H
+#define MYO_BLUEZ_BUDGET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myo-bluetooth/myohw.h"
+
+#define MYO_BUDGET_MAX_REQUESTS 16
+//notifications per second across all myos on one adapter, a conservative
+//figure for a USB dongle, set what yours sustains
+#define MYO_BUDGET_CAPACITY 300
+#define MYO_BUDGET_TICK_MS 1000
+
+typedef enum {
+	//higher priority myos keep their modes, the rest share what is left
+	MYO_BUDGET_PRIORITY,
+	//the hungriest myo steps down first until everything fits
+	MYO_BUDGET_FAIR_SHARE
+} myo_budget_policy_t;
+
+typedef struct {
+	//per adapter
+	unsigned int capacity;
+	myo_budget_policy_t policy;
+} MyoBudgetConfig;
+
+typedef struct {
+	//myos with the same adapter share its capacity
+	int adapter;
+	int priority;
+	myohw_emg_mode_t emg;
+	myohw_imu_mode_t imu;
+} MyoBudgetRequest;
+
+typedef struct {
+	myohw_emg_mode_t emg;
+	myohw_imu_mode_t imu;
+	//notifications per second the modes should bring
+	unsigned int projected;
+} MyoBudgetGrant;
+
+//One connected myo as last assigned, rates in notifications per second
+typedef struct {
+	//the myobluez_myo_t
+	void *myo;
+	int adapter;
+	int priority;
+	myohw_emg_mode_t requested_emg;
+	myohw_imu_mode_t requested_imu;
+	myohw_emg_mode_t emg;
+	myohw_imu_mode_t imu;
+	unsigned int projected;
+	//measured over the last MYO_BUDGET_TICK_MS
+	unsigned int achieved;
+} MyoBudgetReport;
+
+//Notifications per second a myo sends in these modes
+unsigned int myo_budget_rate(myohw_emg_mode_t emg, myohw_imu_mode_t imu);
+//Picks modes for count requests, each at most what was asked for, stepping
+//down the same ladder as the stream mode controller until every adapter's
+//myos fit its capacity. The bottom of the ladder streams nothing, so
+//everything always fits.
+void myo_budget_assign(const MyoBudgetConfig *config, const MyoBudgetRequest *requests,
+		int count, MyoBudgetGrant *grants);
+
+#endif
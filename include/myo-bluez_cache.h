@@ -0,0 +1,40 @@
+#ifndef MYO_BLUEZ_CACHE_H
+#define MYO_BLUEZ_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "myo-bluetooth/myohw.h"
+
+//On-disk record of a myo's attribute layout and static values, one file per
+//device address. Everything in it is only valid for the firmware version it
+//was stored with.
+typedef struct {
+	GKeyFile *keyfile;
+	char *file;
+	bool loaded;
+} MyoCache;
+
+MyoCache* myo_cache_open(const char *address);
+void myo_cache_free(MyoCache *cache);
+int myo_cache_save(MyoCache *cache);
+//Forgets everything and removes the file
+void myo_cache_clear(MyoCache *cache);
+
+bool myo_cache_get_version(MyoCache *cache, myohw_fw_version_t *version);
+void myo_cache_set_version(MyoCache *cache, const myohw_fw_version_t *version);
+bool myo_cache_get_info(MyoCache *cache, myohw_fw_info_t *info);
+void myo_cache_set_info(MyoCache *cache, const myohw_fw_info_t *info);
+char* myo_cache_get_name(MyoCache *cache);
+void myo_cache_set_name(MyoCache *cache, const char *name);
+
+//D-Bus object path of a service or characteristic
+char* myo_cache_get_path(MyoCache *cache, const char *uuid);
+void myo_cache_set_path(MyoCache *cache, const char *uuid, const char *path);
+//ATT value and CCCD handles of a characteristic
+bool myo_cache_get_handles(MyoCache *cache, const char *uuid, uint16_t *handle, uint16_t *cccd);
+void myo_cache_set_handles(MyoCache *cache, const char *uuid, uint16_t handle, uint16_t cccd);
+
+#endif
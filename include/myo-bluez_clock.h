@@ -0,0 +1,71 @@
+#ifndef MYO_BLUEZ_CLOCK_H
+#define MYO_BLUEZ_CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//forgetting factor of the fit, about 2048 notifications of memory, 40s of
+//EMG, long enough to average out connection events and short enough to
+//follow the crystal's drift with temperature
+#define MYO_CLOCK_FORGET (1.0 - 1.0 / 2048)
+//residuals beyond this many mean absolute residuals are clipped
+#define MYO_CLOCK_HUBER 2.0
+//arrivals later than this many periods start a possible gap
+#define MYO_CLOCK_GAP_FACTOR 4
+//a gap is samples lost once this many arrivals in a row stay late, before
+//that it may still be a host stall catching up
+#define MYO_CLOCK_SETTLE 16
+//longer silences start the stream over from its next arrival
+#define MYO_CLOCK_RESET_US 1000000
+
+typedef enum {
+	MYO_CLOCK_EMG,
+	MYO_CLOCK_IMU
+} myo_clock_stream_t;
+
+typedef struct {
+	uint64_t samples;
+	//fitted sample period and how far it is off the nominal one
+	double period_us;
+	double drift_ppm;
+	//mean absolute residual of arrivals around the fit
+	double jitter_us;
+	//how far above the fit the earliest arrivals sit, stamps are put there
+	double floor_us;
+	//started over after a silence or when the fit lost track
+	uint64_t anchors;
+	//late runs that turned out to be lost samples, and how many
+	uint64_t gaps;
+	uint64_t skipped;
+	//late runs that caught up again
+	uint64_t stalls;
+} MyoClockStats;
+
+//Recursive least squares fit of arrival time against sample index,
+//t = t0 + a + b (n - n0), with forgetting and Huber clipped residuals so
+//bursts from connection events pull on it only so much. Arrivals are never
+//early, so stamps go onto a low quantile of the residuals rather than the
+//fit itself.
+typedef struct {
+	MyoClockStats stats;
+	double nominal_us;
+	int64_t t0;
+	uint64_t n0;
+	//index of the next sample
+	uint64_t n;
+	double a;
+	double b;
+	double p[2][2];
+	int64_t last;
+	int64_t last_stamp;
+	//arrivals in a row beyond the gap threshold, and the least late of them
+	int late;
+	double late_min;
+} MyoClock;
+
+void myo_clock_init(MyoClock *clock, double nominal_us);
+//Feeds a notification carrying count samples that arrived at arrival and
+//writes each sample's acquisition time to stamps, oldest first
+void myo_clock_push(MyoClock *clock, int count, int64_t arrival, int64_t *stamps);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef MYO_BLUEZ_CODEC_H
+#define MYO_BLUEZ_CODEC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "myo-bluetooth/myohw.h"
+
+#define MYO_CODEC_MAGIC "MYOC"
+#define MYO_CODEC_VERSION 2
+
+//residuals are bit-packed in blocks of this many samples, each with its own width
+#define MYO_CODEC_BLOCK 16
+#define MYO_CODEC_MAX_SAMPLES 256
+
+#define MYO_CODEC_EMG_CHANNELS 8
+//quaternion, accelerometer and gyroscope
+#define MYO_CODEC_IMU_CHANNELS 10
+
+typedef enum {
+	MYO_CODEC_EMG = 1,
+	MYO_CODEC_IMU = 2
+} myo_codec_stream_t;
+
+//Every chunk starts with this and decodes on its own, so a recording is just
+//chunks back to back. Multi-byte fields are little-endian.
+typedef struct {
+	char magic[4];
+	uint8_t stream;
+	uint8_t version;
+	uint16_t num_samples;
+	//payload bytes after the header
+	uint32_t size;
+	uint32_t reserved;
+	//caller's clock at the first sample, usually microseconds
+	uint64_t timestamp;
+} MyoCodecHeader;
+
+#define MYO_CODEC_HEADER_SIZE 24
+
+//Upper bound of an encoded chunk, header included
+size_t myo_codec_max_size(myo_codec_stream_t stream, int num_samples);
+
+//Both return the chunk size, or -1 when num_samples is out of range
+int myo_codec_encode_emg(const int16_t (*samples)[MYO_CODEC_EMG_CHANNELS], int num_samples,
+		uint64_t timestamp, uint8_t *out);
+int myo_codec_encode_imu(const myohw_imu_data_t *samples, int num_samples, uint64_t timestamp,
+		uint8_t *out);
+
+//Returns the chunk size when buf starts with a complete valid chunk, else -1
+int myo_codec_chunk_info(const uint8_t *buf, size_t len, MyoCodecHeader *header);
+
+//Both return the number of samples, or -1 when the chunk is not of that
+//stream, is corrupt or does not fit into max_samples
+int myo_codec_decode_emg(const uint8_t *buf, size_t len,
+		int16_t (*samples)[MYO_CODEC_EMG_CHANNELS], int max_samples);
+int myo_codec_decode_imu(const uint8_t *buf, size_t len, myohw_imu_data_t *samples,
+		int max_samples);
+
+//Buffers the notification payloads of one myo and writes a chunk whenever a
+//stream has MYO_CODEC_MAX_SAMPLES. Not thread-safe, keep one per consumer.
+typedef struct MyoRecorder MyoRecorder;
+
+MyoRecorder* myo_recorder_new(FILE *file);
+//One 8 channel sample, timestamp is when it arrived
+int myo_recorder_add_emg(MyoRecorder *recorder, const int16_t *sample, uint64_t timestamp);
+int myo_recorder_add_imu(MyoRecorder *recorder, const myohw_imu_data_t *data, uint64_t timestamp);
+//Writes out partial chunks
+int myo_recorder_flush(MyoRecorder *recorder);
+//Flushes and frees, the file stays open
+int myo_recorder_free(MyoRecorder *recorder);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MYO_BLUEZ_DECIMATE_H
+#define MYO_BLUEZ_DECIMATE_H
+
+#include <stdbool.h>
+
+#define MYO_DECIMATE_MAX_FACTOR 8
+//filter length grows with the factor so the transition band stays put
+#define MYO_DECIMATE_TAPS_PER_PHASE 8
+#define MYO_DECIMATE_MAX_TAPS (MYO_DECIMATE_MAX_FACTOR * MYO_DECIMATE_TAPS_PER_PHASE + 1)
+//8 EMG channels, or quaternion, accelerometer and gyroscope
+#define MYO_DECIMATE_MAX_CHANNELS 10
+
+//Windowed sinc low-pass followed by keeping every factor-th sample. Only the
+//kept phase is ever filtered, the rest just goes into the history.
+typedef struct {
+	int factor;
+	int num_taps;
+	int channels;
+	int phase;
+	int pos;
+	float taps[MYO_DECIMATE_MAX_TAPS];
+	//every sample is written twice so a window is always contiguous
+	float history[MYO_DECIMATE_MAX_CHANNELS][2 * MYO_DECIMATE_MAX_TAPS];
+} MyoDecimator;
+
+//Returns the factor for a rate, or 0 when it is not a supported divisor
+int myo_decimator_factor(unsigned int native_rate, unsigned int rate);
+void myo_decimator_init(MyoDecimator *decimator, int factor, int channels);
+//Returns true when out holds a new output sample
+bool myo_decimator_push(MyoDecimator *decimator, const float *in, float *out);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef MYO_BLUEZ_EVENT_H
+#define MYO_BLUEZ_EVENT_H
+
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "myo-bluetooth/myohw.h"
+
+#define MYO_EVENT_QUEUE_SIZE 256
+
+typedef enum {
+	MYO_EVENT_CONNECTED,
+	MYO_EVENT_DISCONNECTED,
+	//myo_init accepted the myo
+	MYO_EVENT_READY,
+	MYO_EVENT_CLASSIFIER,
+	MYO_EVENT_MOTION,
+	MYO_EVENT_BATTERY,
+	//an EMG channel's myo_quality_flag_t changed
+	MYO_EVENT_QUALITY,
+	//RSSI changed or a gap in a stream was settled
+	MYO_EVENT_LINK
+} myo_event_type_t;
+
+typedef struct {
+	//myo_link_event_t
+	uint8_t kind;
+	//myo_link_stream_t of a gap
+	uint8_t stream;
+	//dBm, for MYO_LINK_RSSI
+	int16_t rssi;
+	//notifications not made up for, at most UINT16_MAX
+	uint16_t lost;
+	uint32_t gap_ms;
+} MyoLinkEvent;
+
+typedef struct {
+	//g_get_monotonic_time when it happened
+	int64_t timestamp;
+	//the myobluez_myo_t it came from
+	void *myo;
+	uint8_t type;
+	union {
+		myohw_classifier_event_t classifier;
+		myohw_motion_event_t motion;
+		//percent
+		uint8_t battery;
+		struct {
+			uint8_t channel;
+			uint8_t flags;
+		} quality;
+		MyoLinkEvent link;
+	};
+} MyoEvent;
+
+//Oldest events are dropped when it is full
+typedef struct {
+	GMutex lock;
+	MyoEvent events[MYO_EVENT_QUEUE_SIZE];
+	int head;
+	int count;
+	unsigned int dropped;
+} MyoEventQueue;
+
+void myo_event_queue_init(MyoEventQueue *queue);
+void myo_event_queue_clear(MyoEventQueue *queue);
+void myo_event_queue_push(MyoEventQueue *queue, const MyoEvent *event);
+//Moves up to max of the oldest events out, dropped gets the overflow since
+//the last drain
+int myo_event_queue_drain(MyoEventQueue *queue, MyoEvent *events, int max, unsigned int *dropped);
+
+#endif
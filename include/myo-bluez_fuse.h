@@ -0,0 +1,65 @@
+#ifndef MYO_BLUEZ_FUSE_H
+#define MYO_BLUEZ_FUSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myo-bluetooth/myohw.h"
+
+//EMG samples waiting for the IMU sample after them
+#define MYO_FUSE_MAX_PENDING 32
+//a frame goes out with held IMU values once it waited this long, a bit
+//over two IMU periods
+#define MYO_FUSE_MAX_LATENCY_US 50000
+//IMU samples further apart than this are not interpolated between
+#define MYO_FUSE_MAX_GAP_US 100000
+
+typedef enum {
+	//between the IMU samples before and after the EMG sample
+	MYO_FUSE_INTERPOLATED,
+	//nearest IMU sample, the next one was late or too far away
+	MYO_FUSE_HELD,
+	//no IMU sample yet, the IMU fields are zero
+	MYO_FUSE_NO_IMU
+} myo_fuse_imu_t;
+
+//One per EMG sample, IMU values are a unit quaternion (w, x, y, z), g and deg/s
+typedef struct {
+	int64_t timestamp;
+	int16_t emg[8];
+	myo_fuse_imu_t imu;
+	float orientation[4];
+	float accelerometer[3];
+	float gyroscope[3];
+} MyoFusedFrame;
+
+typedef struct {
+	int64_t timestamp;
+	float orientation[4];
+	float accelerometer[3];
+	float gyroscope[3];
+} MyoFuseImu;
+
+//Resamples IMU onto the EMG timeline. Frames come out in EMG order, each
+//once the IMU sample after it arrived, or at the first push after it waited
+//MYO_FUSE_MAX_LATENCY_US.
+typedef struct {
+	MyoFusedFrame pending[MYO_FUSE_MAX_PENDING];
+	int head;
+	int num_pending;
+	//the last two IMU samples, prev is older
+	MyoFuseImu prev;
+	MyoFuseImu next;
+	int num_imu;
+} MyoFuse;
+
+void myo_fuse_init(MyoFuse *fuse);
+//Both return the number of frames written to out, which needs room for
+//MYO_FUSE_MAX_PENDING + 1
+int myo_fuse_push_emg(MyoFuse *fuse, const int16_t *emg, int64_t timestamp, MyoFusedFrame *out);
+int myo_fuse_push_imu(MyoFuse *fuse, const myohw_imu_data_t *data, int64_t timestamp,
+		MyoFusedFrame *out);
+//Shortest path interpolation between two unit quaternions, t from 0 to 1
+void myo_fuse_slerp(const float *a, const float *b, float t, float *out);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef MYO_BLUEZ_GESTURE_H
+#define MYO_BLUEZ_GESTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "myo-bluetooth/myohw.h"
+#include "myo-bluez_rate.h"
+
+#define MYO_GESTURE_CHANNELS 8
+//mean absolute value, waveform length, zero crossings, slope sign changes
+#define MYO_GESTURE_CHANNEL_FEATURES 4
+#define MYO_GESTURE_FEATURES (MYO_GESTURE_CHANNELS * MYO_GESTURE_CHANNEL_FEATURES)
+#define MYO_GESTURE_MAX_CLASSES 8
+//Window lengths in raw EMG samples follow from these and MYO_EMG_RATE. The
+//shortest is never under three samples, slope sign changes need that many.
+#define MYO_GESTURE_MAX_WINDOW_MS 640
+#define MYO_GESTURE_MIN_WINDOW_MS 60
+#define MYO_GESTURE_MAX_WINDOW (MYO_GESTURE_MAX_WINDOW_MS * MYO_EMG_RATE / 1000)
+#define MYO_GESTURE_MIN_WINDOW MAX((MYO_GESTURE_MIN_WINDOW_MS * MYO_EMG_RATE + 999) / 1000, 3)
+//zero crossings and slope changes smaller than this are noise
+#define MYO_GESTURE_THRESHOLD 2
+
+//Linear discriminant over normalized time domain features, the class with
+//the highest score wins
+typedef struct {
+	int num_classes;
+	myohw_pose_t poses[MYO_GESTURE_MAX_CLASSES];
+	float mean[MYO_GESTURE_FEATURES];
+	float scale[MYO_GESTURE_FEATURES];
+	float weights[MYO_GESTURE_MAX_CLASSES][MYO_GESTURE_FEATURES];
+	float bias[MYO_GESTURE_MAX_CLASSES];
+} MyoGestureModel;
+
+//Sliding window feature extractor, features are updated per sample instead
+//of recomputed per window
+typedef struct {
+	int window;
+	int head;
+	int count;
+	int16_t samples[MYO_GESTURE_MAX_WINDOW][MYO_GESTURE_CHANNELS];
+
+	int32_t abs_sum[MYO_GESTURE_CHANNELS];
+	int32_t length[MYO_GESTURE_CHANNELS];
+	int16_t crossings[MYO_GESTURE_CHANNELS];
+	int16_t slope_changes[MYO_GESTURE_CHANNELS];
+} MyoGestureWindow;
+
+//Everything inference needs, sized up front so classifying never allocates
+typedef struct {
+	MyoGestureModel model;
+	MyoGestureWindow window;
+	int stride;
+	int since_last;
+	myohw_pose_t pose;
+} MyoGesture;
+
+typedef struct MyoGestureTrainer MyoGestureTrainer;
+
+//Window and stride are rounded to whole samples at the raw EMG rate
+int myo_gesture_ms_to_samples(unsigned int ms);
+
+void myo_gesture_window_init(MyoGestureWindow *window, int samples);
+void myo_gesture_window_reset(MyoGestureWindow *window);
+void myo_gesture_window_push(MyoGestureWindow *window, const int16_t *sample);
+bool myo_gesture_window_full(const MyoGestureWindow *window);
+void myo_gesture_window_features(const MyoGestureWindow *window, float *features);
+
+MyoGesture* myo_gesture_new(const MyoGestureModel *model, unsigned int window_ms,
+		unsigned int stride_ms);
+void myo_gesture_free(MyoGesture *gesture);
+//Feeds one 8 channel sample, returns true and sets pose when the classified
+//pose changed
+bool myo_gesture_push(MyoGesture *gesture, const int16_t *sample, myohw_pose_t *pose);
+myohw_pose_t myo_gesture_classify(const MyoGestureModel *model, const float *features);
+
+//Collects labelled windows from recorded sessions and fits a model
+MyoGestureTrainer* myo_gesture_trainer_new(unsigned int window_ms, unsigned int stride_ms);
+void myo_gesture_trainer_free(MyoGestureTrainer *trainer);
+void myo_gesture_trainer_add(MyoGestureTrainer *trainer, const int16_t *sample, myohw_pose_t pose);
+//Starts a new window, eg. between recordings
+void myo_gesture_trainer_split(MyoGestureTrainer *trainer);
+int myo_gesture_trainer_fit(MyoGestureTrainer *trainer, MyoGestureModel *model);
+
+int myo_gesture_model_load(MyoGestureModel *model, const char *file);
+int myo_gesture_model_save(const MyoGestureModel *model, const char *file);
+
+#endif
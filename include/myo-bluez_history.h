@@ -0,0 +1,75 @@
+#ifndef MYO_BLUEZ_HISTORY_H
+#define MYO_BLUEZ_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MYO_HISTORY_MAX_CHANNELS 10
+//full resolution samples kept, about 40s of EMG and IMU
+#define MYO_HISTORY_RAW 2048
+//a bucket on one level sums up this many of the level below
+#define MYO_HISTORY_FANOUT 4
+//buckets of 4, 16, 64, 256 and 1024 samples, the last level reaches back
+//about 3 hours
+#define MYO_HISTORY_LEVELS 5
+#define MYO_HISTORY_BUCKETS 512
+//a longer silence closes every open bucket so none spans a reconnect
+#define MYO_HISTORY_GAP_US 1000000
+
+typedef enum {
+	MYO_HISTORY_EMG,
+	MYO_HISTORY_IMU
+} myo_history_stream_t;
+
+//One pixel column of one channel, count is 0 where nothing arrived
+typedef struct {
+	int16_t min;
+	int16_t max;
+	float mean;
+	uint32_t count;
+} MyoHistoryPoint;
+
+typedef struct {
+	//arrival time of the first sample
+	int64_t start;
+	uint32_t count;
+	int16_t min[MYO_HISTORY_MAX_CHANNELS];
+	int16_t max[MYO_HISTORY_MAX_CHANNELS];
+	int32_t sum[MYO_HISTORY_MAX_CHANNELS];
+} MyoHistoryBucket;
+
+typedef struct {
+	MyoHistoryBucket buckets[MYO_HISTORY_BUCKETS];
+	//still filling, shown in queries like a closed one
+	MyoHistoryBucket open;
+	//buckets of the level below merged into open
+	int children;
+	int head;
+	int count;
+} MyoHistoryLevel;
+
+//Bounded history of one stream. Every sample goes into the raw ring and the
+//first level's open bucket, and a bucket closing merges into the next level
+//up, so a sample costs O(1) amortized.
+typedef struct {
+	int channels;
+	//nominal sample period, picks the level a query reads
+	int64_t period_us;
+	int16_t raw[MYO_HISTORY_RAW][MYO_HISTORY_MAX_CHANNELS];
+	int64_t raw_time[MYO_HISTORY_RAW];
+	int raw_head;
+	int raw_count;
+	int64_t last;
+	MyoHistoryLevel levels[MYO_HISTORY_LEVELS];
+} MyoHistory;
+
+void myo_history_init(MyoHistory *history, int channels, int64_t period_us);
+void myo_history_push(MyoHistory *history, const int16_t *sample, int64_t timestamp);
+//Splits [from, to) into width columns and fills points[column * channels +
+//channel] from the coarsest level whose buckets still fit in a column and
+//that reaches back to from, so the cost depends on width and not on the
+//range. Returns the level read, 0 being the raw samples.
+int myo_history_read(const MyoHistory *history, int64_t from, int64_t to,
+		unsigned int width, MyoHistoryPoint *points);
+
+#endif
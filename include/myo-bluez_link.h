@@ -0,0 +1,100 @@
+#ifndef MYO_BLUEZ_LINK_H
+#define MYO_BLUEZ_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//connection drops remembered
+#define MYO_LINK_HISTORY 16
+//notifications closer than this fraction of the nominal interval came in
+//the same connection event
+#define MYO_LINK_BURST_FRACTION 4
+//this many or more notifications in one run make a burst
+#define MYO_LINK_BURST 3
+//an interval this many times the nominal one is a gap
+#define MYO_LINK_GAP_FACTOR 3
+//longer silences are a stream being restarted, not a gap
+#define MYO_LINK_MAX_GAP_US 5000000
+
+typedef enum {
+	MYO_LINK_EMG,
+	MYO_LINK_IMU,
+	MYO_LINK_STREAMS
+} myo_link_stream_t;
+
+typedef enum {
+	MYO_LINK_NONE,
+	//Device1 RSSI changed
+	MYO_LINK_RSSI,
+	//a gap made up for by a burst right after: the host did not read the
+	//socket for a while, the notifications were queued and not lost
+	MYO_LINK_STALL,
+	//a gap nothing made up for, the notifications are gone
+	MYO_LINK_LOSS
+} myo_link_event_t;
+
+typedef struct {
+	uint64_t notifications;
+	//both smoothed over about 16 intervals, jitter like RFC 3550 but
+	//against the nominal interval
+	float interval_us;
+	float jitter_us;
+	uint64_t bursts;
+	uint32_t longest_burst;
+	uint64_t gaps;
+	int64_t gap_us;
+	int64_t longest_gap_us;
+	uint64_t stalls;
+	uint64_t losses;
+	//notifications missing after a gap and never made up for
+	uint64_t lost;
+} MyoLinkStream;
+
+typedef struct {
+	int64_t connected;
+	int64_t disconnected;
+} MyoLinkDrop;
+
+//All times g_get_monotonic_time
+typedef struct {
+	//dBm, from the Device1 properties while bluez reports them
+	bool has_rssi;
+	int16_t rssi;
+	int64_t rssi_time;
+	bool has_tx_power;
+	int16_t tx_power;
+	uint64_t connects;
+	uint64_t drops;
+	//0 while disconnected
+	int64_t connected_since;
+	MyoLinkStream streams[MYO_LINK_STREAMS];
+	//oldest first
+	MyoLinkDrop history[MYO_LINK_HISTORY];
+	int history_count;
+} MyoLinkStats;
+
+typedef struct {
+	MyoLinkStats stats;
+	int64_t nominal_us[MYO_LINK_STREAMS];
+	int64_t last[MYO_LINK_STREAMS];
+	//notifications in the current run
+	uint32_t run[MYO_LINK_STREAMS];
+	//missing after the last gap, settled once the run after it ends
+	uint32_t owed[MYO_LINK_STREAMS];
+	int64_t owed_gap_us[MYO_LINK_STREAMS];
+	int history_head;
+} MyoLink;
+
+void myo_link_init(MyoLink *link, int64_t emg_interval_us, int64_t imu_interval_us);
+//Counts a notification of stream arriving at timestamp. Returns
+//MYO_LINK_STALL or MYO_LINK_LOSS when an earlier gap is settled, with its
+//length in gap_us and the notifications not made up for in lost.
+myo_link_event_t myo_link_arrival(MyoLink *link, myo_link_stream_t stream, int64_t timestamp,
+		int64_t *gap_us, uint32_t *lost);
+//The stream stops or starts on purpose, the silence is not a gap
+void myo_link_restart(MyoLink *link, myo_link_stream_t stream);
+void myo_link_connected(MyoLink *link, int64_t timestamp);
+void myo_link_disconnected(MyoLink *link, int64_t timestamp);
+void myo_link_copy(const MyoLink *link, MyoLinkStats *stats);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef MYO_BLUEZ_QUALITY_H
+#define MYO_BLUEZ_QUALITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myo-bluez_rate.h"
+
+#define MYO_QUALITY_CHANNELS 8
+//1s of raw EMG, which puts 50Hz and 60Hz, or what they alias to, on exact
+//DFT bins
+#define MYO_QUALITY_WINDOW MYO_EMG_RATE
+//more than this many samples per window at the int16 limits
+#define MYO_QUALITY_MAX_SATURATED 4
+//this many samples in a row at the limits is a clipping burst
+#define MYO_QUALITY_BURST 3
+//a window spanning at most this many steps is flat
+#define MYO_QUALITY_FLAT_RANGE 2
+//more than this fraction of the window's power at 50Hz or 60Hz, where
+//they do not alias to DC
+#define MYO_QUALITY_MAX_LINE_NOISE 0.3f
+
+typedef enum {
+	MYO_QUALITY_SATURATED = 1 << 0,
+	//no signal, usually a sensor that lost skin contact
+	MYO_QUALITY_FLAT = 1 << 1,
+	MYO_QUALITY_LINE_NOISE = 1 << 2,
+	//set as soon as a burst happens, cleared after a window without one
+	MYO_QUALITY_CLIPPING = 1 << 3
+} myo_quality_flag_t;
+
+typedef struct {
+	//myo_quality_flag_t of the last window
+	uint8_t flags;
+	uint64_t samples;
+	//samples at the limits and clipping bursts, since the start
+	uint64_t saturated;
+	uint64_t bursts;
+	//of the last full window, line_noise is the fraction of the power at
+	//50Hz or 60Hz, whichever is larger
+	float mean;
+	float rms;
+	float line_noise;
+	int16_t min;
+	int16_t max;
+} MyoQualityChannel;
+
+//Per channel window accumulators, a sample costs a few multiply-adds
+typedef struct {
+	int32_t sum;
+	int64_t sum_sq;
+	int16_t min;
+	int16_t max;
+	int16_t saturated;
+	int16_t run;
+	bool burst;
+	//Goertzel state at 50Hz and 60Hz
+	float s50[2];
+	float s60[2];
+} MyoQualityWindow;
+
+typedef struct {
+	MyoQualityChannel channels[MYO_QUALITY_CHANNELS];
+	MyoQualityWindow windows[MYO_QUALITY_CHANNELS];
+	int count;
+	//Goertzel coefficients at 50Hz and 60Hz as sampled
+	float coeff50;
+	float coeff60;
+} MyoQuality;
+
+void myo_quality_init(MyoQuality *quality);
+//Feeds one 8 channel sample, returns a bitmask of the channels whose flags
+//changed
+uint8_t myo_quality_push(MyoQuality *quality, const int16_t *sample);
+
+#endif
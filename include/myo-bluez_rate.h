@@ -0,0 +1,13 @@
+#ifndef MYO_BLUEZ_RATE_H
+#define MYO_BLUEZ_RATE_H
+
+//Notifications per second on the EMG characteristic we subscribe to
+//(d5060104), as measured on it by myo-raw. Every other EMG rate and period
+//is derived from this one.
+#define MYO_EMG_NOTIFY_RATE 50
+//each notification carries one sample of 8 16-bit values
+#define MYO_EMG_RATE MYO_EMG_NOTIFY_RATE
+//IMU data notifications carry one sample each
+#define MYO_IMU_RATE 50
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MYO_BLUEZ_RING_H
+#define MYO_BLUEZ_RING_H
+
+#include <stdint.h>
+
+//about 20s of EMG and IMU, has to be a power of two
+#define MYO_RING_CAPACITY 1024
+#define MYO_RING_MAX_CHANNELS 10
+//a read serves at most this many samples, the rest of the ring is slack for
+//the writer to run into while a reader copies
+#define MYO_RING_MAX_READ (MYO_RING_CAPACITY / 2)
+
+//Latest samples of one stream, stored a column per channel. One writer, any
+//number of readers on other threads that never block it: a reader copies
+//and then checks the writer has not reached what it copied, retrying if so.
+typedef struct {
+	int channels;
+	//sequence number of the next sample, published after it is written
+	uint64_t head;
+	//sequence number after the one being written, bumped before writing
+	uint64_t reserved;
+	int16_t data[MYO_RING_MAX_CHANNELS][MYO_RING_CAPACITY];
+	int64_t timestamps[MYO_RING_CAPACITY];
+} MyoRing;
+
+void myo_ring_init(MyoRing *ring, int channels);
+void myo_ring_push(MyoRing *ring, const int16_t *sample, int64_t timestamp);
+//Copies the newest samples with a sequence number of at least since, at most
+//max, oldest first. Either of channels and fchannels may be NULL, fchannels
+//get every channel multiplied by its scale. Returns the number of samples
+//copied and the first one's sequence number in first.
+int myo_ring_read(MyoRing *ring, uint64_t since, int max, int16_t *const *channels,
+		float *const *fchannels, const float *scale, int64_t *timestamps, uint64_t *first);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef MYO_BLUEZ_SPECTRUM_H
+#define MYO_BLUEZ_SPECTRUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "myo-bluez_rate.h"
+
+#define MYO_SPECTRUM_CHANNELS 8
+//640ms of raw EMG, bins are 1.5625Hz apart
+#define MYO_SPECTRUM_WINDOW (MYO_EMG_RATE * 16 / 25)
+#define MYO_SPECTRUM_BINS (MYO_SPECTRUM_WINDOW / 2 + 1)
+#define MYO_SPECTRUM_MAX_BANDS 4
+//100ms
+#define MYO_SPECTRUM_DEFAULT_HOP (MYO_EMG_RATE / 10)
+
+typedef struct {
+	//samples between feature updates, at least 1
+	unsigned int hop;
+	int num_bands;
+	//low and high edge in Hz of each band, a bin belongs to the band its
+	//center falls in, low inclusive
+	float bands[MYO_SPECTRUM_MAX_BANDS][2];
+} MyoSpectrumConfig;
+
+//Features of the last MYO_SPECTRUM_WINDOW samples, per channel. Powers are
+//in squared EMG units and add up to the window's AC mean square.
+typedef struct {
+	int64_t timestamp;
+	float median[MYO_SPECTRUM_CHANNELS];
+	float mean[MYO_SPECTRUM_CHANNELS];
+	float total[MYO_SPECTRUM_CHANNELS];
+	float bands[MYO_SPECTRUM_MAX_BANDS][MYO_SPECTRUM_CHANNELS];
+} MyoSpectrumFeatures;
+
+//Sliding DFT, every sample updates all bins of all channels. Arrays are
+//channel minor so the inner loops run over 8 contiguous floats.
+typedef struct {
+	MyoSpectrumConfig config;
+	float re[MYO_SPECTRUM_BINS][MYO_SPECTRUM_CHANNELS];
+	float im[MYO_SPECTRUM_BINS][MYO_SPECTRUM_CHANNELS];
+	//one full turn, also used to recompute the spectrum now and then
+	float cos[MYO_SPECTRUM_WINDOW];
+	float sin[MYO_SPECTRUM_WINDOW];
+	int16_t history[MYO_SPECTRUM_WINDOW][MYO_SPECTRUM_CHANNELS];
+	int head;
+	int count;
+	unsigned int since_hop;
+	unsigned int since_resync;
+} MyoSpectrum;
+
+//Three bands splitting 10Hz to half of MYO_EMG_RATE and a hop of
+//MYO_SPECTRUM_DEFAULT_HOP
+void myo_spectrum_config_default(MyoSpectrumConfig *config);
+void myo_spectrum_init(MyoSpectrum *spectrum, const MyoSpectrumConfig *config);
+//Feeds one 8 channel sample, returns true and fills out every hop once a
+//full window came in
+bool myo_spectrum_push(MyoSpectrum *spectrum, const int16_t *sample, int64_t timestamp,
+		MyoSpectrumFeatures *out);
+//Computes the features from the current spectrum
+void myo_spectrum_features(const MyoSpectrum *spectrum, MyoSpectrumFeatures *out);
+
+#endif
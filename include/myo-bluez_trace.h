@@ -0,0 +1,74 @@
+#ifndef MYO_BLUEZ_TRACE_H
+#define MYO_BLUEZ_TRACE_H
+
+//Library internal, applications only get myobluez_trace_enable and
+//myobluez_trace_dump through myo-bluez.h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define MYOBLUEZ_TRACE_ARGS 4
+//events kept per thread, must be a power of two
+#define MYOBLUEZ_TRACE_RING_SIZE 4096
+#define MYOBLUEZ_TRACE_MAGIC "MYOTRACE"
+#define MYOBLUEZ_TRACE_VERSION 1
+//myo index used for events that are not tied to a myo
+#define MYOBLUEZ_TRACE_NO_MYO 0xFF
+
+typedef enum {
+	TRACE_NONE,
+	TRACE_MYO_LOOKUP,
+	TRACE_CONNECT,
+	TRACE_CONNECTED,
+	TRACE_CONNECT_FAILED,
+	TRACE_DISCONNECTED,
+	TRACE_SERVICES_RESOLVED,
+	TRACE_INIT_DISPATCH,
+	TRACE_IMU_NOTIFY,
+	TRACE_ARM_NOTIFY,
+	TRACE_EMG_NOTIFY,
+	TRACE_GESTURE,
+	TRACE_ADAPT,
+	TRACE_DISCOVERY,
+	TRACE_BUDGET,
+	TRACE_NUM_EVENTS
+} myobluez_trace_id_t;
+
+typedef struct {
+	uint64_t timestamp; //CLOCK_MONOTONIC, nanoseconds
+	uint32_t seq;
+	uint16_t id;
+	uint8_t myo;
+	uint8_t thread;
+	uint32_t args[MYOBLUEZ_TRACE_ARGS];
+} myobluez_trace_event_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t event_size;
+	uint64_t num_events;
+} myobluez_trace_header_t;
+
+extern volatile int myobluez_trace_enabled;
+
+void myobluez_trace_emit(myobluez_trace_id_t id, uint8_t myo, const uint32_t *args);
+
+//Cheap enough to leave in hot paths: a single branch when tracing is off.
+//Unused arguments are zero filled.
+#define trace(ID, MYO, ...) \
+	do { \
+		if(__builtin_expect(myobluez_trace_enabled, 0)) { \
+			myobluez_trace_emit(ID, MYO, \
+					(const uint32_t[MYOBLUEZ_TRACE_ARGS]){ __VA_ARGS__ }); \
+		} \
+	} while(0)
+
+void myobluez_trace_enable(bool enable);
+//Only uses write(2), so it can be called from a signal handler.
+int myobluez_trace_dump(int fd);
+int myobluez_trace_decode(int fd, FILE *out);
+const char* myobluez_trace_name(uint16_t id);
+
+#endif
@@ -1,8 +1,17 @@
+#include <math.h>
+
 #include <bluetooth/bluetooth.h>
 
 #include <glib.h>
 
 #include "myo-bluez.h"
+#include "myo-bluez_trace.h"
+#include "myo-bluez_att.h"
+#include "myo-bluez_cache.h"
+#include "myo-bluez_adapt.h"
+#include "myo-bluez_budget.h"
+#include "myo-bluez_decimate.h"
+#include "myo-bluez_ring.h"
 
 #define ASSERT(GERR, MSG) \
 	if(GERR != NULL) { \
@@ -10,6 +19,7 @@
 		g_clear_error(&GERR); \
 	}
 
+#define ADAPTER_IFACE "org.bluez.Adapter1"
 #define DEVICE_IFACE "org.bluez.Device1"
 #define GATT_SERVICE_IFACE "org.bluez.GattService1"
 #define GATT_CHARACTERISTIC_IFACE "org.bluez.GattCharacteristic1"
@@ -36,17 +46,21 @@ static const char *ARM_CHAR_UUIDS[] = {"d5060103-a904-deb9-4748-2c7f4a124842"};
 static const char *EMG_UUID = "d5060004-a904-deb9-4748-2c7f4a124842";
 static const char *EMG_CHAR_UUIDS[] = {"d5060104-a904-deb9-4748-2c7f4a124842"};
 
-static GError *error;
-
-static gulong cb_id;
-
-static GDBusObjectManagerClient *bluez_manager;
+typedef struct {
+	GDBusProxy *proxy;
+	//only used by the ATT transport
+	uint16_t handle;
+	uint16_t cccd_handle;
+	bool notifying;
+	//init waits for it, the others resolve when first used
+	bool required;
+} GattChar;
 
 typedef struct {
 	const char *UUID;
 	GDBusProxy *proxy;
 	const char **char_UUIDs;
-	GDBusProxy **char_proxies;
+	GattChar *chars;
 	int num_chars;
 } GattService;
 
@@ -58,8 +72,43 @@ typedef enum {
 	INITIALIZED
 } MyoStatus;
 
+typedef struct MyoBluezCtx MyoBluezCtx;
+
+typedef struct {
+	gpointer callback;
+	gpointer user_data;
+} Subscriber;
+
+//Never changed once published, see subscribers_swap
 typedef struct {
+	int count;
+	Subscriber subs[];
+} SubscriberList;
+
+//nominal time between samples
+#define EMG_PERIOD_US (G_USEC_PER_SEC / MYO_EMG_RATE)
+#define IMU_PERIOD_US (G_USEC_PER_SEC / MYO_IMU_RATE)
+
+#define MAX_RATES 4
+#define MAX_SUBSCRIBERS 4
+
+//Consumers of one stream at one rate, sharing a decimator
+typedef struct {
+	unsigned int rate;
+	MyoDecimator *decimator;
+	Subscriber subs[MAX_SUBSCRIBERS];
+	int num_subs;
+} StreamRate;
+
+typedef struct {
+	MyoBluezCtx *ctx;
+	//serializes reads, writes and notify changes from user threads
+	GMutex lock;
+
 	GDBusProxy *proxy;
+	gulong dev_sig_id;
+	AttLink *att;
+	GSource *retry;
 
 	GattService services[NUM_SERVICES];
 
@@ -69,60 +118,445 @@ typedef struct {
 	gulong imu_sig_id;
 	gulong arm_sig_id;
 	gulong emg_sig_id;
-
+	gulong motion_sig_id;
+	gulong battery_sig_id;
+
+	//published atomically, cb_lock only serializes changes
+	SubscriberList *imu_cbs;
+	SubscriberList *arm_cbs;
+	SubscriberList *emg_cbs;
+	GMutex cb_lock;
+	//what the single callback registration added, guarded by cb_lock
 	imu_cb_t on_imu;
 	arm_cb_t on_arm;
+	//gets the raw notification instead of a subscriber slot, published
+	//atomically on its own
 	emg_cb_t on_emg;
 
+	//host side classifier, only held for a sample at a time
+	GMutex gesture_lock;
+	MyoGesture *gesture;
+
+	//IMU to EMG resampling, held like the classifier
+	GMutex fuse_lock;
+	MyoFuse *fuse;
+	fused_cb_t on_fused;
+	void *fused_user_data;
+
+	GMutex ahrs_lock;
+	MyoAhrs *ahrs;
+	ahrs_cb_t on_ahrs;
+	void *ahrs_user_data;
+
+	GMutex quality_lock;
+	MyoQuality *quality;
+
+	GMutex spectrum_lock;
+	MyoSpectrum *spectrum;
+	spectrum_cb_t on_spectrum;
+	void *spectrum_user_data;
+
+	//dashboard history, only held for a sample or a query at a time
+	GMutex history_lock;
+	MyoHistory *emg_history;
+	MyoHistory *imu_history;
+
+	//link telemetry, written from the main context
+	GMutex link_lock;
+	MyoLink link;
+
+	//acquisition time reconstruction, written from the main context
+	GMutex clock_lock;
+	gint clocked;
+	MyoClock emg_clock;
+	MyoClock imu_clock;
+
+	//rate subscriptions, sub_lock is only held while filtering
+	GMutex sub_lock;
+	StreamRate emg_rates[MAX_RATES];
+	StreamRate imu_rates[MAX_RATES];
+	gint num_subs;
+
+	//latest samples for polling, only written from the main context
+	MyoRing emg_ring;
+	MyoRing imu_ring;
+
+	//modes in effect, which the controller steps down from: the ones from
+	//the last myo_update_enable, or what the budget granted of them.
+	//Guarded by lock
+	myohw_emg_mode_t emg_mode;
+	myohw_imu_mode_t imu_mode;
+	myohw_classifier_mode_t arm_mode;
+	myohw_emg_mode_t requested_emg;
+	myohw_imu_mode_t requested_imu;
+	//budget share, guarded by lock, the rest by the context's budget_lock
+	int priority;
+	int budget_adapter;
+	unsigned int budget_projected;
+	unsigned int budget_achieved;
+	//EMG and IMU notifications since the last budget tick
+	gint budget_count;
+	MyoAdapt adapt;
+	GSource *adapt_timer;
+	adapt_cb_t on_adapt;
+	gint adapting;
+	//the first tick after enabling only starts counting
+	bool adapt_fresh;
+	//consumer time and deliveries since the last tick, only touched from
+	//the main context
+	gint64 busy_us;
+	guint delivered;
+	gint64 tick_start;
+
+	//never sleep and unlocked were sent and have to be undone, guarded by lock
+	bool keepalive;
+	GSource *keepalive_timer;
+
 	GSource *source;
 
+	GCancellable *cancellable;
+	MyoCache *cache;
+	//version, info and layout came from the cache and still need checking
+	bool cache_hit;
+	//characteristics that still have no proxy or handle, init is woken
+	//when this reaches zero
+	int missing_chars;
+
 	MyoStatus myo_status;
-	ConnectionStatus conn_status;
+	//a ConnectionStatus, only written from the context, other threads read
+	//it with g_atomic_int_get
+	gint conn_status;
+	myobluez_transport_t transport;
 } Myo;
 
 //TODO: add unknown services
 #define battery_service services[0]
+#define battery_level battery_service.chars[0]
 #define myo_control_service services[1]
 #define imu_service services[2]
 #define arm_service services[3]
 #define emg_service services[4]
 
-#define firmware_info myo_control_service.char_proxies[0]
-#define version_data myo_control_service.char_proxies[1]
-#define cmd_input myo_control_service.char_proxies[2]
-#define imu_data imu_service.char_proxies[0]
-#define imu_events imu_service.char_proxies[1]
-#define arm_data arm_service.char_proxies[0]
-#define emg_data emg_service.char_proxies[0]
+#define firmware_info myo_control_service.chars[0]
+#define version_data myo_control_service.chars[1]
+#define cmd_input myo_control_service.chars[2]
+#define imu_data imu_service.chars[0]
+#define imu_events imu_service.chars[1]
+#define arm_data arm_service.chars[0]
+#define emg_data emg_service.chars[0]
 
 #define MAX_MYOS 4
-static Myo myos[MAX_MYOS];
-static int num_myos;
+
+struct MyoBluezCtx {
+	//thread-default when the context was made, everything but the public
+	//myo calls happens here
+	GMainContext *context;
+
+	GDBusObjectManagerClient *bluez_manager;
+	gulong cb_id;
+
+	Myo myos[MAX_MYOS];
+	//only grows, from the context, other threads read it with
+	//g_atomic_int_get
+	gint num_myos;
+
+	int (*myo_initialize)(myobluez_myo_t myo);
+	myobluez_transport_t transport;
+	bool cache_enabled;
+	bool keepalive_enabled;
+	//myobluez_need_t
+	unsigned int required;
+
+	//active scanning, discovery_target is 0 when off
+	int discovery_target;
+	int16_t discovery_rssi;
+	gchar **allowlist;
+	GDBusProxy *adapter;
+	GCancellable *discovery_cancellable;
+	//set as soon as StartDiscovery is sent, bluez may be scanning from then on
+	bool discovering;
+
+	MyoEventQueue events;
+	MyoBluezStats stats;
+
+	//bandwidth budget, see budget_rebalance
+	GMutex budget_lock;
+	//set under budget_lock, read without it through g_atomic_int_get
+	gint budget_enabled;
+	MyoBudgetConfig budget;
+	GSource *budget_timer;
+	gint64 budget_tick_start;
+	//myos the last assignment covered, one bit each
+	unsigned int budget_members;
+	//adapter object paths, a myo's budget_adapter indexes this
+	gchar *adapters[MAX_MYOS];
+
+	//system bus unless an address was given
+	gchar *bus_address;
+	GDBusConnection *connection;
+	//DeviceWatch for devices still waiting for their UUIDs
+	GSList *watches;
+
+	//owned by an outside poll loop between prepare and dispatch
+	bool prepared;
+	gint max_priority;
+};
+
+#define MYO_INDEX(MYO) ((uint8_t) ((MYO) - (MYO)->ctx->myos))
 
 typedef struct {
 	GSource parent;
 	Myo *myo;
 } MyoInitSource;
 
-static gboolean myo_init_prepare(GSource *source, gint *timeout_);
+//Waiting for a device's UUIDs to show up
+typedef struct {
+	MyoBluezCtx *ctx;
+	GDBusProxy *proxy;
+	gulong sig_id;
+} DeviceWatch;
+
+//process wide so leaks show up across contexts, see myobluez_get_resources
+static gint live_contexts;
+static gint live_objects;
+static gint live_handlers;
+static gint live_sources;
+
+#define STAT_ADD(CTX, FIELD, N) __atomic_fetch_add(&(CTX)->stats.FIELD, (N), __ATOMIC_RELAXED)
+
+static MyoBluezCtx *default_ctx;
+
 static gboolean myo_init_dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
-static int (*myo_initialize)(myobluez_myo_t myo);
 
+//Only ever dispatched through its ready time, see myo_init_ready
 GSourceFuncs myo_init_funcs = {
-	myo_init_prepare,
+	NULL,
 	NULL,
 	myo_init_dispatch,
 	NULL
 };
 
-static void set_myo(const gchar *path);
+static void set_myo(MyoBluezCtx *ctx, const gchar *path);
 static GSource* myo_init_source_new(Myo *myo, GCancellable *cancellable);
+static void myo_init_ready(Myo *myo);
+static void myo_att_connect(Myo *myo);
+static void myo_att_notify_cb(AttLink *link, uint16_t handle, const uint8_t *value, size_t len, void *user_data);
 
 static void init_GattService(GattService *service, const char *UUID, const char **char_UUIDs, int num_chars) {
 	service->UUID = UUID;
 	service->char_UUIDs = char_UUIDs;
 	service->num_chars = num_chars;
-	service->char_proxies = calloc(num_chars, sizeof(GDBusProxy*));
+	service->chars = calloc(num_chars, sizeof(GattChar));
+}
+
+static void object_finalized(gpointer data, GObject *object) {
+	g_atomic_int_add(&live_objects, -1);
+}
+
+//Counts an object until it is finalized, whoever holds the last reference
+static gpointer track_object(gpointer object) {
+	if(object != NULL && g_object_get_data(object, "myobluez-tracked") == NULL) {
+		g_object_set_data(object, "myobluez-tracked", GINT_TO_POINTER(1));
+		g_object_weak_ref(object, object_finalized, NULL);
+		g_atomic_int_inc(&live_objects);
+	}
+	return object;
+}
+
+static gulong signal_connect(gpointer instance, const gchar *signal, GCallback callback,
+		gpointer user_data)
+{
+	gulong id;
+
+	id = g_signal_connect(instance, signal, callback, user_data);
+	if(id != 0) {
+		g_atomic_int_inc(&live_handlers);
+	}
+	return id;
+}
+
+static void signal_disconnect(gpointer instance, gulong *id) {
+	if(*id != 0) {
+		g_signal_handler_disconnect(instance, *id);
+		g_atomic_int_add(&live_handlers, -1);
+		*id = 0;
+	}
+}
+
+static void source_attach(MyoBluezCtx *ctx, GSource *source) {
+	g_source_attach(source, ctx->context);
+	g_atomic_int_inc(&live_sources);
+}
+
+//Drops our reference, destroying the source first if it is still attached
+static void source_clear(GSource **source) {
+	if(*source != NULL) {
+		if(!g_source_is_destroyed(*source)) {
+			g_source_destroy(*source);
+		}
+		g_source_unref(*source);
+		g_atomic_int_add(&live_sources, -1);
+		*source = NULL;
+	}
+}
+
+static gboolean subscribers_retired(gpointer user_data) {
+	return G_SOURCE_REMOVE;
+}
+
+//Subscriber lists are only read while the context dispatches a
+//notification, so one replaced from any thread is unused once the context
+//gets to an idle source
+static void subscribers_retire(MyoBluezCtx *ctx, SubscriberList *list) {
+	GSource *source;
+
+	if(list == NULL) {
+		return;
+	}
+
+	source = g_idle_source_new();
+	g_source_set_callback(source, subscribers_retired, list, free);
+	g_source_attach(source, ctx->context);
+	g_source_unref(source);
+}
+
+//Publishes a copy of *subs without (callback, old_data) if remove and with
+//(callback, new_data) appended if add, the old list is retired. cb_lock held.
+static int subscribers_swap(Myo *myo, SubscriberList **subs, gpointer callback,
+		bool remove, gpointer old_data, bool add, gpointer new_data)
+{
+	SubscriberList *old = *subs, *list;
+	int i, count = old != NULL ? old->count : 0, found = -1;
+
+	for(i = 0; i < count; i++) {
+		if(old->subs[i].callback != callback) {
+			continue;
+		}
+		if(remove && old->subs[i].user_data == old_data) {
+			found = i;
+		} else if(add && old->subs[i].user_data == new_data) {
+			debug("Already subscribed");
+			return MYOBLUEZ_ERROR;
+		}
+	}
+	if(remove && found < 0) {
+		debug("Not subscribed");
+		return MYOBLUEZ_ERROR;
+	}
+
+	list = NULL;
+	count = count - remove + add;
+	if(count > 0) {
+		list = malloc(sizeof(SubscriberList) + count * sizeof(Subscriber));
+		if(list == NULL) {
+			return MYOBLUEZ_ERROR;
+		}
+		list->count = 0;
+		for(i = 0; old != NULL && i < old->count; i++) {
+			if(i != found) {
+				list->subs[list->count++] = old->subs[i];
+			}
+		}
+		if(add) {
+			list->subs[list->count].callback = callback;
+			list->subs[list->count].user_data = new_data;
+			list->count++;
+		}
+	}
+
+	g_atomic_pointer_set(subs, list);
+	subscribers_retire(myo->ctx, old);
+	return MYOBLUEZ_OK;
+}
+
+static GDBusProxy* bluez_proxy_new(MyoBluezCtx *ctx, const gchar *path, const gchar *iface,
+		GError **error)
+{
+	return track_object(g_dbus_proxy_new_sync(ctx->connection, G_DBUS_PROXY_FLAGS_NONE, NULL,
+			"org.bluez", path, iface, NULL, error));
+}
+
+//Unlinks an entry of a list from g_dbus_object_manager_get_objects
+static GList* drop_object(GList *objects, GList *object) {
+	g_object_unref(object->data);
+	return g_list_delete_link(objects, object);
+}
+
+static void myo_event(Myo *myo, myo_event_type_t type, const void *data, size_t len) {
+	MyoEvent event;
+
+	memset(&event, 0, sizeof(event));
+	event.timestamp = g_get_monotonic_time();
+	event.myo = (myobluez_myo_t) myo;
+	event.type = type;
+	if(data != NULL) {
+		memcpy(&event.classifier, data,
+				MIN(len, sizeof(event) - G_STRUCT_OFFSET(MyoEvent, classifier)));
+	}
+
+	if(type == MYO_EVENT_CONNECTED) {
+		STAT_ADD(myo->ctx, connects, 1);
+		g_mutex_lock(&myo->link_lock);
+		myo_link_connected(&myo->link, event.timestamp);
+		g_mutex_unlock(&myo->link_lock);
+	} else if(type == MYO_EVENT_DISCONNECTED) {
+		STAT_ADD(myo->ctx, disconnects, 1);
+		g_mutex_lock(&myo->link_lock);
+		myo_link_disconnected(&myo->link, event.timestamp);
+		g_mutex_unlock(&myo->link_lock);
+	}
+
+	myo_event_queue_push(&myo->ctx->events, &event);
+}
+
+//RSSI and TxPower of Device1, bluez only has them while it scans
+static void myo_link_property(Myo *myo, const gchar *key, GVariant *value) {
+	MyoLinkEvent event;
+
+	if(!g_variant_is_of_type(value, G_VARIANT_TYPE_INT16)) {
+		return;
+	}
+
+	if(strcmp(key, "RSSI") == 0) {
+		memset(&event, 0, sizeof(event));
+		event.kind = MYO_LINK_RSSI;
+		event.rssi = g_variant_get_int16(value);
+
+		g_mutex_lock(&myo->link_lock);
+		myo->link.stats.has_rssi = true;
+		myo->link.stats.rssi = event.rssi;
+		myo->link.stats.rssi_time = g_get_monotonic_time();
+		g_mutex_unlock(&myo->link_lock);
+
+		myo_event(myo, MYO_EVENT_LINK, &event, sizeof(event));
+	} else if(strcmp(key, "TxPower") == 0) {
+		g_mutex_lock(&myo->link_lock);
+		myo->link.stats.has_tx_power = true;
+		myo->link.stats.tx_power = g_variant_get_int16(value);
+		g_mutex_unlock(&myo->link_lock);
+	}
+}
+
+static const gchar *LINK_PROPERTIES[] = {"RSSI", "TxPower"};
+
+static void myo_link_note(Myo *myo, myo_link_stream_t stream, gint64 timestamp) {
+	MyoLinkEvent event;
+	myo_link_event_t kind;
+	int64_t gap_us;
+	uint32_t lost;
+
+	g_mutex_lock(&myo->link_lock);
+	kind = myo_link_arrival(&myo->link, stream, timestamp, &gap_us, &lost);
+	g_mutex_unlock(&myo->link_lock);
+
+	if(kind != MYO_LINK_NONE) {
+		memset(&event, 0, sizeof(event));
+		event.kind = kind;
+		event.stream = stream;
+		event.lost = MIN(lost, G_MAXUINT16);
+		event.gap_ms = gap_us / 1000;
+		myo_event(myo, MYO_EVENT_LINK, &event, sizeof(event));
+	}
 }
 
 static gint is_device(gconstpointer a, gconstpointer b) {
@@ -163,40 +597,89 @@ static gint is_characteristic(gconstpointer a, gconstpointer b) {
 	}
 }
 
-static Myo* get_myo_from_proxy(GDBusProxy *proxy) {
+static Myo* get_myo_from_proxy(MyoBluezCtx *ctx, GDBusProxy *proxy) {
 	int i;
 
-	for(i = 0; i < num_myos; i++) {
-		if(myos[i].proxy == proxy) {
-			debug("Myo Index: %d", i);
-			return &myos[i];
+	for(i = 0; i < ctx->num_myos; i++) {
+		if(ctx->myos[i].proxy == proxy) {
+			trace(TRACE_MYO_LOOKUP, i, 0);
+			return &ctx->myos[i];
 		}
 	}
 
 	return NULL;
 }
 
-static void set_characteristic(GattService *serv, const gchar *char_path) {
+//Marks what init waits for, the myobluez_need_t bits follow the order of
+//the characteristics
+static void set_required(Myo *myo, unsigned int needs) {
+	int i, j, bit = 0;
+
+	for(i = 0; i < NUM_SERVICES; i++) {
+		for(j = 0; j < myo->services[i].num_chars; j++) {
+			myo->services[i].chars[j].required = (needs & (1 << bit++)) != 0;
+		}
+	}
+}
+
+static bool service_required(const GattService *serv) {
+	int i;
+
+	for(i = 0; i < serv->num_chars; i++) {
+		if(serv->chars[i].required) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int count_chars(Myo *myo) {
+	int i, j, count = 0;
+
+	for(i = 0; i < NUM_SERVICES; i++) {
+		for(j = 0; j < myo->services[i].num_chars; j++) {
+			count += myo->services[i].chars[j].required;
+		}
+	}
+
+	return count;
+}
+
+//Takes proxy, a proxy already set stays as user threads may be using it,
+//lock held
+static void set_char_proxy(Myo *myo, GattService *serv, int i, GDBusProxy *proxy) {
+	if(serv->chars[i].proxy != NULL) {
+		g_object_unref(proxy);
+		return;
+	}
+
+	serv->chars[i].proxy = proxy;
+	if(serv->chars[i].required && --myo->missing_chars == 0) {
+		myo_init_ready(myo);
+	}
+}
+
+static void set_characteristic(Myo *myo, GattService *serv, const gchar *char_path) {
 	int i;
 	GDBusProxy *proxy;
 	GVariant *UUID;
 	const char *UUID_str;
+	GError *error = NULL;
 
 	debug("Setting Characteristic at %s", char_path);
 
-	proxy = g_dbus_proxy_new_for_bus_sync(
-			G_BUS_TYPE_SYSTEM,
-			G_DBUS_PROXY_FLAGS_NONE, NULL, "org.bluez", char_path,
-			GATT_CHARACTERISTIC_IFACE, NULL, &error);
+	proxy = bluez_proxy_new(myo->ctx, char_path, GATT_CHARACTERISTIC_IFACE, &error);
 	ASSERT(error, "Get characteristic proxy failed");
 	if(proxy == NULL) {
 		fprintf(stderr, "Get characteristic proxy failed\n");
+		return;
 	}
 
 	UUID = g_dbus_proxy_get_cached_property(proxy, "UUID");
 	if(UUID == NULL) {
 		//This shouldn't happen
 		debug("Characteristic UUID not set");
+		g_object_unref(proxy);
 		return;
 	}
 	UUID_str = g_variant_get_string(UUID, NULL);
@@ -204,7 +687,9 @@ static void set_characteristic(GattService *serv, const gchar *char_path) {
 	for(i = 0; i < serv->num_chars; i++) {
 		if(strcmp(serv->char_UUIDs[i], UUID_str) == 0) {
 			debug("Characteristic set");
-			serv->char_proxies[i] = proxy;
+			g_mutex_lock(&myo->lock);
+			set_char_proxy(myo, serv, i, proxy);
+			g_mutex_unlock(&myo->lock);
 
 			g_variant_unref(UUID);
 			return;
@@ -225,12 +710,11 @@ static void set_service(Myo *myo, const gchar *serv_path) {
 
 	GList *objects, *object;
 	const gchar *char_path, *char_serv_path;
+	GError *error = NULL;
 
 	debug("Setting Service at %s", serv_path);
 
-	proxy = g_dbus_proxy_new_for_bus_sync(
-			G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL, "org.bluez",
-			serv_path, GATT_SERVICE_IFACE, NULL, &error);
+	proxy = bluez_proxy_new(myo->ctx, serv_path, GATT_SERVICE_IFACE, &error);
 	ASSERT(error, "Get service proxy failed");
 	if(proxy == NULL) {
 		return;
@@ -240,20 +724,33 @@ static void set_service(Myo *myo, const gchar *serv_path) {
 	if(UUID == NULL) {
 		//This shouldn't happen
 		debug("Service UUID not set");
+		g_object_unref(proxy);
 		return;
 	}
 	UUID_str = g_variant_get_string(UUID, NULL);
 
 	for(i = 0; i < NUM_SERVICES; i++) {
 		if(strcmp(UUID_str, myo->services[i].UUID) == 0) {
-			debug("Service set");
-			myo->services[i].proxy = proxy;
-
 			g_variant_unref(UUID);
+			if(!service_required(&myo->services[i])) {
+				//resolved when first used
+				debug("Service not required");
+				g_object_unref(proxy);
+				return;
+			}
+
+			debug("Service set");
+			g_mutex_lock(&myo->lock);
+			if(myo->services[i].proxy == NULL) {
+				myo->services[i].proxy = proxy;
+			} else {
+				g_object_unref(proxy);
+			}
+			g_mutex_unlock(&myo->lock);
 
 			//search for chars
 			objects = g_dbus_object_manager_get_objects(
-					(GDBusObjectManager*) bluez_manager);
+					(GDBusObjectManager*) myo->ctx->bluez_manager);
 			if(NULL == objects) {
 				debug("Manager did not give us objects!");
 				return;
@@ -265,30 +762,29 @@ static void set_service(Myo *myo, const gchar *serv_path) {
 				object = g_list_find_custom(objects, NULL, is_characteristic);
 				if(object != NULL) {
 					char_path = g_dbus_object_get_object_path((GDBusObject*) object->data);
-					chara = g_dbus_proxy_new_for_bus_sync(
-							G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL, "org.bluez",
-							char_path, GATT_CHARACTERISTIC_IFACE, NULL, &error);
+					chara = bluez_proxy_new(myo->ctx, char_path, GATT_CHARACTERISTIC_IFACE,
+							&error);
 					ASSERT(error, "Get characteristic proxy failed");
 					if(chara == NULL) {
-						objects = g_list_delete_link(objects, object);
+						objects = drop_object(objects, object);
 						continue;
 					}
 
 					serv = g_dbus_proxy_get_cached_property(chara, "Service");
+					g_object_unref(chara);
 					if(serv != NULL) {
 						char_serv_path = g_variant_get_string(serv, NULL);
 					} else {
 						debug("Characteristic Service not set");
-						g_variant_unref(serv);
 						g_list_free_full(objects, g_object_unref);
 						return;
 					}
 
 					if(strcmp(serv_path, char_serv_path) == 0) {
-						set_characteristic(&myo->services[i], char_path);
+						set_characteristic(myo, &myo->services[i], char_path);
 					}
 					g_variant_unref(serv);
-					objects = g_list_delete_link(objects, object);
+					objects = drop_object(objects, object);
 				}
 			} while(object != NULL);
 
@@ -304,17 +800,250 @@ static void set_service(Myo *myo, const gchar *serv_path) {
 	return;
 }
 
+static void myo_cache_load(Myo *myo) {
+	GVariant *address;
+
+	if(!myo->ctx->cache_enabled) {
+		return;
+	}
+
+	address = g_dbus_proxy_get_cached_property(myo->proxy, "Address");
+	if(address == NULL) {
+		debug("Myo address not set");
+		return;
+	}
+	myo->cache = myo_cache_open(g_variant_get_string(address, NULL));
+	g_variant_unref(address);
+
+	if(!myo->cache->loaded) {
+		return;
+	}
+
+	//everything else in the cache is keyed by the firmware version
+	if(!myo_cache_get_version(myo->cache, &myo->version)) {
+		myo_cache_clear(myo->cache);
+		return;
+	}
+	if(!myo_cache_get_info(myo->cache, &myo->info)) {
+		myo->info.reserved[0] = 0xFF;
+	}
+
+	debug("Using cached attributes");
+	myo->cache_hit = true;
+}
+
+static void myo_cache_store(Myo *myo) {
+	int i, j;
+	char name[25];
+	GattService *serv;
+	myohw_fw_version_t version;
+	myohw_fw_info_t info;
+
+	if(myo->cache == NULL) {
+		return;
+	}
+
+	for(i = 0; i < NUM_SERVICES; i++) {
+		serv = &myo->services[i];
+		if(serv->proxy != NULL) {
+			myo_cache_set_path(myo->cache, serv->UUID,
+					g_dbus_proxy_get_object_path(serv->proxy));
+		}
+		for(j = 0; j < serv->num_chars; j++) {
+			if(serv->chars[j].proxy != NULL) {
+				myo_cache_set_path(myo->cache, serv->char_UUIDs[j],
+						g_dbus_proxy_get_object_path(serv->chars[j].proxy));
+			}
+			if(serv->chars[j].handle != 0) {
+				myo_cache_set_handles(myo->cache, serv->char_UUIDs[j],
+						serv->chars[j].handle, serv->chars[j].cccd_handle);
+			}
+		}
+	}
+
+	g_mutex_lock(&myo->lock);
+	version = myo->version;
+	info = myo->info;
+	g_mutex_unlock(&myo->lock);
+	if(version.hardware_rev != 0xFFFF) {
+		myo_cache_set_version(myo->cache, &version);
+	}
+	if(info.reserved[0] != 0xFF) {
+		myo_cache_set_info(myo->cache, &info);
+	}
+	if(myo_get_name((myobluez_myo_t) myo, name) >= 0) {
+		myo_cache_set_name(myo->cache, name);
+	}
+
+	myo_cache_save(myo->cache);
+}
+
+//The getters read version and info from other threads under the lock
+static bool myo_version_matches(Myo *myo, const myohw_fw_version_t *version) {
+	bool matches;
+
+	g_mutex_lock(&myo->lock);
+	matches = memcmp(version, &myo->version, sizeof(myohw_fw_version_t)) == 0;
+	g_mutex_unlock(&myo->lock);
+
+	return matches;
+}
+
+static void myo_cache_invalidate(Myo *myo, const myohw_fw_version_t *version) {
+	printf("Firmware changed, dropping cached attributes\n");
+
+	g_mutex_lock(&myo->lock);
+	myo->version = *version;
+	myo->info.reserved[0] = 0xFF;
+	g_mutex_unlock(&myo->lock);
+	myo->cache_hit = false;
+	myo_cache_clear(myo->cache);
+}
+
+static void myo_cache_validate_cb(GObject *source, GAsyncResult *res, gpointer user_data) {
+	Myo *myo = (Myo*) user_data;
+	GError *err = NULL;
+	GVariant *reply, *bytes;
+	const uint8_t *vals;
+	gsize len;
+	myohw_fw_version_t version;
+
+	reply = g_dbus_proxy_call_finish((GDBusProxy*) source, res, &err);
+	if(reply == NULL) {
+		//also where we end up after myobluez_deinit cancelled the read
+		ASSERT(err, "Version read failed");
+		return;
+	}
+
+	bytes = g_variant_get_child_value(reply, 0);
+	vals = g_variant_get_fixed_array(bytes, &len, sizeof(guchar));
+	if(len >= sizeof(version)) {
+		memcpy(&version, vals, sizeof(version));
+		if(!myo_version_matches(myo, &version)) {
+			myo_cache_invalidate(myo, &version);
+			myo_cache_store(myo);
+		} else {
+			myo->cache_hit = false;
+		}
+	}
+
+	g_variant_unref(bytes);
+	g_variant_unref(reply);
+}
+
+//D-Bus transport, the cached version was handed out without a read so check
+//it in the background once streaming
+static void myo_cache_validate(Myo *myo) {
+	GVariantBuilder build_opt;
+
+	if(!myo->cache_hit || myo->version_data.proxy == NULL) {
+		return;
+	}
+
+	g_variant_builder_init(&build_opt, G_VARIANT_TYPE("a{sv}"));
+	g_dbus_proxy_call(myo->version_data.proxy, "ReadValue",
+			g_variant_new("(a{sv})", &build_opt),
+			G_DBUS_CALL_FLAGS_NONE, -1, myo->cancellable,
+			(GAsyncReadyCallback) myo_cache_validate_cb, myo);
+}
+
+static GDBusProxy* get_cached_proxy(Myo *myo, const char *UUID, const char *iface) {
+	GDBusProxy *proxy;
+	GVariant *proxy_UUID;
+	char *path;
+	bool match;
+
+	path = myo_cache_get_path(myo->cache, UUID);
+	if(path == NULL) {
+		return NULL;
+	}
+
+	//the manager already holds proxies for everything bluez exports
+	proxy = track_object(g_dbus_object_manager_get_interface(
+			(GDBusObjectManager*) myo->ctx->bluez_manager, path, iface));
+	g_free(path);
+	if(proxy == NULL) {
+		return NULL;
+	}
+
+	proxy_UUID = g_dbus_proxy_get_cached_property(proxy, "UUID");
+	match = proxy_UUID != NULL && strcmp(g_variant_get_string(proxy_UUID, NULL), UUID) == 0;
+	if(proxy_UUID != NULL) {
+		g_variant_unref(proxy_UUID);
+	}
+	if(!match) {
+		g_object_unref(proxy);
+		return NULL;
+	}
+
+	return proxy;
+}
+
+//D-Bus transport, takes the cached object paths straight from the object
+//manager instead of walking every object once services are resolved
+static void set_cached_chars(Myo *myo) {
+	int i, j;
+	GattService *serv;
+	GDBusProxy *proxy;
+
+	if(!myo->cache_hit || myo->missing_chars == 0) {
+		return;
+	}
+
+	g_mutex_lock(&myo->lock);
+	for(i = 0; i < NUM_SERVICES; i++) {
+		serv = &myo->services[i];
+		if(serv->proxy == NULL) {
+			serv->proxy = get_cached_proxy(myo, serv->UUID, GATT_SERVICE_IFACE);
+		}
+		for(j = 0; j < serv->num_chars; j++) {
+			if(serv->chars[j].proxy != NULL) {
+				continue;
+			}
+			proxy = get_cached_proxy(myo, serv->char_UUIDs[j], GATT_CHARACTERISTIC_IFACE);
+			if(proxy != NULL) {
+				set_char_proxy(myo, serv, j, proxy);
+			}
+		}
+	}
+	g_mutex_unlock(&myo->lock);
+}
+
+//ATT transport, takes the handles from the cache. They are only used once a
+//read shows the firmware is still the one they were stored for
+static bool set_cached_handles(Myo *myo) {
+	int i, j;
+	GattService *serv;
+
+	if(!myo->cache_hit) {
+		return false;
+	}
+
+	for(i = 0; i < NUM_SERVICES; i++) {
+		serv = &myo->services[i];
+		for(j = 0; j < serv->num_chars; j++) {
+			if(!myo_cache_get_handles(myo->cache, serv->char_UUIDs[j],
+					&serv->chars[j].handle, &serv->chars[j].cccd_handle)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
 static void set_services(Myo *myo) {
 	GList *objects, *object;
 	GVariant *device;
 	GDBusProxy *serv;
 	const gchar *myo_path, *serv_path, *serv_dev_path;
+	GError *error = NULL;
 
 	myo_path = g_dbus_proxy_get_object_path(myo->proxy);
 
 	//search for services that are already registered
 	objects = g_dbus_object_manager_get_objects(
-			(GDBusObjectManager*) bluez_manager);
+			(GDBusObjectManager*) myo->ctx->bluez_manager);
 	if(NULL == objects) {
 		//failed
 		fprintf(stderr, "Manager did not give us objects!\n");
@@ -327,21 +1056,19 @@ static void set_services(Myo *myo) {
 		object = g_list_find_custom(objects, NULL, is_service);
 		if(object != NULL) {
 			serv_path = g_dbus_object_get_object_path((GDBusObject*) object->data);
-			serv = g_dbus_proxy_new_for_bus_sync(
-					G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE, NULL, "org.bluez",
-					serv_path, GATT_SERVICE_IFACE, NULL, &error);
+			serv = bluez_proxy_new(myo->ctx, serv_path, GATT_SERVICE_IFACE, &error);
 			ASSERT(error, "Get service proxy failed");
 			if(serv == NULL) {
-				objects = g_list_delete_link(objects, object);
+				objects = drop_object(objects, object);
 				continue;
 			}
 
 			device = g_dbus_proxy_get_cached_property(serv, "Device");
+			g_object_unref(serv);
 			if(device != NULL) {
 				serv_dev_path = g_variant_get_string(device, NULL);
 			} else {
 				debug("Service Device not set");
-				g_variant_unref(device);
 				g_list_free_full(objects, g_object_unref);
 				return;
 			}
@@ -350,7 +1077,7 @@ static void set_services(Myo *myo) {
 				set_service(myo, serv_path);
 			}
 			g_variant_unref(device);
-			objects = g_list_delete_link(objects, object);
+			objects = drop_object(objects, object);
 		}
 	} while(object != NULL);
 
@@ -360,39 +1087,44 @@ static void set_services(Myo *myo) {
 }
 
 static void device_connect_cb(GObject *source, GAsyncResult *res, gpointer user_data) {
-	Myo *myo;
-	GError *err = NULL;
+	Myo *myo = (Myo*) user_data;
+	GError *err = NULL, *error = NULL;
 	GVariant *reply;
 
-	myo = get_myo_from_proxy((GDBusProxy*) source);
-
-	if(myo == NULL || !G_IS_DBUS_PROXY(myo->proxy)) {
-		//couldn't find myo in registered myos
-		//this REALLY shouldn't ever happen
+	reply = g_dbus_proxy_call_finish((GDBusProxy*) source, res, &err);
+	if(g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		//the myo, and maybe its context, is gone
+		g_clear_error(&err);
 		return;
 	}
 
-	reply = g_dbus_proxy_call_finish(myo->proxy, res, &err);
 	if(err != NULL) {
+		trace(TRACE_CONNECT_FAILED, MYO_INDEX(myo), err->code);
+		STAT_ADD(myo->ctx, connect_failures, 1);
 		debug("Connection failed ; %s", err->message);
 		if(strstr(err->message, "Timeout") != NULL) {
 			reply = g_dbus_proxy_call_sync(
 					myo->proxy, "Disconnect", NULL, G_DBUS_CALL_FLAGS_NONE,
 					-1, NULL, &error);
 			ASSERT(error, "Disconnect failed");
-			g_variant_unref(reply);
+			if(reply != NULL) {
+				g_variant_unref(reply);
+			}
 			printf("Retrying...\n");
+			trace(TRACE_CONNECT, MYO_INDEX(myo), 1);
 			g_dbus_proxy_call(
 					myo->proxy, "Connect", NULL, G_DBUS_CALL_FLAGS_NONE,
-					-1, NULL, (GAsyncReadyCallback) device_connect_cb, NULL);
+					-1, myo->cancellable, (GAsyncReadyCallback) device_connect_cb, myo);
 
-			myo->conn_status = CONNECTING;
+			g_atomic_int_set(&myo->conn_status, CONNECTING);
 		}
 		g_clear_error(&err);
 	} else {
 		g_variant_unref(reply);
 
-		myo->conn_status = CONNECTED;
+		g_atomic_int_set(&myo->conn_status, CONNECTED);
+		trace(TRACE_CONNECTED, MYO_INDEX(myo), 0);
+		myo_event(myo, MYO_EVENT_CONNECTED, NULL, 0);
 		printf("Connected!\n");
 	}
 }
@@ -402,7 +1134,7 @@ static void myo_signal_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, g
 	const gchar *key;
 	GVariant *value;
 
-	Myo *myo = NULL;
+	Myo *myo = (Myo*) user_data;
 
 	if(g_variant_n_children(changed) > 0) {
 		g_variant_get(changed, "a{sv}", &iter);
@@ -410,38 +1142,30 @@ static void myo_signal_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, g
 			if(strcmp(key, "Connected") == 0) {
 				//check for disconnect
 				if(!g_variant_get_boolean(value)) {
-					myo = get_myo_from_proxy(proxy);
-
-					if(myo == NULL || !G_IS_DBUS_PROXY(myo->proxy)) {
-						//couldn't find myo in registered myos
-						//this REALLY shouldn't ever happen
-						return;
-					}
-
 					//disconnected
+					trace(TRACE_DISCONNECTED, MYO_INDEX(myo), myo->conn_status);
+					myo_event(myo, MYO_EVENT_DISCONNECTED, NULL, 0);
 					printf("Myo disconnected\n");
 
 					printf("Reconnecting...\n");
+					trace(TRACE_CONNECT, MYO_INDEX(myo), 1);
 					g_dbus_proxy_call(
 							proxy, "Connect", NULL, G_DBUS_CALL_FLAGS_NONE,
-							-1, NULL, (GAsyncReadyCallback) device_connect_cb,
-							NULL);
+							-1, myo->cancellable, (GAsyncReadyCallback) device_connect_cb,
+							myo);
 
-					myo->conn_status = CONNECTING;
+					g_atomic_int_set(&myo->conn_status, CONNECTING);
 				}
 			}  else if(strcmp(key, "ServicesResolved") == 0) {
 				if(g_variant_get_boolean(value)) {
-					myo = get_myo_from_proxy(proxy);
-					if(myo == NULL) {
-						//couldn't find myo in registered myos
-						//this REALLY shouldn't ever happen
-						return;
-					}
+					trace(TRACE_SERVICES_RESOLVED, MYO_INDEX(myo), myo->myo_status);
 					if(myo->myo_status == UNKNOWN) {
 						debug("ServicesResolved");
 						set_services(myo);
 					}
 				}
+			} else {
+				myo_link_property(myo, key, value);
 			}
 		}
 		g_variant_iter_free(iter);
@@ -449,6 +1173,8 @@ static void myo_signal_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, g
 }
 
 static void device_UUID_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
+	DeviceWatch *watch = (DeviceWatch*) user_data;
+	MyoBluezCtx *ctx = watch->ctx;
 	GVariantIter *iter;
 	const gchar *key;
 	GVariant *value;
@@ -460,9 +1186,11 @@ static void device_UUID_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid,
 			if(strcmp(key, "UUIDs") == 0) {
 				//if UUIDs set, kill notifier and call set_myo
 				//TODO: might cause problems if not all UUIDs are set at once
-				g_signal_handler_disconnect(proxy, *((gulong*) user_data));
-				free(user_data);
-				set_myo(g_dbus_proxy_get_object_path(proxy));
+				signal_disconnect(proxy, &watch->sig_id);
+				ctx->watches = g_slist_remove(ctx->watches, watch);
+				set_myo(ctx, g_dbus_proxy_get_object_path(proxy));
+				g_object_unref(watch->proxy);
+				free(watch);
 				break;
 			}
 		}
@@ -470,25 +1198,173 @@ static void device_UUID_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid,
 	}
 }
 
-static void set_myo(const gchar *path) {
-	gulong *sig_id;
+static void myo_init_source_attach(Myo *myo) {
+	GSource *source;
+
+	if(myo->source != NULL) {
+		return;
+	}
+
+	source = myo_init_source_new(myo, myo->cancellable);
+	if(source != NULL) {
+		debug("Attaching source");
+		myo->source = source;
+		source_attach(myo->ctx, source);
+	}
+}
+
+//Called once the last missing characteristic has been resolved
+static void myo_init_ready(Myo *myo) {
+	if(myo->myo_status == INITIALIZED) {
+		return;
+	}
+	myo->myo_status = DISCOVERED;
+
+	myo_init_source_attach(myo);
+	if(myo->source != NULL) {
+		g_source_set_ready_time(myo->source, 0);
+	}
+}
+
+static bool device_allowed(MyoBluezCtx *ctx, GDBusProxy *proxy) {
+	GVariant *address;
+	bool allowed = false;
+	int i;
+
+	if(ctx->allowlist == NULL) {
+		return true;
+	}
+
+	address = g_dbus_proxy_get_cached_property(proxy, "Address");
+	if(address == NULL) {
+		return false;
+	}
+	for(i = 0; ctx->allowlist[i] != NULL && !allowed; i++) {
+		allowed = g_ascii_strcasecmp(ctx->allowlist[i], g_variant_get_string(address, NULL)) == 0;
+	}
+	g_variant_unref(address);
+
+	if(!allowed) {
+		debug("Device %s not in allowlist", g_dbus_proxy_get_object_path(proxy));
+	}
+	return allowed;
+}
+
+static void discovery_stop(MyoBluezCtx *ctx) {
+	if(ctx->adapter == NULL || !ctx->discovering) {
+		return;
+	}
+
+	debug("Stopping discovery");
+	trace(TRACE_DISCOVERY, MYOBLUEZ_TRACE_NO_MYO, 0, ctx->num_myos);
+	ctx->discovering = false;
+	g_dbus_proxy_call(ctx->adapter, "StopDiscovery", NULL, G_DBUS_CALL_FLAGS_NONE,
+			-1, NULL, NULL, NULL);
+}
+
+//Scanning stops once enough myos are there
+static void discovery_check(MyoBluezCtx *ctx) {
+	if(ctx->discovery_target > 0 && ctx->num_myos >= ctx->discovery_target) {
+		discovery_stop(ctx);
+	}
+}
+
+static void discovery_start_cb(GObject *source, GAsyncResult *res, gpointer user_data) {
+	MyoBluezCtx *ctx = (MyoBluezCtx*) user_data;
+	GError *err = NULL;
+	GVariant *reply;
+
+	reply = g_dbus_proxy_call_finish((GDBusProxy*) source, res, &err);
+	if(g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		//the context is gone
+		g_clear_error(&err);
+		return;
+	}
+	if(reply == NULL) {
+		fprintf(stderr, "Starting discovery failed: %s\n", err->message);
+		g_clear_error(&err);
+		ctx->discovering = false;
+		return;
+	}
+	g_variant_unref(reply);
+
+	printf("Scanning...\n");
+	trace(TRACE_DISCOVERY, MYOBLUEZ_TRACE_NO_MYO, 1, ctx->num_myos);
+	//the target may have been reached by known myos in the meantime
+	discovery_check(ctx);
+}
+
+static GDBusProxy* get_adapter(MyoBluezCtx *ctx) {
+	GDBusInterface *adapter = NULL;
+	GList *objects, *object;
+
+	objects = g_dbus_object_manager_get_objects((GDBusObjectManager*) ctx->bluez_manager);
+	for(object = objects; object != NULL && adapter == NULL; object = object->next) {
+		adapter = g_dbus_object_get_interface((GDBusObject*) object->data, ADAPTER_IFACE);
+	}
+	g_list_free_full(objects, g_object_unref);
+
+	return track_object(adapter);
+}
+
+//Filters on the myo service so bluez only reports myos, and only close ones
+//if asked to
+static int discovery_start(MyoBluezCtx *ctx) {
+	GVariantBuilder filter;
+	GVariant *reply;
+	GError *error = NULL;
+
+	if(ctx->discovery_target == 0 || ctx->num_myos >= ctx->discovery_target) {
+		return MYOBLUEZ_OK;
+	}
+
+	ctx->adapter = get_adapter(ctx);
+	if(ctx->adapter == NULL) {
+		fprintf(stderr, "No bluetooth adapter to scan with\n");
+		return MYOBLUEZ_ERROR;
+	}
+
+	g_variant_builder_init(&filter, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&filter, "{sv}", "UUIDs", g_variant_new_strv(&MYO_UUID, 1));
+	g_variant_builder_add(&filter, "{sv}", "Transport", g_variant_new_string("le"));
+	if(ctx->discovery_rssi != 0) {
+		g_variant_builder_add(&filter, "{sv}", "RSSI", g_variant_new_int16(ctx->discovery_rssi));
+	}
+
+	reply = g_dbus_proxy_call_sync(ctx->adapter, "SetDiscoveryFilter",
+			g_variant_new("(a{sv})", &filter), G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	if(reply == NULL) {
+		ASSERT(error, "Set discovery filter failed");
+		return MYOBLUEZ_ERROR;
+	}
+	g_variant_unref(reply);
+
+	ctx->discovery_cancellable = g_cancellable_new();
+	ctx->discovering = true;
+	g_dbus_proxy_call(ctx->adapter, "StartDiscovery", NULL, G_DBUS_CALL_FLAGS_NONE,
+			-1, ctx->discovery_cancellable, discovery_start_cb, ctx);
+
+	return MYOBLUEZ_OK;
+}
+
+static void set_myo(MyoBluezCtx *ctx, const gchar *path) {
+	DeviceWatch *watch;
 
 	GDBusProxy *proxy;
-	GVariant *UUIDs, *serv_res;
+	GVariant *UUIDs, *serv_res, *link_prop;
 	GVariantIter *iter;
 	gchar *uuid;
+	guint i;
 
 	Myo *myo;
 
-	GSource *source;
-
-	if(num_myos == MAX_MYOS) {
+	if(ctx->num_myos == MAX_MYOS) {
 		fprintf(stderr, "Maximum myos already registered\n");
 		return;
 	}
 
-	proxy = (GDBusProxy*) g_dbus_object_manager_get_interface(
-			(GDBusObjectManager*) bluez_manager, path, DEVICE_IFACE);
+	proxy = track_object(g_dbus_object_manager_get_interface(
+			(GDBusObjectManager*) ctx->bluez_manager, path, DEVICE_IFACE));
 	if(!G_IS_DBUS_PROXY(proxy)) {
 		debug("Get device proxy failed");
 		return;
@@ -502,9 +1378,18 @@ static void set_myo(const gchar *path) {
 		if(UUIDs != NULL) {
 			g_variant_unref(UUIDs);
 		}
-		sig_id = (gulong*) malloc(sizeof(gulong));
-		*sig_id = g_signal_connect(proxy, "g-properties-changed",
-									G_CALLBACK(device_UUID_cb), sig_id);
+		//the watch keeps the proxy, freed in ctx_free if UUIDs never show up
+		watch = (DeviceWatch*) malloc(sizeof(DeviceWatch));
+		watch->ctx = ctx;
+		watch->proxy = proxy;
+		watch->sig_id = signal_connect(proxy, "g-properties-changed",
+									G_CALLBACK(device_UUID_cb), watch);
+		ctx->watches = g_slist_prepend(ctx->watches, watch);
+		return;
+	}
+
+	if(!device_allowed(ctx, proxy)) {
+		g_variant_unref(UUIDs);
 		g_object_unref(proxy);
 		return;
 	}
@@ -513,9 +1398,10 @@ static void set_myo(const gchar *path) {
 	g_variant_get(UUIDs, "as", &iter);
 	while(g_variant_iter_loop(iter, "&s", &uuid)) {
 		if(strcmp(uuid, MYO_UUID) == 0) {
-			debug("Myo Index:%d", num_myos);
-			myo = &myos[num_myos++];
+			debug("Myo Index:%d", ctx->num_myos);
+			myo = &ctx->myos[ctx->num_myos];
 			myo->proxy = proxy;
+			g_atomic_int_inc(&ctx->num_myos);
 			break;
 		}
 	}
@@ -528,409 +1414,1988 @@ static void set_myo(const gchar *path) {
 	}
 
 	printf("Myo found!\n");
+	discovery_check(ctx);
 
-	g_signal_connect(myo->proxy, "g-properties-changed", G_CALLBACK(myo_signal_cb), NULL);
-
-	printf("Connecting...\n");
-	g_dbus_proxy_call(
-			myo->proxy, "Connect", NULL, G_DBUS_CALL_FLAGS_NONE,
-			-1, NULL, (GAsyncReadyCallback) device_connect_cb,
-			NULL);
-
-	myo->conn_status = CONNECTING;
+	myo->transport = ctx->transport;
+	myo->cancellable = g_cancellable_new();
+	set_required(myo, ctx->required);
+	myo->missing_chars = count_chars(myo);
 	myo->myo_status = UNKNOWN;
 	myo->version.hardware_rev = 0xFFFF;
 	myo->info.reserved[0] = 0xFF;
-	myo->on_imu = NULL;
-	myo->on_arm = NULL;
-	myo->on_emg = NULL;
 
-	//check ServicesResolved
-	serv_res = g_dbus_proxy_get_cached_property(myo->proxy, "ServicesResolved");
-	if(serv_res != NULL && g_variant_get_boolean(serv_res) && myo->services[0].proxy == NULL) {
-		g_variant_unref(serv_res);
-		debug("ServicesResolved");
-		set_services(myo);
+	for(i = 0; i < G_N_ELEMENTS(LINK_PROPERTIES); i++) {
+		link_prop = g_dbus_proxy_get_cached_property(myo->proxy, LINK_PROPERTIES[i]);
+		if(link_prop != NULL) {
+			myo_link_property(myo, LINK_PROPERTIES[i], link_prop);
+			g_variant_unref(link_prop);
+		}
 	}
 
-	//TODO: use a cancellable
-	source = myo_init_source_new(myo, NULL);
-	if(myo->source == NULL && source != NULL) {
-		debug("Attaching source");
-		myo->source = source;
-		if(g_main_context_get_thread_default() == NULL) {
-			debug("Using default context");
+	myo_cache_load(myo);
+
+	if(myo->transport == MYOBLUEZ_TRANSPORT_ATT) {
+		myo_att_connect(myo);
+	} else {
+		myo->dev_sig_id = signal_connect(myo->proxy, "g-properties-changed",
+				G_CALLBACK(myo_signal_cb), myo);
+
+		printf("Connecting...\n");
+		trace(TRACE_CONNECT, MYO_INDEX(myo), 0);
+		g_dbus_proxy_call(
+				myo->proxy, "Connect", NULL, G_DBUS_CALL_FLAGS_NONE,
+				-1, myo->cancellable, (GAsyncReadyCallback) device_connect_cb,
+				myo);
+
+		g_atomic_int_set(&myo->conn_status, CONNECTING);
+
+		set_cached_chars(myo);
+
+		//check ServicesResolved
+		serv_res = g_dbus_proxy_get_cached_property(myo->proxy, "ServicesResolved");
+		if(serv_res != NULL && g_variant_get_boolean(serv_res) && myo->services[0].proxy == NULL) {
+			g_variant_unref(serv_res);
+			debug("ServicesResolved");
+			set_services(myo);
 		}
-		g_source_attach(source, g_main_context_get_thread_default());
 	}
-}
 
-static void object_added_cb(GDBusObjectManager *manager, GDBusObject *object, gpointer user_data) {
-	if(is_device(object, NULL) == 0) {
-		debug("object_added_devce");
-		set_myo(g_dbus_object_get_object_path(object));
-	} 
+	myo_init_source_attach(myo);
 }
 
-static void myo_imu_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
-	GVariantIter *iter;
-	const gchar *key, *vals;
-	GVariant *value;
-	gsize elements;
-
-	Myo* myo;
-	myohw_imu_data_t data;
+static void set_att_handles(Myo *myo) {
+	int i, j;
+	GattService *serv;
 
-	if(g_variant_n_children(changed) > 0) {
-		g_variant_get(changed, "a{sv}", &iter);
-		while(g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
-			if(strcmp(key, "Value") == 0) {
-				vals = g_variant_get_fixed_array(value, &elements, sizeof(gchar));
-				memcpy(&data, vals, sizeof(myohw_imu_data_t));
+	myo->missing_chars = 0;
 
-				myo = (Myo*) user_data;
-				if(myo != NULL && myo->on_imu != NULL) {
-					myo->on_imu(data);
-				}
+	for(i = 0; i < NUM_SERVICES; i++) {
+		serv = &myo->services[i];
+		for(j = 0; j < serv->num_chars; j++) {
+			serv->chars[j].handle = att_link_find_char(myo->att, serv->char_UUIDs[j],
+					&serv->chars[j].cccd_handle);
+			if(serv->chars[j].handle == 0) {
+				debug("Service %d char %d handle not found", i, j);
+				myo->missing_chars += serv->chars[j].required;
 			}
 		}
-		g_variant_iter_free (iter);
+	}
+
+	trace(TRACE_SERVICES_RESOLVED, MYO_INDEX(myo), myo->myo_status, myo->missing_chars);
+	if(myo->missing_chars == 0) {
+		myo_init_ready(myo);
 	}
 }
 
-static void myo_arm_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
-	GVariantIter *iter;
-	myohw_classifier_event_t event;
-	const gchar *key, *vals;
-	GVariant *value;
-	gsize elements;
-	Myo* myo;
+static void myo_att_disconnect_cb(AttLink *link, void *user_data) {
+	Myo *myo = (Myo*) user_data;
 
-	if(g_variant_n_children(changed) > 0) {
-		g_variant_get(changed, "a{sv}", &iter);
-		while(g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
-			if(strcmp(key, "Value") == 0) {
-				vals = g_variant_get_fixed_array(value, &elements, sizeof(gchar));
-				memcpy(&event, vals, sizeof(event));
+	trace(TRACE_DISCONNECTED, MYO_INDEX(myo), myo->conn_status);
+	myo_event(myo, MYO_EVENT_DISCONNECTED, NULL, 0);
+	printf("Myo disconnected\n");
 
-				myo = (Myo*) user_data;
-				if(myo != NULL && myo->on_arm != NULL) {
-					myo->on_arm(event);
-				}
-			}
-		}
-		g_variant_iter_free (iter);
+	g_mutex_lock(&myo->lock);
+	att_link_free(link);
+	myo->att = NULL;
+	g_mutex_unlock(&myo->lock);
+	g_atomic_int_set(&myo->conn_status, DISCONNECTED);
+
+	//CCCDs are not kept without a bond, so run the initializer again once
+	//the link is back
+	if(myo->myo_status == INITIALIZED) {
+		myo->myo_status = UNKNOWN;
 	}
+
+	printf("Reconnecting...\n");
+	myo_att_connect(myo);
 }
 
-static void myo_emg_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
-	GVariantIter *iter;
-	const gchar *key, *vals;
-	GVariant *value;
+static gboolean myo_att_retry_cb(gpointer user_data) {
+	Myo *myo = (Myo*) user_data;
+
+	source_clear(&myo->retry);
+	myo_att_connect(myo);
+	return G_SOURCE_REMOVE;
+}
 
-	Myo* myo;
-	short emg[8];
-	unsigned char moving;
+static void myo_att_discover_cb(AttLink *link, int err, const uint8_t *value, size_t len,
+		void *user_data)
+{
+	Myo *myo = (Myo*) user_data;
 
-	if(g_variant_n_children(changed) > 0) {
-		g_variant_get(changed, "a{sv}", &iter);
-		while(g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
-			if(strcmp(key, "Value") == 0) {
-				vals = g_variant_get_fixed_array(value, NULL, sizeof(gchar));
-				//not entirely sure what the last byte is, but it's a bitmask
-				//that seems to indicate which sensors think they're being moved
-				//around or something
-				memcpy(emg, vals, 16);
-				moving = vals[16];
-
-				myo = (Myo*) user_data;
-				if(myo != NULL && myo->on_emg != NULL) {
-					myo->on_emg(emg, moving);
-				}
-			}
-		}
-		g_variant_iter_free (iter);
+	if(err != 0) {
+		fprintf(stderr, "ATT discovery failed\n");
+		return;
 	}
+	set_att_handles(myo);
 }
 
-void myo_imu_cb_register(myobluez_myo_t bmyo, imu_cb_t callback) {
-	Myo* myo = (Myo*) bmyo;
-	myo->on_imu = callback;
-}
+static void myo_att_version_cb(AttLink *link, int err, const uint8_t *value, size_t len,
+		void *user_data)
+{
+	Myo *myo = (Myo*) user_data;
+	myohw_fw_version_t version;
 
-void myo_arm_cb_register(myobluez_myo_t bmyo, arm_cb_t callback) {
-	Myo* myo = (Myo*) bmyo;
-	myo->on_arm = callback;
-}
+	if(err == 0 && len == sizeof(version)) {
+		memcpy(&version, value, sizeof(version));
+		if(myo_version_matches(myo, &version)) {
+			myo->cache_hit = false;
+			myo->missing_chars = 0;
+			trace(TRACE_SERVICES_RESOLVED, MYO_INDEX(myo), myo->myo_status, 0);
+			myo_init_ready(myo);
+			return;
+		}
+		myo_cache_invalidate(myo, &version);
+	}
 
-void myo_emg_cb_register(myobluez_myo_t bmyo, emg_cb_t callback) {
-	Myo* myo = (Myo*) bmyo;
-	myo->on_emg = callback;
+	att_link_discover(link, myo_att_discover_cb, myo);
 }
 
-static GVariant* myo_read_value(GDBusProxy *proxy) {
-	GVariantBuilder build_opt;
-	GVariant *var;
+static void myo_att_mtu_cb(AttLink *link, int err, const uint8_t *value, size_t len,
+		void *user_data)
+{
+	Myo *myo = (Myo*) user_data;
 
-	if(proxy == NULL) {
-		debug("Proxy was NULL\n");
-		return NULL;
+	//a peer without MTU exchange is fine, a dead link is not
+	if(err == ATT_ERR_LINK) {
+		return;
 	}
 
-	g_variant_builder_init(&build_opt, G_VARIANT_TYPE("a{sv}"));
-
-	var = g_dbus_proxy_call_sync(proxy, "ReadValue",
-			g_variant_new("(a{sv})", &build_opt),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-	ASSERT(error, "Failed to get value");
-	return var;
+	if(set_cached_handles(myo)) {
+		att_link_read_async(link, myo->version_data.handle, myo_att_version_cb, myo);
+	} else {
+		att_link_discover(link, myo_att_discover_cb, myo);
+	}
 }
 
-char* pose2str(myohw_pose_t pose) {
-	switch(pose) {
-		case myohw_pose_rest:
-			return "Rest";
-		case myohw_pose_fist:
-			return "Fist";
-		case myohw_pose_wave_in:
-			return "Wave in";
-		case myohw_pose_wave_out:
-			return "Wave out";
-		case myohw_pose_fingers_spread:
-			return "Spread";
-		case myohw_pose_double_tap:
-			return "Double Tap";
-		default:
-			return "Unknown";
+static void myo_att_connect_cb(AttLink *link, int err, void *user_data) {
+	Myo *myo = (Myo*) user_data;
+
+	if(err != 0) {
+		trace(TRACE_CONNECT_FAILED, MYO_INDEX(myo), err);
+		STAT_ADD(myo->ctx, connect_failures, 1);
+		debug("Connection failed ; %s", strerror(err));
+		g_mutex_lock(&myo->lock);
+		att_link_free(link);
+		myo->att = NULL;
+		g_mutex_unlock(&myo->lock);
+		g_atomic_int_set(&myo->conn_status, DISCONNECTED);
+
+		printf("Retrying...\n");
+		myo->retry = g_timeout_source_new_seconds(1);
+		g_source_set_callback(myo->retry, myo_att_retry_cb, myo, NULL);
+		source_attach(myo->ctx, myo->retry);
+		return;
 	}
-}
 
-int myo_get_name(myobluez_myo_t bmyo, char *str) {
-	GVariant *name;
-	gsize length;
-	Myo *myo = (Myo*) bmyo;
+	g_atomic_int_set(&myo->conn_status, CONNECTED);
+	trace(TRACE_CONNECTED, MYO_INDEX(myo), 0);
+	myo_event(myo, MYO_EVENT_CONNECTED, NULL, 0);
+	printf("Connected!\n");
 
-	if(myo->proxy == NULL) {
-		debug("Myo proxy not set\n");
-		return -1;
+	att_link_set_handlers(link, myo_att_notify_cb, myo_att_disconnect_cb, myo);
+	if(att_link_set_conn_params(link, ATT_CONN_INTERVAL_MIN, ATT_CONN_INTERVAL_MAX,
+			ATT_CONN_LATENCY, ATT_SUPERVISION_TIMEOUT) != 0) {
+		debug("Could not shorten connection interval");
 	}
 
-	name = g_dbus_proxy_get_cached_property(myo->proxy, "Alias");
-	if(name == NULL) {
-		return -1;
-	}
-	strncpy(str, g_variant_get_string(name, &length), 25);
-	str[24] = '\0';
-	g_variant_unref(name);
-	return (int) length;
+	//the rest of the setup runs from the link's responses, so a slow myo
+	//never holds up the others
+	att_link_exchange_mtu(link, ATT_MAX_MTU, myo_att_mtu_cb, myo);
 }
 
-int myo_get_version(myobluez_myo_t bmyo, myohw_fw_version_t *ver) {
-	GVariant *ver_var;
-	GVariantIter *iter;
-	unsigned char *ver_char;
+static void myo_att_connect(Myo *myo) {
+	GVariant *address, *address_type, *connected, *reply;
+	bool random_address;
+	GError *error = NULL;
 
-	Myo *myo = (Myo*) bmyo;
+	if(myo->proxy == NULL || myo->att != NULL) {
+		return;
+	}
 
-	if(myo->version_data == NULL) {
-		debug("Version data proxy not set\n");
-		return MYOBLUEZ_ERROR;
+	address = g_dbus_proxy_get_cached_property(myo->proxy, "Address");
+	if(address == NULL) {
+		debug("Myo address not set");
+		return;
+	}
+	address_type = g_dbus_proxy_get_cached_property(myo->proxy, "AddressType");
+	random_address = address_type != NULL &&
+			strcmp(g_variant_get_string(address_type, NULL), "random") == 0;
+
+	//otherwise bluetoothd keeps its own ATT channel on the link
+	connected = g_dbus_proxy_get_cached_property(myo->proxy, "Connected");
+	if(connected != NULL && g_variant_get_boolean(connected)) {
+		reply = g_dbus_proxy_call_sync(
+				myo->proxy, "Disconnect", NULL, G_DBUS_CALL_FLAGS_NONE,
+				-1, NULL, &error);
+		ASSERT(error, "Disconnect failed");
+		if(reply != NULL) {
+			g_variant_unref(reply);
+		}
 	}
 
-	if(myo->version.hardware_rev == 0xFFFF) {
-		ver_var = myo_read_value(myo->version_data);
-		if(ver_var != NULL) {
-			g_variant_get(ver_var, "(ay)", &iter);
+	printf("Connecting...\n");
+	trace(TRACE_CONNECT, MYO_INDEX(myo), 0);
+	g_mutex_lock(&myo->lock);
+	myo->att = att_link_connect(g_variant_get_string(address, NULL), random_address,
+			myo->ctx->context, myo_att_connect_cb, myo);
+	g_mutex_unlock(&myo->lock);
+	g_atomic_int_set(&myo->conn_status, myo->att != NULL ? CONNECTING : DISCONNECTED);
+
+	g_variant_unref(address);
+	if(address_type != NULL) {
+		g_variant_unref(address_type);
+	}
+	if(connected != NULL) {
+		g_variant_unref(connected);
+	}
+}
 
-			ver_char = (unsigned char*) &myo->version;
+static void object_added_cb(GDBusObjectManager *manager, GDBusObject *object, gpointer user_data) {
+	MyoBluezCtx *ctx = (MyoBluezCtx*) user_data;
+	int i;
 
-			//TODO:check for overruns
-			while(g_variant_iter_loop(iter, "y", ver_char))  ver_char++;
-			g_variant_iter_free(iter);
-		} else {
-			debug("Failled to read version");
-			return MYOBLUEZ_ERROR;
+	if(is_device(object, NULL) == 0) {
+		debug("object_added_devce");
+		set_myo(ctx, g_dbus_object_get_object_path(object));
+	} else if(is_characteristic(object, NULL) == 0) {
+		for(i = 0; i < ctx->num_myos; i++) {
+			if(ctx->myos[i].transport == MYOBLUEZ_TRANSPORT_DBUS) {
+				set_cached_chars(&ctx->myos[i]);
+			}
 		}
-		g_variant_unref(ver_var);
 	}
+}
 
-	memcpy(ver, &myo->version, sizeof(myohw_fw_version_t));
-	return MYOBLUEZ_OK;
+static int16_t to_int16(float value) {
+	return (int16_t) CLAMP(lrintf(value), INT16_MIN, INT16_MAX);
 }
 
-void myo_EMG_notify_enable(myobluez_myo_t bmyo, bool enable) {
-	Myo *myo = (Myo*) bmyo;
+//Runs one sample through every rate that has consumers. Outputs and the
+//subscribers to hand them to are copied out so no lock is held while calling
+static int stream_push(Myo *myo, StreamRate *rates, const float *in, int channels,
+		float out[][MYO_DECIMATE_MAX_CHANNELS], Subscriber subs[][MAX_SUBSCRIBERS],
+		int *num_subs)
+{
+	StreamRate *r;
+	int i, n = 0;
+
+	g_mutex_lock(&myo->sub_lock);
+	for(i = 0; i < MAX_RATES; i++) {
+		r = &rates[i];
+		if(r->num_subs == 0) {
+			continue;
+		}
+		if(r->decimator == NULL) {
+			memcpy(out[n], in, channels * sizeof(float));
+		} else if(!myo_decimator_push(r->decimator, in, out[n])) {
+			continue;
+		}
+		memcpy(subs[n], r->subs, r->num_subs * sizeof(Subscriber));
+		num_subs[n] = r->num_subs;
+		n++;
+	}
+	g_mutex_unlock(&myo->sub_lock);
 
-	if(myo->emg_data == NULL) {
-		return;
+	return n;
+}
+
+static void myo_imu_subs_deliver(Myo *myo, const myohw_imu_data_t *data) {
+	float in[MYO_DECIMATE_MAX_CHANNELS], out[MAX_RATES][MYO_DECIMATE_MAX_CHANNELS];
+	Subscriber subs[MAX_RATES][MAX_SUBSCRIBERS];
+	int num_subs[MAX_RATES];
+	myohw_imu_data_t imu;
+	float norm;
+	int i, j, n;
+
+	in[0] = data->orientation.w;
+	in[1] = data->orientation.x;
+	in[2] = data->orientation.y;
+	in[3] = data->orientation.z;
+	for(i = 0; i < 3; i++) {
+		in[4 + i] = data->accelerometer[i];
+		in[7 + i] = data->gyroscope[i];
 	}
-	//call start notify or stop notify
-	if(enable) {
-		g_dbus_proxy_call_sync(myo->emg_data, "StartNotify", NULL,
-								G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-		ASSERT(error, "EMG notify enable failed");
-		if(myo->emg_sig_id == 0) {
-			myo->emg_sig_id = g_signal_connect(myo->emg_data,
-					"g-properties-changed", G_CALLBACK(myo_emg_cb), myo);
+
+	n = stream_push(myo, myo->imu_rates, in, 10, out, subs, num_subs);
+	for(i = 0; i < n; i++) {
+		//filtering shortens the quaternion a little
+		norm = sqrtf(out[i][0] * out[i][0] + out[i][1] * out[i][1] +
+				out[i][2] * out[i][2] + out[i][3] * out[i][3]);
+		if(norm > 0.0f) {
+			for(j = 0; j < 4; j++) {
+				out[i][j] *= MYOHW_ORIENTATION_SCALE / norm;
+			}
 		}
-	} else {
-		g_dbus_proxy_call_sync(myo->emg_data, "StopNotify", NULL,
-				G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-		ASSERT(error, "EMG notify disable failed");
-		if(myo->emg_sig_id != 0) {
-			g_signal_handler_disconnect(myo->emg_data, myo->emg_sig_id);
+
+		imu.orientation.w = to_int16(out[i][0]);
+		imu.orientation.x = to_int16(out[i][1]);
+		imu.orientation.y = to_int16(out[i][2]);
+		imu.orientation.z = to_int16(out[i][3]);
+		for(j = 0; j < 3; j++) {
+			imu.accelerometer[j] = to_int16(out[i][4 + j]);
+			imu.gyroscope[j] = to_int16(out[i][7 + j]);
+		}
+
+		for(j = 0; j < num_subs[i]; j++) {
+			((imu_sub_cb_t) subs[i][j].callback)((myobluez_myo_t) myo, &imu, subs[i][j].user_data);
 		}
 	}
 }
 
-void myo_IMU_notify_enable(myobluez_myo_t bmyo, bool enable) {
-	Myo *myo = (Myo*) bmyo;
+static void myo_emg_subs_deliver(Myo *myo, const int16_t *emg, uint8_t moving) {
+	float in[MYO_DECIMATE_MAX_CHANNELS], out[MAX_RATES][MYO_DECIMATE_MAX_CHANNELS];
+	Subscriber subs[MAX_RATES][MAX_SUBSCRIBERS];
+	int num_subs[MAX_RATES];
+	int16_t sample[8];
+	int i, j, n;
 
-	if(myo->imu_data == NULL) {
-		return;
+	for(i = 0; i < 8; i++) {
+		in[i] = emg[i];
 	}
-	//call start notify or stop notify
-	if(enable) {
-		g_dbus_proxy_call_sync(myo->imu_data, "StartNotify", NULL,
-								G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-		ASSERT(error, "IMU notify enable failed");
-		if(myo->imu_sig_id == 0) {
-			myo->imu_sig_id = g_signal_connect(myo->imu_data, "g-properties-changed",
-											G_CALLBACK(myo_imu_cb), myo);
+
+	n = stream_push(myo, myo->emg_rates, in, 8, out, subs, num_subs);
+	for(i = 0; i < n; i++) {
+		for(j = 0; j < 8; j++) {
+			sample[j] = to_int16(out[i][j]);
 		}
-	} else {
-		g_dbus_proxy_call_sync(myo->imu_data, "StopNotify", NULL,
-								G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-		ASSERT(error, "IMU notify disable failed");
-		if(myo->imu_sig_id != 0) {
-			g_signal_handler_disconnect(myo->imu_data, myo->imu_sig_id);
+		for(j = 0; j < num_subs[i]; j++) {
+			((emg_sub_cb_t) subs[i][j].callback)((myobluez_myo_t) myo, sample, moving,
+					subs[i][j].user_data);
 		}
 	}
 }
 
-void myo_arm_indicate_enable(myobluez_myo_t bmyo, bool enable) {
-	Myo *myo = (Myo*) bmyo;
+static int stream_subscribe(Myo *myo, StreamRate *rates, unsigned int native_rate, int channels,
+		unsigned int rate, gpointer callback, gpointer user_data)
+{
+	StreamRate *r = NULL;
+	int i, factor;
+
+	factor = myo_decimator_factor(native_rate, rate);
+	if(factor == 0 || callback == NULL) {
+		debug("Unsupported rate %u", rate);
+		return MYOBLUEZ_ERROR;
+	}
+
+	g_mutex_lock(&myo->sub_lock);
+
+	for(i = 0; i < MAX_RATES && r == NULL; i++) {
+		if(rates[i].num_subs > 0 && rates[i].rate == rate) {
+			r = &rates[i];
+		}
+	}
+	for(i = 0; i < MAX_RATES && r == NULL; i++) {
+		if(rates[i].num_subs == 0) {
+			r = &rates[i];
+			r->rate = rate;
+			if(factor > 1) {
+				r->decimator = malloc(sizeof(MyoDecimator));
+				if(r->decimator == NULL) {
+					g_mutex_unlock(&myo->sub_lock);
+					return MYOBLUEZ_ERROR;
+				}
+				myo_decimator_init(r->decimator, factor, channels);
+			}
+		}
+	}
+
+	if(r == NULL || r->num_subs == MAX_SUBSCRIBERS) {
+		debug("Too many subscriptions");
+		g_mutex_unlock(&myo->sub_lock);
+		return MYOBLUEZ_ERROR;
+	}
+
+	r->subs[r->num_subs].callback = callback;
+	r->subs[r->num_subs].user_data = user_data;
+	r->num_subs++;
+	g_atomic_int_inc(&myo->num_subs);
+
+	g_mutex_unlock(&myo->sub_lock);
+	return MYOBLUEZ_OK;
+}
+
+static int stream_unsubscribe(Myo *myo, StreamRate *rates, unsigned int rate, gpointer callback,
+		gpointer user_data)
+{
+	StreamRate *r;
+	int i, j;
+
+	g_mutex_lock(&myo->sub_lock);
+
+	for(i = 0; i < MAX_RATES; i++) {
+		r = &rates[i];
+		if(r->num_subs == 0 || r->rate != rate) {
+			continue;
+		}
+		for(j = 0; j < r->num_subs; j++) {
+			if(r->subs[j].callback != callback || r->subs[j].user_data != user_data) {
+				continue;
+			}
+
+			r->num_subs--;
+			memmove(&r->subs[j], &r->subs[j + 1], (r->num_subs - j) * sizeof(Subscriber));
+			if(r->num_subs == 0) {
+				free(r->decimator);
+				r->decimator = NULL;
+				r->rate = 0;
+			}
+			g_atomic_int_add(&myo->num_subs, -1);
+
+			g_mutex_unlock(&myo->sub_lock);
+			return MYOBLUEZ_OK;
+		}
+	}
+
+	g_mutex_unlock(&myo->sub_lock);
+	return MYOBLUEZ_ERROR;
+}
+
+//Acquisition time of the sample in a notification arriving now, from the
+//clock model while it runs, otherwise when it arrived
+static void myo_clock_stamp(Myo *myo, myo_clock_stream_t stream, gint64 *stamp) {
+	gint64 now = g_get_monotonic_time();
+
+	if(g_atomic_int_get(&myo->clocked)) {
+		g_mutex_lock(&myo->clock_lock);
+		myo_clock_push(stream == MYO_CLOCK_EMG ? &myo->emg_clock : &myo->imu_clock, 1, now,
+				stamp);
+		g_mutex_unlock(&myo->clock_lock);
+	} else {
+		*stamp = now;
+	}
+}
+
+//Runs one sample through the fusion stage, frames are handed out after the
+//lock is released
+static void myo_fuse_deliver(Myo *myo, const int16_t *emg, const myohw_imu_data_t *imu,
+		gint64 timestamp)
+{
+	MyoFusedFrame frames[MYO_FUSE_MAX_PENDING + 1];
+	fused_cb_t on_fused;
+	void *user_data;
+	int i, n = 0;
+
+	g_mutex_lock(&myo->fuse_lock);
+	on_fused = myo->on_fused;
+	user_data = myo->fused_user_data;
+	if(myo->fuse != NULL) {
+		n = emg != NULL ? myo_fuse_push_emg(myo->fuse, emg, timestamp, frames) :
+				myo_fuse_push_imu(myo->fuse, imu, timestamp, frames);
+	}
+	g_mutex_unlock(&myo->fuse_lock);
+
+	for(i = 0; i < n; i++) {
+		on_fused((myobluez_myo_t) myo, &frames[i], user_data);
+	}
+}
+
+static void myo_ahrs_deliver(Myo *myo, const int16_t *imu, gint64 timestamp) {
+	MyoAhrsSample sample;
+	ahrs_cb_t on_ahrs = NULL;
+	void *user_data = NULL;
+
+	g_mutex_lock(&myo->ahrs_lock);
+	if(myo->ahrs != NULL) {
+		myo_ahrs_push(myo->ahrs, imu, timestamp, &sample);
+		on_ahrs = myo->on_ahrs;
+		user_data = myo->ahrs_user_data;
+	}
+	g_mutex_unlock(&myo->ahrs_lock);
+
+	if(on_ahrs != NULL) {
+		on_ahrs((myobluez_myo_t) myo, &sample, user_data);
+	}
+}
+
+static void myo_imu_deliver(Myo *myo, const uint8_t *vals, gsize len) {
+	myohw_imu_data_t data;
+	int16_t imu[10];
+	gint64 now;
+	SubscriberList *list;
+	int i;
+
+	if(len < sizeof(myohw_imu_data_t)) {
+		return;
+	}
+	trace(TRACE_IMU_NOTIFY, MYO_INDEX(myo), len);
+	memcpy(&data, vals, sizeof(myohw_imu_data_t));
+
+	imu[0] = data.orientation.w;
+	imu[1] = data.orientation.x;
+	imu[2] = data.orientation.y;
+	imu[3] = data.orientation.z;
+	memcpy(&imu[4], data.accelerometer, sizeof(data.accelerometer));
+	memcpy(&imu[7], data.gyroscope, sizeof(data.gyroscope));
+	myo_clock_stamp(myo, MYO_CLOCK_IMU, &now);
+	myo_ring_push(&myo->imu_ring, imu, now);
+	if(g_atomic_pointer_get(&myo->fuse) != NULL) {
+		myo_fuse_deliver(myo, NULL, &data, now);
+	}
+	if(g_atomic_pointer_get(&myo->ahrs) != NULL) {
+		myo_ahrs_deliver(myo, imu, now);
+	}
+	if(g_atomic_pointer_get(&myo->imu_history) != NULL) {
+		g_mutex_lock(&myo->history_lock);
+		if(myo->imu_history != NULL) {
+			myo_history_push(myo->imu_history, imu, now);
+		}
+		g_mutex_unlock(&myo->history_lock);
+	}
+
+	list = g_atomic_pointer_get(&myo->imu_cbs);
+	for(i = 0; list != NULL && i < list->count; i++) {
+		((imu_sub_cb_t) list->subs[i].callback)((myobluez_myo_t) myo, &data,
+				list->subs[i].user_data);
+	}
+
+	if(g_atomic_int_get(&myo->num_subs) > 0) {
+		myo_imu_subs_deliver(myo, &data);
+	}
+}
+
+static void myo_arm_subscribers(Myo *myo, const myohw_classifier_event_t *event) {
+	SubscriberList *list = g_atomic_pointer_get(&myo->arm_cbs);
+	int i;
+
+	for(i = 0; list != NULL && i < list->count; i++) {
+		((arm_sub_cb_t) list->subs[i].callback)((myobluez_myo_t) myo, event,
+				list->subs[i].user_data);
+	}
+}
+
+static void myo_arm_deliver(Myo *myo, const uint8_t *vals, gsize len) {
+	myohw_classifier_event_t event;
+
+	memset(&event, 0, sizeof(event));
+	memcpy(&event, vals, MIN(len, sizeof(event)));
+	trace(TRACE_ARM_NOTIFY, MYO_INDEX(myo), event.type, event.pose);
+	myo_event(myo, MYO_EVENT_CLASSIFIER, &event, sizeof(event));
+
+	myo_arm_subscribers(myo, &event);
+}
+
+static void myo_motion_deliver(Myo *myo, const uint8_t *vals, gsize len) {
+	myohw_motion_event_t event;
+
+	memset(&event, 0, sizeof(event));
+	memcpy(&event, vals, MIN(len, sizeof(event)));
+	myo_event(myo, MYO_EVENT_MOTION, &event, sizeof(event));
+}
+
+static void myo_battery_deliver(Myo *myo, const uint8_t *vals, gsize len) {
+	if(len >= 1) {
+		myo_event(myo, MYO_EVENT_BATTERY, vals, 1);
+	}
+}
+
+static void myo_gesture_deliver(Myo *myo, const int16_t *emg) {
+	myohw_classifier_event_t event;
+	myohw_pose_t pose;
+	bool changed;
+
+	g_mutex_lock(&myo->gesture_lock);
+	changed = myo->gesture != NULL && myo_gesture_push(myo->gesture, emg, &pose);
+	g_mutex_unlock(&myo->gesture_lock);
+	if(!changed) {
+		return;
+	}
+
+	trace(TRACE_GESTURE, MYO_INDEX(myo), pose);
+	memset(&event, 0, sizeof(event));
+	event.type = myohw_classifier_event_pose;
+	event.pose = pose;
+	myo_event(myo, MYO_EVENT_CLASSIFIER, &event, sizeof(event));
+
+	myo_arm_subscribers(myo, &event);
+}
+
+static void myo_quality_deliver(Myo *myo, const int16_t *emg) {
+	uint8_t changed = 0, flags[MYO_QUALITY_CHANNELS], quality[2];
+	int i;
+
+	g_mutex_lock(&myo->quality_lock);
+	if(myo->quality != NULL) {
+		changed = myo_quality_push(myo->quality, emg);
+		for(i = 0; i < MYO_QUALITY_CHANNELS; i++) {
+			flags[i] = myo->quality->channels[i].flags;
+		}
+	}
+	g_mutex_unlock(&myo->quality_lock);
+
+	for(i = 0; i < MYO_QUALITY_CHANNELS; i++) {
+		if(changed & (1 << i)) {
+			quality[0] = i;
+			quality[1] = flags[i];
+			myo_event(myo, MYO_EVENT_QUALITY, quality, sizeof(quality));
+		}
+	}
+}
+
+static void myo_spectrum_deliver(Myo *myo, const int16_t *emg, gint64 timestamp) {
+	MyoSpectrumFeatures features;
+	spectrum_cb_t on_spectrum = NULL;
+	void *user_data = NULL;
+	bool ready = false;
+
+	g_mutex_lock(&myo->spectrum_lock);
+	if(myo->spectrum != NULL) {
+		on_spectrum = myo->on_spectrum;
+		user_data = myo->spectrum_user_data;
+		ready = myo_spectrum_push(myo->spectrum, emg, timestamp, &features);
+	}
+	g_mutex_unlock(&myo->spectrum_lock);
+
+	if(ready) {
+		on_spectrum((myobluez_myo_t) myo, &features, user_data);
+	}
+}
+
+static void myo_history_emg_deliver(Myo *myo, const int16_t *emg, gint64 timestamp) {
+	g_mutex_lock(&myo->history_lock);
+	if(myo->emg_history != NULL) {
+		myo_history_push(myo->emg_history, emg, timestamp);
+	}
+	g_mutex_unlock(&myo->history_lock);
+}
+
+//A notification is one sample of 8 16-bit little-endian values and a byte
+//of which sensors think they are being moved
+static void myo_emg_deliver(Myo *myo, const uint8_t *vals, gsize len) {
+	int16_t emg[8], raw[8];
+	uint8_t moving;
+	SubscriberList *list;
+	emg_cb_t on_emg;
+	gint64 now;
+	int i;
+
+	if(len < 17) {
+		return;
+	}
+	for(i = 0; i < 8; i++) {
+		emg[i] = (int16_t) (vals[2 * i] | vals[2 * i + 1] << 8);
+	}
+	//not entirely sure what the last byte is, but it's a bitmask
+	//that seems to indicate which sensors think they're being moved
+	//around or something
+	moving = vals[16];
+	trace(TRACE_EMG_NOTIFY, MYO_INDEX(myo), moving);
+
+	myo_clock_stamp(myo, MYO_CLOCK_EMG, &now);
+	myo_ring_push(&myo->emg_ring, emg, now);
+	if(g_atomic_pointer_get(&myo->emg_history) != NULL) {
+		myo_history_emg_deliver(myo, emg, now);
+	}
+	if(g_atomic_pointer_get(&myo->fuse) != NULL) {
+		myo_fuse_deliver(myo, emg, NULL, now);
+	}
+	if(g_atomic_pointer_get(&myo->gesture) != NULL) {
+		myo_gesture_deliver(myo, emg);
+	}
+	if(g_atomic_pointer_get(&myo->quality) != NULL) {
+		myo_quality_deliver(myo, emg);
+	}
+	if(g_atomic_pointer_get(&myo->spectrum) != NULL) {
+		myo_spectrum_deliver(myo, emg, now);
+	}
+
+	list = g_atomic_pointer_get(&myo->emg_cbs);
+	for(i = 0; list != NULL && i < list->count; i++) {
+		((emg_sub_cb_t) list->subs[i].callback)((myobluez_myo_t) myo, emg, moving,
+				list->subs[i].user_data);
+	}
+
+	if(g_atomic_int_get(&myo->num_subs) > 0) {
+		myo_emg_subs_deliver(myo, emg, moving);
+	}
+
+	on_emg = g_atomic_pointer_get(&myo->on_emg);
+	if(on_emg != NULL) {
+		memcpy(raw, vals, 16);
+		on_emg(raw, moving);
+	}
+}
+
+//Counts and times every notification, for the stats and for the stream mode
+//controller while it runs
+static void myo_deliver(Myo *myo, void (*deliver)(Myo*, const uint8_t*, gsize),
+		const uint8_t *vals, gsize len)
+{
+	MyoBluezCtx *ctx = myo->ctx;
+	gint64 start, took;
+
+	start = g_get_monotonic_time();
+	if(deliver == myo_emg_deliver) {
+		myo_link_note(myo, MYO_LINK_EMG, start);
+	} else if(deliver == myo_imu_deliver) {
+		myo_link_note(myo, MYO_LINK_IMU, start);
+	}
+	deliver(myo, vals, len);
+	took = g_get_monotonic_time() - start;
+
+	if(deliver == myo_emg_deliver) {
+		STAT_ADD(ctx, emg, 1);
+	} else if(deliver == myo_imu_deliver) {
+		STAT_ADD(ctx, imu, 1);
+	} else if(deliver == myo_arm_deliver) {
+		STAT_ADD(ctx, arm, 1);
+	} else if(deliver == myo_motion_deliver) {
+		STAT_ADD(ctx, motion, 1);
+	} else if(deliver == myo_battery_deliver) {
+		STAT_ADD(ctx, battery, 1);
+	}
+	STAT_ADD(ctx, bytes, len);
+	STAT_ADD(ctx, delivery_us[took <= 0 ? 0 :
+			MIN(g_bit_storage(took), MYOBLUEZ_STATS_BUCKETS - 1)], 1);
+
+	if(deliver == myo_emg_deliver || deliver == myo_imu_deliver) {
+		g_atomic_int_inc(&myo->budget_count);
+	}
+
+	if(g_atomic_int_get(&myo->adapting)) {
+		myo->busy_us += took;
+		if(deliver == myo_emg_deliver || deliver == myo_imu_deliver) {
+			myo->delivered++;
+		}
+	}
+}
+
+//D-Bus transport, characteristic values arrive as property changes
+static void myo_char_value_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid,
+		Myo *myo, void (*deliver)(Myo*, const uint8_t*, gsize))
+{
+	GVariantIter *iter;
+	const gchar *key;
+	const uint8_t *vals;
+	GVariant *value;
+	gsize elements;
+
+	if(myo == NULL) {
+		return;
+	}
+
+	if(g_variant_n_children(changed) > 0) {
+		g_variant_get(changed, "a{sv}", &iter);
+		while(g_variant_iter_loop(iter, "{&sv}", &key, &value)) {
+			if(strcmp(key, "Value") == 0) {
+				vals = g_variant_get_fixed_array(value, &elements, sizeof(gchar));
+				myo_deliver(myo, deliver, vals, elements);
+			}
+		}
+		g_variant_iter_free (iter);
+	}
+}
+
+static void myo_imu_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
+	myo_char_value_cb(proxy, changed, invalid, (Myo*) user_data, myo_imu_deliver);
+}
+
+static void myo_arm_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
+	myo_char_value_cb(proxy, changed, invalid, (Myo*) user_data, myo_arm_deliver);
+}
+
+static void myo_emg_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
+	myo_char_value_cb(proxy, changed, invalid, (Myo*) user_data, myo_emg_deliver);
+}
+
+static void myo_motion_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
+	myo_char_value_cb(proxy, changed, invalid, (Myo*) user_data, myo_motion_deliver);
+}
+
+static void myo_battery_cb(GDBusProxy *proxy, GVariant *changed, GStrv invalid, gpointer user_data) {
+	myo_char_value_cb(proxy, changed, invalid, (Myo*) user_data, myo_battery_deliver);
+}
+
+//ATT transport, notifications come straight off the socket
+static void myo_att_notify_cb(AttLink *link, uint16_t handle, const uint8_t *value, size_t len, void *user_data) {
+	Myo *myo = (Myo*) user_data;
+
+	if(handle == myo->emg_data.handle) {
+		myo_deliver(myo, myo_emg_deliver, value, len);
+	} else if(handle == myo->imu_data.handle) {
+		myo_deliver(myo, myo_imu_deliver, value, len);
+	} else if(handle == myo->arm_data.handle) {
+		myo_deliver(myo, myo_arm_deliver, value, len);
+	} else if(handle == myo->imu_events.handle) {
+		myo_deliver(myo, myo_motion_deliver, value, len);
+	} else if(handle == myo->battery_level.handle) {
+		myo_deliver(myo, myo_battery_deliver, value, len);
+	} else {
+		debug("Notification for unknown handle 0x%04x", handle);
+	}
+}
+
+static int myo_cb_update(Myo *myo, SubscriberList **subs, gpointer callback, gpointer user_data,
+		bool add)
+{
+	int ret;
+
+	if(callback == NULL) {
+		return MYOBLUEZ_ERROR;
+	}
+
+	g_mutex_lock(&myo->cb_lock);
+	ret = subscribers_swap(myo, subs, callback, !add, user_data, add, user_data);
+	g_mutex_unlock(&myo->cb_lock);
+
+	return ret;
+}
+
+int myo_imu_cb_add(myobluez_myo_t bmyo, imu_sub_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	return myo_cb_update(myo, &myo->imu_cbs, (gpointer) callback, user_data, true);
+}
+
+int myo_imu_cb_remove(myobluez_myo_t bmyo, imu_sub_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	return myo_cb_update(myo, &myo->imu_cbs, (gpointer) callback, user_data, false);
+}
+
+int myo_arm_cb_add(myobluez_myo_t bmyo, arm_sub_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	return myo_cb_update(myo, &myo->arm_cbs, (gpointer) callback, user_data, true);
+}
+
+int myo_arm_cb_remove(myobluez_myo_t bmyo, arm_sub_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	return myo_cb_update(myo, &myo->arm_cbs, (gpointer) callback, user_data, false);
+}
+
+int myo_emg_cb_add(myobluez_myo_t bmyo, emg_sub_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	return myo_cb_update(myo, &myo->emg_cbs, (gpointer) callback, user_data, true);
+}
+
+int myo_emg_cb_remove(myobluez_myo_t bmyo, emg_sub_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	return myo_cb_update(myo, &myo->emg_cbs, (gpointer) callback, user_data, false);
+}
+
+//The single IMU and arm callback registrations are subscribers like any
+//other, the callback rides in user_data
+static void legacy_imu_cb(myobluez_myo_t myo, const myohw_imu_data_t *data, void *user_data) {
+	((imu_cb_t) user_data)(*data);
+}
+
+static void legacy_arm_cb(myobluez_myo_t myo, const myohw_classifier_event_t *event,
+		void *user_data)
+{
+	((arm_cb_t) user_data)(*event);
+}
+
+void myo_imu_cb_register(myobluez_myo_t bmyo, imu_cb_t callback) {
+	Myo* myo = (Myo*) bmyo;
+
+	g_mutex_lock(&myo->cb_lock);
+	if(subscribers_swap(myo, &myo->imu_cbs, (gpointer) legacy_imu_cb,
+			myo->on_imu != NULL, (gpointer) myo->on_imu,
+			callback != NULL, (gpointer) callback) == MYOBLUEZ_OK) {
+		myo->on_imu = callback;
+	}
+	g_mutex_unlock(&myo->cb_lock);
+}
+
+void myo_arm_cb_register(myobluez_myo_t bmyo, arm_cb_t callback) {
+	Myo* myo = (Myo*) bmyo;
+
+	g_mutex_lock(&myo->cb_lock);
+	if(subscribers_swap(myo, &myo->arm_cbs, (gpointer) legacy_arm_cb,
+			myo->on_arm != NULL, (gpointer) myo->on_arm,
+			callback != NULL, (gpointer) callback) == MYOBLUEZ_OK) {
+		myo->on_arm = callback;
+	}
+	g_mutex_unlock(&myo->cb_lock);
+}
+
+void myo_emg_cb_register(myobluez_myo_t bmyo, emg_cb_t callback) {
+	Myo* myo = (Myo*) bmyo;
+	g_atomic_pointer_set(&myo->on_emg, callback);
+}
+
+int myo_emg_subscribe(myobluez_myo_t bmyo, unsigned int rate, emg_sub_cb_t callback,
+		void *user_data)
+{
+	Myo *myo = (Myo*) bmyo;
+	return stream_subscribe(myo, myo->emg_rates, MYO_EMG_RATE, 8, rate, (gpointer) callback,
+			user_data);
+}
+
+int myo_emg_unsubscribe(myobluez_myo_t bmyo, unsigned int rate, emg_sub_cb_t callback,
+		void *user_data)
+{
+	Myo *myo = (Myo*) bmyo;
+	return stream_unsubscribe(myo, myo->emg_rates, rate, (gpointer) callback, user_data);
+}
+
+int myo_imu_subscribe(myobluez_myo_t bmyo, unsigned int rate, imu_sub_cb_t callback,
+		void *user_data)
+{
+	Myo *myo = (Myo*) bmyo;
+	return stream_subscribe(myo, myo->imu_rates, MYO_IMU_RATE, 10, rate, (gpointer) callback,
+			user_data);
+}
+
+int myo_imu_unsubscribe(myobluez_myo_t bmyo, unsigned int rate, imu_sub_cb_t callback,
+		void *user_data)
+{
+	Myo *myo = (Myo*) bmyo;
+	return stream_unsubscribe(myo, myo->imu_rates, rate, (gpointer) callback, user_data);
+}
+
+//unit quaternion, g and deg/s
+static const float EMG_SCALE[] = {1, 1, 1, 1, 1, 1, 1, 1};
+static const float IMU_SCALE[] = {
+	1 / MYOHW_ORIENTATION_SCALE, 1 / MYOHW_ORIENTATION_SCALE,
+	1 / MYOHW_ORIENTATION_SCALE, 1 / MYOHW_ORIENTATION_SCALE,
+	1 / MYOHW_ACCELEROMETER_SCALE, 1 / MYOHW_ACCELEROMETER_SCALE, 1 / MYOHW_ACCELEROMETER_SCALE,
+	1 / MYOHW_GYROSCOPE_SCALE, 1 / MYOHW_GYROSCOPE_SCALE, 1 / MYOHW_GYROSCOPE_SCALE
+};
+
+int myo_emg_poll(myobluez_myo_t bmyo, uint64_t since, unsigned int max,
+		int16_t *const *channels, int64_t *timestamps, uint64_t *first)
+{
+	Myo *myo = (Myo*) bmyo;
+	return myo_ring_read(&myo->emg_ring, since, MIN(max, MYO_RING_MAX_READ), channels, NULL,
+			NULL, timestamps, first);
+}
+
+int myo_emg_poll_float(myobluez_myo_t bmyo, uint64_t since, unsigned int max,
+		float *const *channels, int64_t *timestamps, uint64_t *first)
+{
+	Myo *myo = (Myo*) bmyo;
+	return myo_ring_read(&myo->emg_ring, since, MIN(max, MYO_RING_MAX_READ), NULL, channels,
+			EMG_SCALE, timestamps, first);
+}
+
+int myo_imu_poll(myobluez_myo_t bmyo, uint64_t since, unsigned int max,
+		int16_t *const *channels, int64_t *timestamps, uint64_t *first)
+{
+	Myo *myo = (Myo*) bmyo;
+	return myo_ring_read(&myo->imu_ring, since, MIN(max, MYO_RING_MAX_READ), channels, NULL,
+			NULL, timestamps, first);
+}
+
+int myo_imu_poll_float(myobluez_myo_t bmyo, uint64_t since, unsigned int max,
+		float *const *channels, int64_t *timestamps, uint64_t *first)
+{
+	Myo *myo = (Myo*) bmyo;
+	return myo_ring_read(&myo->imu_ring, since, MIN(max, MYO_RING_MAX_READ), NULL, channels,
+			IMU_SCALE, timestamps, first);
+}
+
+static GVariant* myo_read_value(GDBusProxy *proxy) {
+	GVariantBuilder build_opt;
+	GVariant *var;
+	GError *error = NULL;
+
+	if(proxy == NULL) {
+		debug("Proxy was NULL\n");
+		return NULL;
+	}
+
+	g_variant_builder_init(&build_opt, G_VARIANT_TYPE("a{sv}"));
+
+	var = g_dbus_proxy_call_sync(proxy, "ReadValue",
+			g_variant_new("(a{sv})", &build_opt),
+			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	ASSERT(error, "Failed to get value");
+	return var;
+}
+
+//D-Bus transport, finds a characteristic of the myo among the proxies the
+//object manager already holds
+static GDBusProxy* find_char_proxy(Myo *myo, const char *UUID) {
+	GList *objects, *object;
+	GDBusInterface *iface;
+	GVariant *char_UUID;
+	GDBusProxy *proxy = NULL;
+	gchar *prefix;
+
+	objects = g_dbus_object_manager_get_objects(
+			(GDBusObjectManager*) myo->ctx->bluez_manager);
+	prefix = g_strconcat(g_dbus_proxy_get_object_path(myo->proxy), "/", NULL);
+
+	for(object = objects; object != NULL && proxy == NULL; object = object->next) {
+		if(!g_str_has_prefix(g_dbus_object_get_object_path((GDBusObject*) object->data), prefix)) {
+			continue;
+		}
+		iface = g_dbus_object_get_interface((GDBusObject*) object->data,
+				GATT_CHARACTERISTIC_IFACE);
+		if(iface == NULL) {
+			continue;
+		}
+		char_UUID = g_dbus_proxy_get_cached_property((GDBusProxy*) iface, "UUID");
+		if(char_UUID != NULL && strcmp(g_variant_get_string(char_UUID, NULL), UUID) == 0) {
+			proxy = track_object((GDBusProxy*) iface);
+		} else {
+			g_object_unref(iface);
+		}
+		if(char_UUID != NULL) {
+			g_variant_unref(char_UUID);
+		}
+	}
+
+	g_free(prefix);
+	g_list_free_full(objects, g_object_unref);
+	return proxy;
+}
+
+//D-Bus transport, resolves a characteristic init did not wait for the first
+//time it is used
+static bool myo_char_resolve(Myo *myo, GattChar *chr) {
+	GattService *serv;
+	GDBusProxy *proxy;
+	int i, j;
+
+	if(!G_IS_DBUS_PROXY(myo->proxy) || myo->ctx->bluez_manager == NULL) {
+		return false;
+	}
+
+	for(i = 0; i < NUM_SERVICES; i++) {
+		serv = &myo->services[i];
+		for(j = 0; j < serv->num_chars; j++) {
+			if(&serv->chars[j] != chr) {
+				continue;
+			}
+			proxy = myo->cache != NULL ?
+					get_cached_proxy(myo, serv->char_UUIDs[j], GATT_CHARACTERISTIC_IFACE) : NULL;
+			if(proxy == NULL) {
+				proxy = find_char_proxy(myo, serv->char_UUIDs[j]);
+			}
+			if(proxy == NULL) {
+				debug("Service %d char %d not found", i, j);
+				return false;
+			}
+			debug("Service %d char %d resolved on use", i, j);
+			set_char_proxy(myo, serv, j, proxy);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool myo_char_is_set(Myo *myo, GattChar *chr) {
+	if(myo->transport == MYOBLUEZ_TRANSPORT_ATT) {
+		return myo->att != NULL && chr->handle != 0;
+	}
+	return chr->proxy != NULL || (!chr->required && myo_char_resolve(myo, chr));
+}
+
+//The I/O helpers below expect myo->lock to be held
+
+//Writes from the context's own thread, eg. from myo_init or a timer, are
+//only queued so it never waits on the radio, failures show up in the log.
+//Other threads wait for the response.
+static int myo_att_write(Myo *myo, uint16_t handle, const void *value, gsize len) {
+	if(g_main_context_is_owner(myo->ctx->context)) {
+		return att_link_write_async(myo->att, handle, value, len, NULL, NULL) == 0 ?
+				MYOBLUEZ_OK : MYOBLUEZ_ERROR;
+	}
+	return att_link_write(myo->att, handle, value, len) == 0 ? MYOBLUEZ_OK : MYOBLUEZ_ERROR;
+}
+
+//Returns the number of bytes read, or -1
+static int myo_read_char(Myo *myo, GattChar *chr, void *value, gsize len) {
+	GVariant *var, *bytes;
+	const uint8_t *vals;
+	gsize elements;
+
+	if(!myo_char_is_set(myo, chr)) {
+		return -1;
+	}
+
+	if(myo->transport == MYOBLUEZ_TRANSPORT_ATT) {
+		return att_link_read(myo->att, chr->handle, value, len);
+	}
+
+	var = myo_read_value(chr->proxy);
+	if(var == NULL) {
+		return -1;
+	}
+
+	bytes = g_variant_get_child_value(var, 0);
+	vals = g_variant_get_fixed_array(bytes, &elements, sizeof(guchar));
+	elements = MIN(elements, len);
+	memcpy(value, vals, elements);
+	g_variant_unref(bytes);
+	g_variant_unref(var);
+
+	return (int) elements;
+}
+
+static int myo_write_char(Myo *myo, GattChar *chr, const void *value, gsize len) {
+	GVariantBuilder build_opt;
+	GVariant *reply;
+	GError *error = NULL;
+
+	if(!myo_char_is_set(myo, chr)) {
+		return MYOBLUEZ_ERROR;
+	}
+
+	if(myo->transport == MYOBLUEZ_TRANSPORT_ATT) {
+		return myo_att_write(myo, chr->handle, value, len);
+	}
+
+	g_variant_builder_init(&build_opt, G_VARIANT_TYPE("a{sv}"));
+
+	reply = g_dbus_proxy_call_sync(chr->proxy, "WriteValue",
+			g_variant_new("(@aya{sv})",
+				g_variant_new_fixed_array(
+					G_VARIANT_TYPE_BYTE, value, len, sizeof(uint8_t)),
+				&build_opt),
+			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	if(reply == NULL) {
+		ASSERT(error, "Write value failed");
+		return MYOBLUEZ_ERROR;
+	}
+	g_variant_unref(reply);
+
+	return MYOBLUEZ_OK;
+}
+
+static int myo_notify_char(Myo *myo, GattChar *chr, bool enable, uint16_t cccd,
+		GCallback callback, gulong *sig_id)
+{
+	GVariant *reply;
+	GError *error = NULL;
+	uint8_t value[2];
+
+	if(!myo_char_is_set(myo, chr)) {
+		return MYOBLUEZ_ERROR;
+	}
+
+	if(myo->transport == MYOBLUEZ_TRANSPORT_ATT) {
+		bt_put_le16(enable ? cccd : 0, value);
+		if(chr->cccd_handle == 0 ||
+				myo_att_write(myo, chr->cccd_handle, value, sizeof(value)) != MYOBLUEZ_OK) {
+			debug("CCCD write failed");
+			return MYOBLUEZ_ERROR;
+		}
+		chr->notifying = enable;
+		return MYOBLUEZ_OK;
+	}
+
+	//call start notify or stop notify
+	if(enable) {
+		reply = g_dbus_proxy_call_sync(chr->proxy, "StartNotify", NULL,
+								G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+		if(reply == NULL) {
+			ASSERT(error, "Notify enable failed");
+			return MYOBLUEZ_ERROR;
+		}
+		if(*sig_id == 0) {
+			*sig_id = signal_connect(chr->proxy, "g-properties-changed",
+					callback, myo);
+		}
+	} else {
+		reply = g_dbus_proxy_call_sync(chr->proxy, "StopNotify", NULL,
+				G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+		signal_disconnect(chr->proxy, sig_id);
+		if(reply == NULL) {
+			ASSERT(error, "Notify disable failed");
+			return MYOBLUEZ_ERROR;
+		}
+	}
+	g_variant_unref(reply);
+	chr->notifying = enable;
+
+	return MYOBLUEZ_OK;
+}
+
+static int myo_notify_char_locked(Myo *myo, GattChar *chr, bool enable, uint16_t cccd,
+		GCallback callback, gulong *sig_id)
+{
+	int ret;
+
+	g_mutex_lock(&myo->lock);
+	ret = myo_notify_char(myo, chr, enable, cccd, callback, sig_id);
+	g_mutex_unlock(&myo->lock);
+
+	return ret;
+}
+
+int myo_gesture_enable(myobluez_myo_t bmyo, const MyoGestureModel *model,
+		unsigned int window_ms, unsigned int stride_ms)
+{
+	Myo *myo = (Myo*) bmyo;
+	MyoGesture *gesture = NULL, *old;
+
+	//allocate outside the lock, classifying never does
+	if(model != NULL) {
+		gesture = myo_gesture_new(model, window_ms, stride_ms);
+		if(gesture == NULL) {
+			return MYOBLUEZ_ERROR;
+		}
+	}
+
+	g_mutex_lock(&myo->gesture_lock);
+	old = myo->gesture;
+	g_atomic_pointer_set(&myo->gesture, gesture);
+	g_mutex_unlock(&myo->gesture_lock);
+
+	myo_gesture_free(old);
+	return MYOBLUEZ_OK;
+}
 
-	if(myo->arm_data == NULL) {
-		return;
+int myo_fuse_enable(myobluez_myo_t bmyo, fused_cb_t callback, void *user_data) {
+	Myo *myo = (Myo*) bmyo;
+	MyoFuse *fuse = NULL, *old;
+
+	if(callback != NULL) {
+		fuse = malloc(sizeof(MyoFuse));
+		if(fuse == NULL) {
+			return MYOBLUEZ_ERROR;
+		}
+		myo_fuse_init(fuse);
 	}
-	//call start notify or stop notify
+
+	g_mutex_lock(&myo->fuse_lock);
+	old = myo->fuse;
+	myo->on_fused = callback;
+	myo->fused_user_data = user_data;
+	g_atomic_pointer_set(&myo->fuse, fuse);
+	g_mutex_unlock(&myo->fuse_lock);
+
+	free(old);
+	return MYOBLUEZ_OK;
+}
+
+int myo_ahrs_enable(myobluez_myo_t bmyo, const MyoAhrsConfig *config, ahrs_cb_t callback,
+		void *user_data)
+{
+	Myo *myo = (Myo*) bmyo;
+	MyoAhrsConfig defaults;
+	MyoAhrs *ahrs = NULL, *old;
+
+	if(callback != NULL) {
+		ahrs = malloc(sizeof(MyoAhrs));
+		if(ahrs == NULL) {
+			return MYOBLUEZ_ERROR;
+		}
+		if(config == NULL) {
+			myo_ahrs_config_default(&defaults, MYO_AHRS_MADGWICK);
+			config = &defaults;
+		}
+		myo_ahrs_init(ahrs, config);
+	}
+
+	g_mutex_lock(&myo->ahrs_lock);
+	old = myo->ahrs;
+	myo->on_ahrs = callback;
+	myo->ahrs_user_data = user_data;
+	g_atomic_pointer_set(&myo->ahrs, ahrs);
+	g_mutex_unlock(&myo->ahrs_lock);
+
+	free(old);
+	return MYOBLUEZ_OK;
+}
+
+int myo_ahrs_calibrate_bias(myobluez_myo_t bmyo, unsigned int samples) {
+	Myo *myo = (Myo*) bmyo;
+	int ret = MYOBLUEZ_ERROR;
+
+	g_mutex_lock(&myo->ahrs_lock);
+	if(myo->ahrs != NULL) {
+		myo_ahrs_calibrate(myo->ahrs, samples);
+		ret = MYOBLUEZ_OK;
+	}
+	g_mutex_unlock(&myo->ahrs_lock);
+
+	return ret;
+}
+
+int myo_quality_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+	MyoQuality *quality = NULL, *old;
+
 	if(enable) {
-		g_dbus_proxy_call_sync(myo->arm_data, "StartNotify", NULL,
-								G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-		ASSERT(error, "Arm notify enable failed");
-		if(myo->arm_sig_id == 0) {
-			myo->arm_sig_id = g_signal_connect(myo->arm_data, "g-properties-changed",
-											G_CALLBACK(myo_arm_cb), myo);
+		quality = malloc(sizeof(MyoQuality));
+		if(quality == NULL) {
+			return MYOBLUEZ_ERROR;
 		}
-	} else {
-		g_dbus_proxy_call_sync(myo->arm_data, "StopNotify", NULL,
-				G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-		ASSERT(error, "Arm notify disable failed");
-		if(myo->arm_sig_id != 0) {
-			g_signal_handler_disconnect(myo->arm_data, myo->arm_sig_id);
+		myo_quality_init(quality);
+	}
+
+	g_mutex_lock(&myo->quality_lock);
+	old = myo->quality;
+	g_atomic_pointer_set(&myo->quality, quality);
+	g_mutex_unlock(&myo->quality_lock);
+
+	free(old);
+	return MYOBLUEZ_OK;
+}
+
+int myo_quality_get(myobluez_myo_t bmyo, MyoQualityChannel *channels) {
+	Myo *myo = (Myo*) bmyo;
+	int ret = MYOBLUEZ_ERROR;
+
+	g_mutex_lock(&myo->quality_lock);
+	if(myo->quality != NULL) {
+		memcpy(channels, myo->quality->channels, sizeof(myo->quality->channels));
+		ret = MYOBLUEZ_OK;
+	}
+	g_mutex_unlock(&myo->quality_lock);
+
+	return ret;
+}
+
+int myo_spectrum_enable(myobluez_myo_t bmyo, const MyoSpectrumConfig *config,
+		spectrum_cb_t callback, void *user_data)
+{
+	Myo *myo = (Myo*) bmyo;
+	MyoSpectrumConfig defaults;
+	MyoSpectrum *spectrum = NULL, *old;
+
+	if(callback != NULL) {
+		spectrum = malloc(sizeof(MyoSpectrum));
+		if(spectrum == NULL) {
+			return MYOBLUEZ_ERROR;
+		}
+		if(config == NULL) {
+			myo_spectrum_config_default(&defaults);
+			config = &defaults;
+		}
+		myo_spectrum_init(spectrum, config);
+	}
+
+	g_mutex_lock(&myo->spectrum_lock);
+	old = myo->spectrum;
+	myo->on_spectrum = callback;
+	myo->spectrum_user_data = user_data;
+	g_atomic_pointer_set(&myo->spectrum, spectrum);
+	g_mutex_unlock(&myo->spectrum_lock);
+
+	free(old);
+	return MYOBLUEZ_OK;
+}
+
+int myo_link_get(myobluez_myo_t bmyo, MyoLinkStats *stats) {
+	Myo *myo = (Myo*) bmyo;
+
+	g_mutex_lock(&myo->link_lock);
+	myo_link_copy(&myo->link, stats);
+	g_mutex_unlock(&myo->link_lock);
+
+	return MYOBLUEZ_OK;
+}
+
+int myo_clock_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+
+	g_mutex_lock(&myo->clock_lock);
+	myo_clock_init(&myo->emg_clock, EMG_PERIOD_US);
+	myo_clock_init(&myo->imu_clock, IMU_PERIOD_US);
+	g_atomic_int_set(&myo->clocked, enable);
+	g_mutex_unlock(&myo->clock_lock);
+
+	return MYOBLUEZ_OK;
+}
+
+int myo_clock_get(myobluez_myo_t bmyo, myo_clock_stream_t stream, MyoClockStats *stats) {
+	Myo *myo = (Myo*) bmyo;
+	int ret = MYOBLUEZ_ERROR;
+
+	g_mutex_lock(&myo->clock_lock);
+	if(myo->clocked) {
+		*stats = stream == MYO_CLOCK_EMG ? myo->emg_clock.stats : myo->imu_clock.stats;
+		ret = MYOBLUEZ_OK;
+	}
+	g_mutex_unlock(&myo->clock_lock);
+
+	return ret;
+}
+
+int myo_history_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+	MyoHistory *emg = NULL, *imu = NULL, *old_emg, *old_imu;
+
+	if(enable) {
+		emg = malloc(sizeof(MyoHistory));
+		imu = malloc(sizeof(MyoHistory));
+		if(emg == NULL || imu == NULL) {
+			free(emg);
+			free(imu);
+			return MYOBLUEZ_ERROR;
+		}
+		myo_history_init(emg, 8, EMG_PERIOD_US);
+		myo_history_init(imu, 10, IMU_PERIOD_US);
+	}
+
+	g_mutex_lock(&myo->history_lock);
+	old_emg = myo->emg_history;
+	old_imu = myo->imu_history;
+	g_atomic_pointer_set(&myo->emg_history, emg);
+	g_atomic_pointer_set(&myo->imu_history, imu);
+	g_mutex_unlock(&myo->history_lock);
+
+	free(old_emg);
+	free(old_imu);
+	return MYOBLUEZ_OK;
+}
+
+int myo_history_query(myobluez_myo_t bmyo, myo_history_stream_t stream, int64_t from,
+		int64_t to, unsigned int width, MyoHistoryPoint *points)
+{
+	Myo *myo = (Myo*) bmyo;
+	MyoHistory *history;
+	int ret = MYOBLUEZ_ERROR;
+
+	g_mutex_lock(&myo->history_lock);
+	history = stream == MYO_HISTORY_EMG ? myo->emg_history : myo->imu_history;
+	if(history != NULL && myo_history_read(history, from, to, width, points) >= 0) {
+		ret = MYOBLUEZ_OK;
+	}
+	g_mutex_unlock(&myo->history_lock);
+
+	return ret;
+}
+
+char* pose2str(myohw_pose_t pose) {
+	switch(pose) {
+		case myohw_pose_rest:
+			return "Rest";
+		case myohw_pose_fist:
+			return "Fist";
+		case myohw_pose_wave_in:
+			return "Wave in";
+		case myohw_pose_wave_out:
+			return "Wave out";
+		case myohw_pose_fingers_spread:
+			return "Spread";
+		case myohw_pose_double_tap:
+			return "Double Tap";
+		default:
+			return "Unknown";
+	}
+}
+
+static int myo_get_cached_name(Myo *myo, char *str) {
+	char *name;
+	int length;
+
+	if(myo->cache == NULL || (name = myo_cache_get_name(myo->cache)) == NULL) {
+		return -1;
+	}
+
+	length = (int) strlen(name);
+	strncpy(str, name, 25);
+	str[24] = '\0';
+	g_free(name);
+	return length;
+}
+
+int myo_get_name(myobluez_myo_t bmyo, char *str) {
+	GVariant *name;
+	gsize length;
+	Myo *myo = (Myo*) bmyo;
+
+	if(myo->proxy == NULL) {
+		debug("Myo proxy not set\n");
+		return -1;
+	}
+
+	name = g_dbus_proxy_get_cached_property(myo->proxy, "Alias");
+	if(name == NULL) {
+		return myo_get_cached_name(myo, str);
+	}
+	strncpy(str, g_variant_get_string(name, &length), 25);
+	str[24] = '\0';
+	g_variant_unref(name);
+	return (int) length;
+}
+
+int myo_get_version(myobluez_myo_t bmyo, myohw_fw_version_t *ver) {
+	Myo *myo = (Myo*) bmyo;
+	myohw_fw_version_t version;
+
+	g_mutex_lock(&myo->lock);
+
+	if(!myo_char_is_set(myo, &myo->version_data)) {
+		debug("Version data proxy not set\n");
+		g_mutex_unlock(&myo->lock);
+		return MYOBLUEZ_ERROR;
+	}
+
+	if(myo->version.hardware_rev == 0xFFFF) {
+		if(myo_read_char(myo, &myo->version_data, &version, sizeof(myohw_fw_version_t)) < 0) {
+			debug("Failled to read version");
+			g_mutex_unlock(&myo->lock);
+			return MYOBLUEZ_ERROR;
+		}
+		myo->version = version;
+	}
+
+	memcpy(ver, &myo->version, sizeof(myohw_fw_version_t));
+	g_mutex_unlock(&myo->lock);
+	return MYOBLUEZ_OK;
+}
+
+int myo_EMG_notify_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+
+	return myo_notify_char_locked(myo, &myo->emg_data, enable, ATT_CCCD_NOTIFY,
+			G_CALLBACK(myo_emg_cb), &myo->emg_sig_id);
+}
+
+int myo_IMU_notify_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+
+	return myo_notify_char_locked(myo, &myo->imu_data, enable, ATT_CCCD_NOTIFY,
+			G_CALLBACK(myo_imu_cb), &myo->imu_sig_id);
+}
+
+int myo_arm_indicate_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+
+	return myo_notify_char_locked(myo, &myo->arm_data, enable, ATT_CCCD_INDICATE,
+			G_CALLBACK(myo_arm_cb), &myo->arm_sig_id);
+}
+
+int myo_motion_indicate_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+
+	return myo_notify_char_locked(myo, &myo->imu_events, enable, ATT_CCCD_INDICATE,
+			G_CALLBACK(myo_motion_cb), &myo->motion_sig_id);
+}
+
+int myo_battery_notify_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+
+	return myo_notify_char_locked(myo, &myo->battery_level, enable, ATT_CCCD_NOTIFY,
+			G_CALLBACK(myo_battery_cb), &myo->battery_sig_id);
+}
+
+static int myo_write_mode(Myo *myo,
+		myohw_emg_mode_t emg,
+		myohw_imu_mode_t imu,
+		myohw_classifier_mode_t arm)
+{
+	myohw_command_set_mode_t cmd;
+
+	cmd.header.command = myohw_command_set_mode;
+	cmd.header.payload_size = 3;
+	cmd.emg_mode = emg;
+	cmd.imu_mode = imu;
+	cmd.classifier_mode = arm;
+
+	//streams stopping or starting leave silences that are no gaps
+	g_mutex_lock(&myo->link_lock);
+	myo_link_restart(&myo->link, MYO_LINK_EMG);
+	myo_link_restart(&myo->link, MYO_LINK_IMU);
+	g_mutex_unlock(&myo->link_lock);
+
+	return myo_write_char(myo, &myo->cmd_input, &cmd, sizeof(cmd));
+}
+
+static int myo_write_sleep(Myo *myo, myohw_sleep_mode_t sleep, myohw_unlock_type_t unlock) {
+	myohw_command_set_sleep_mode_t sleep_cmd;
+	myohw_command_unlock_t unlock_cmd;
+
+	sleep_cmd.header.command = myohw_command_set_sleep_mode;
+	sleep_cmd.header.payload_size = 1;
+	sleep_cmd.sleep_mode = sleep;
+
+	unlock_cmd.header.command = myohw_command_unlock;
+	unlock_cmd.header.payload_size = 1;
+	unlock_cmd.type = unlock;
+
+	if(myo_write_char(myo, &myo->cmd_input, &sleep_cmd, sizeof(sleep_cmd)) != MYOBLUEZ_OK) {
+		return MYOBLUEZ_ERROR;
+	}
+	return myo_write_char(myo, &myo->cmd_input, &unlock_cmd, sizeof(unlock_cmd));
+}
+
+static gboolean myo_keepalive_tick(gpointer user_data) {
+	Myo *myo = (Myo*) user_data;
+
+	g_mutex_lock(&myo->lock);
+	//the myo forgets after a reconnect, so this also puts it back
+	if(!g_source_is_destroyed(g_main_current_source()) && myo->myo_status == INITIALIZED &&
+			myo->ctx->keepalive_enabled) {
+		if(myo_write_sleep(myo, myohw_sleep_mode_never_sleep, myohw_unlock_hold) != MYOBLUEZ_OK) {
+			debug("Keep-alive failed");
+		}
+	}
+	g_mutex_unlock(&myo->lock);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void myo_keepalive_stop(Myo *myo) {
+	source_clear(&myo->keepalive_timer);
+}
+
+//Keeps the myo awake while it streams, lock held
+static int myo_keepalive_update(Myo *myo) {
+	bool streaming = myo->emg_mode != myohw_emg_mode_none || myo->imu_mode != myohw_imu_mode_none;
+	int ret = MYOBLUEZ_OK;
+
+	if(myo->ctx->keepalive_enabled && streaming) {
+		ret = myo_write_sleep(myo, myohw_sleep_mode_never_sleep, myohw_unlock_hold);
+		myo->keepalive = true;
+		if(myo->keepalive_timer == NULL) {
+			myo->keepalive_timer = g_timeout_source_new_seconds(MYOBLUEZ_KEEPALIVE_S);
+			g_source_set_callback(myo->keepalive_timer, myo_keepalive_tick, myo, NULL);
+			source_attach(myo->ctx, myo->keepalive_timer);
+		}
+	} else if(myo->keepalive) {
+		myo_keepalive_stop(myo);
+		myo->keepalive = false;
+		ret = myo_write_sleep(myo, myohw_sleep_mode_normal, myohw_unlock_lock);
+	}
+
+	return ret;
+}
+
+//Puts modes into effect, lock held
+static int myo_apply_modes(Myo *myo, myohw_emg_mode_t emg, myohw_imu_mode_t imu) {
+	int ret;
+
+	myo->emg_mode = emg;
+	myo->imu_mode = imu;
+	//the controller starts over from the new modes
+	myo_adapt_init(&myo->adapt, emg, imu);
+	ret = myo_write_mode(myo, emg, imu, myo->arm_mode);
+	if(ret == MYOBLUEZ_OK && myo_keepalive_update(myo) != MYOBLUEZ_OK) {
+		debug("Keep-alive update failed");
+	}
+
+	return ret;
+}
+
+//Which adapter the myo is on, budget_lock held
+static int myo_adapter_index(Myo *myo) {
+	MyoBluezCtx *ctx = myo->ctx;
+	GVariant *adapter;
+	const gchar *path;
+	int i;
+
+	if(!G_IS_DBUS_PROXY(myo->proxy)) {
+		return 0;
+	}
+	adapter = g_dbus_proxy_get_cached_property(myo->proxy, "Adapter");
+	if(adapter == NULL) {
+		return 0;
+	}
+
+	path = g_variant_get_string(adapter, NULL);
+	for(i = 0; i < MAX_MYOS && ctx->adapters[i] != NULL; i++) {
+		if(strcmp(ctx->adapters[i], path) == 0) {
+			break;
+		}
+	}
+	if(i < MAX_MYOS && ctx->adapters[i] == NULL) {
+		ctx->adapters[i] = g_strdup(path);
+	}
+	g_variant_unref(adapter);
+
+	return i < MAX_MYOS ? i : 0;
+}
+
+//Splits every adapter's capacity between its connected myos and writes
+//what changed. forced is written either way, it may have a new classifier
+//mode. Only one myo lock is held at a time, so myos may call this with
+//theirs released. Returns forced's write result.
+static int budget_rebalance(MyoBluezCtx *ctx, Myo *forced) {
+	MyoBudgetRequest requests[MAX_MYOS];
+	MyoBudgetGrant grants[MAX_MYOS];
+	MyoBudgetConfig config;
+	Myo *members[MAX_MYOS], *myo;
+	unsigned int mask = 0;
+	int i, n = 0, ret = MYOBLUEZ_OK;
+
+	G_STATIC_ASSERT(MAX_MYOS <= MYO_BUDGET_MAX_REQUESTS);
+
+	g_mutex_lock(&ctx->budget_lock);
+
+	config = ctx->budget;
+	if(!ctx->budget_enabled) {
+		//everything fits, which hands back what was asked for
+		config.capacity = G_MAXUINT;
+	}
+
+	for(i = 0; i < g_atomic_int_get(&ctx->num_myos); i++) {
+		myo = &ctx->myos[i];
+		if(myo != forced && g_atomic_int_get(&myo->conn_status) != CONNECTED) {
+			continue;
+		}
+		g_mutex_lock(&myo->lock);
+		myo->budget_adapter = myo_adapter_index(myo);
+		requests[n].adapter = myo->budget_adapter;
+		requests[n].priority = myo->priority;
+		requests[n].emg = myo->requested_emg;
+		requests[n].imu = myo->requested_imu;
+		g_mutex_unlock(&myo->lock);
+		members[n++] = myo;
+		mask |= 1 << i;
+	}
+	ctx->budget_members = mask;
+
+	myo_budget_assign(&config, requests, n, grants);
+
+	for(i = 0; i < n; i++) {
+		myo = members[i];
+		g_mutex_lock(&myo->lock);
+		myo->budget_projected = grants[i].projected;
+		if(myo == forced || grants[i].emg != myo->emg_mode || grants[i].imu != myo->imu_mode) {
+			trace(TRACE_BUDGET, MYO_INDEX(myo), grants[i].emg, grants[i].imu,
+					grants[i].projected);
+			if(myo_apply_modes(myo, grants[i].emg, grants[i].imu) != MYOBLUEZ_OK) {
+				debug("Budget mode change failed");
+				if(myo == forced) {
+					ret = MYOBLUEZ_ERROR;
+				}
+			}
+		}
+		g_mutex_unlock(&myo->lock);
+	}
+
+	g_mutex_unlock(&ctx->budget_lock);
+
+	return ret;
+}
+
+//Measures what each myo delivers and reassigns when myos came or went
+static gboolean budget_tick(gpointer user_data) {
+	MyoBluezCtx *ctx = (MyoBluezCtx*) user_data;
+	unsigned int mask = 0;
+	gint64 now, elapsed;
+	Myo *myo;
+	int i;
+
+	g_mutex_lock(&ctx->budget_lock);
+
+	//turned off while we waited for the lock
+	if(g_source_is_destroyed(g_main_current_source())) {
+		g_mutex_unlock(&ctx->budget_lock);
+		return G_SOURCE_REMOVE;
+	}
+
+	now = g_get_monotonic_time();
+	elapsed = MAX(now - ctx->budget_tick_start, 1);
+	ctx->budget_tick_start = now;
+	for(i = 0; i < g_atomic_int_get(&ctx->num_myos); i++) {
+		myo = &ctx->myos[i];
+		myo->budget_achieved = (guint64) __atomic_exchange_n(&myo->budget_count, 0,
+				__ATOMIC_RELAXED) * G_USEC_PER_SEC / elapsed;
+		if(g_atomic_int_get(&myo->conn_status) == CONNECTED) {
+			mask |= 1 << i;
 		}
 	}
+
+	g_mutex_unlock(&ctx->budget_lock);
+
+	if(mask != ctx->budget_members) {
+		budget_rebalance(ctx, NULL);
+	}
+
+	return G_SOURCE_CONTINUE;
 }
 
-void myo_update_enable(
+int myo_update_enable(
 		myobluez_myo_t bmyo,
 		myohw_emg_mode_t emg,
 		myohw_imu_mode_t imu,
 		myohw_classifier_mode_t arm)
 {
-	GVariantBuilder build_opt;
-	GVariant *reply;
 	Myo *myo = (Myo*) bmyo;
-	myohw_command_set_mode_t cmd;
+	bool budget;
+	int ret = MYOBLUEZ_OK;
+
+	g_mutex_lock(&myo->lock);
+	myo->requested_emg = emg;
+	myo->requested_imu = imu;
+	myo->arm_mode = arm;
+	budget = g_atomic_int_get(&myo->ctx->budget_enabled);
+	if(!budget) {
+		ret = myo_apply_modes(myo, emg, imu);
+	}
+	g_mutex_unlock(&myo->lock);
 
-	cmd.header.command = myohw_command_set_mode;
-	cmd.header.payload_size = 3;
-	cmd.emg_mode = emg;
-	cmd.imu_mode = imu;
-	cmd.classifier_mode = arm;
+	//may change what the other myos get too
+	if(budget) {
+		ret = budget_rebalance(myo->ctx, myo);
+	}
+	if(ret != MYOBLUEZ_OK) {
+		debug("Update enable failed");
+	}
 
-	g_variant_builder_init(&build_opt, G_VARIANT_TYPE("a{sv}"));
+	return ret;
+}
 
-	reply = g_dbus_proxy_call_sync(myo->cmd_input, "WriteValue",
-			g_variant_new("(@aya{sv})",
-				g_variant_new_fixed_array(
-					G_VARIANT_TYPE_BYTE, (uint8_t*) &cmd, 5, sizeof(uint8_t)),
-				&build_opt),
-			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
-	ASSERT(error, "Update enable failed");
-	if(reply != NULL) {
-		g_variant_unref(reply);
+static gboolean myo_adapt_tick(gpointer user_data) {
+	Myo *myo = (Myo*) user_data;
+	MyoAdaptStats stats;
+	MyoAdaptLevel level;
+	gint64 elapsed;
+	unsigned int expected;
+	adapt_cb_t on_adapt;
+	bool changed = false;
+	int index = 0;
+
+	g_mutex_lock(&myo->lock);
+
+	//turned off while we waited for the lock
+	if(g_source_is_destroyed(g_main_current_source())) {
+		g_mutex_unlock(&myo->lock);
+		return G_SOURCE_REMOVE;
+	}
+
+	if(myo->adapt_fresh) {
+		myo->adapt_fresh = false;
+		if(myo->att != NULL) {
+			att_link_take_max_pending(myo->att);
+		}
+		g_mutex_unlock(&myo->lock);
+		myo->busy_us = 0;
+		myo->delivered = 0;
+		myo->tick_start = g_get_monotonic_time();
+		return G_SOURCE_CONTINUE;
+	}
+
+	elapsed = g_get_monotonic_time() - myo->tick_start;
+	level = *myo_adapt_current(&myo->adapt);
+	expected = myo_adapt_expected_rate(&level, myo->emg_data.notifying, myo->imu_data.notifying);
+
+	stats.load = elapsed > 0 ? (double) myo->busy_us / elapsed : 0.0;
+	stats.depth = myo->att != NULL ? (double) att_link_take_max_pending(myo->att) / ATT_PENDING : 0.0;
+	stats.delivered = expected > 0 && elapsed > 0 ?
+			myo->delivered / (expected * (double) elapsed / G_USEC_PER_SEC) : -1.0;
+
+	if(myo->myo_status == INITIALIZED && myo_adapt_update(&myo->adapt, &stats)) {
+		level = *myo_adapt_current(&myo->adapt);
+		index = myo->adapt.level;
+		changed = true;
+		if(myo_write_mode(myo, level.emg, level.imu, myo->arm_mode) != MYOBLUEZ_OK) {
+			debug("Adapt mode change failed");
+		}
 	}
+
+	g_mutex_unlock(&myo->lock);
+
+	//the mode write blocks, start counting after it
+	myo->busy_us = 0;
+	myo->delivered = 0;
+	myo->tick_start = g_get_monotonic_time();
+
+	if(changed) {
+		trace(TRACE_ADAPT, MYO_INDEX(myo), index, level.emg, level.imu,
+				(uint32_t) (myo->adapt.pressure * 100));
+		on_adapt = g_atomic_pointer_get(&myo->on_adapt);
+		if(on_adapt != NULL) {
+			on_adapt((myobluez_myo_t) myo, level.emg, level.imu, index);
+		}
+	}
+
+	return G_SOURCE_CONTINUE;
 }
 
-int myo_get_info(myobluez_myo_t bmyo, myohw_fw_info_t *info) {
-	GVariant *info_var;
-	GVariantIter *iter;
-	unsigned char *info_char = (unsigned char*) info;
+int myo_adapt_enable(myobluez_myo_t bmyo, bool enable) {
+	Myo *myo = (Myo*) bmyo;
+	int ret = MYOBLUEZ_OK;
+
+	g_mutex_lock(&myo->lock);
+
+	if(enable && myo->adapt_timer == NULL) {
+		myo_adapt_init(&myo->adapt, myo->emg_mode, myo->imu_mode);
+		myo->adapt_fresh = true;
+		myo->adapt_timer = g_timeout_source_new(MYO_ADAPT_TICK_MS);
+		g_source_set_callback(myo->adapt_timer, myo_adapt_tick, myo, NULL);
+		source_attach(myo->ctx, myo->adapt_timer);
+		g_atomic_int_set(&myo->adapting, true);
+	} else if(!enable && myo->adapt_timer != NULL) {
+		g_atomic_int_set(&myo->adapting, false);
+		source_clear(&myo->adapt_timer);
+
+		if(myo->adapt.level != 0) {
+			ret = myo_write_mode(myo, myo->emg_mode, myo->imu_mode, myo->arm_mode);
+		}
+		myo_adapt_init(&myo->adapt, myo->emg_mode, myo->imu_mode);
+	}
+
+	g_mutex_unlock(&myo->lock);
+
+	return ret;
+}
+
+int myo_set_priority(myobluez_myo_t bmyo, int priority) {
+	Myo *myo = (Myo*) bmyo;
+
+	g_mutex_lock(&myo->lock);
+	myo->priority = priority;
+	g_mutex_unlock(&myo->lock);
+
+	if(g_atomic_int_get(&myo->ctx->budget_enabled)) {
+		budget_rebalance(myo->ctx, NULL);
+	}
+	return MYOBLUEZ_OK;
+}
+
+void myo_adapt_cb_register(myobluez_myo_t bmyo, adapt_cb_t callback) {
+	Myo *myo = (Myo*) bmyo;
+	g_atomic_pointer_set(&myo->on_adapt, callback);
+}
 
+int myo_get_info(myobluez_myo_t bmyo, myohw_fw_info_t *info) {
 	Myo *myo = (Myo*) bmyo;
+	myohw_fw_info_t fw_info;
 
-	if(myo->firmware_info == NULL) {
+	g_mutex_lock(&myo->lock);
+
+	if(!myo_char_is_set(myo, &myo->firmware_info)) {
 		debug("Firmware info proxy not set\n");
+		g_mutex_unlock(&myo->lock);
 		return MYOBLUEZ_ERROR;
 	}
 
 	if(myo->info.reserved[0] == 0xFF) {
-		info_var = myo_read_value(myo->firmware_info);
-		if(info_var != NULL) {
-			info_char = (unsigned char*) &myo->info;
-
-			g_variant_get(info_var, "(ay)", &iter);
-
-			//TODO: check for overruns
-			while(g_variant_iter_loop(iter, "y", info_char))  info_char++;
-			g_variant_iter_free(iter);
-		} else {
+		if(myo_read_char(myo, &myo->firmware_info, &fw_info, sizeof(myohw_fw_info_t)) < 0) {
 			debug("Failled to read firmware info");
+			g_mutex_unlock(&myo->lock);
 			return MYOBLUEZ_ERROR;
 		}
-		g_variant_unref(info_var);
+		myo->info = fw_info;
 	}
 
 	memcpy(info, &myo->info, sizeof(myohw_fw_info_t));
+	g_mutex_unlock(&myo->lock);
 	return MYOBLUEZ_OK;
 }
 
-static gboolean myo_init_prepare(GSource *source, gint *timeout_) {
-	int i, j;
+static gboolean myo_init_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
 	MyoInitSource *myo_source = (MyoInitSource*) source;
+	Myo *myo = myo_source->myo;
 
-	*timeout_ = -1;
+	//ready time is not reset by the main loop
+	g_source_set_ready_time(source, -1);
 
-	if(myo_source->myo->myo_status == INITIALIZED) return false;
+	if(!g_cancellable_is_cancelled(myo->cancellable)) {
+		trace(TRACE_INIT_DISPATCH, MYO_INDEX(myo), myo->myo_status);
+		if(myo->ctx->myo_initialize((myobluez_myo_t) myo) != MYOBLUEZ_OK) {
+			//try again later instead of on every iteration
+			g_source_set_ready_time(source, g_get_monotonic_time() + G_USEC_PER_SEC);
+			return G_SOURCE_CONTINUE;
+		}
+		g_mutex_lock(&myo->lock);
+		myo->myo_status = INITIALIZED;
+		//a reconnected myo has forgotten it, no need to wait for the next tick
+		if(myo_keepalive_update(myo) != MYOBLUEZ_OK) {
+			debug("Keep-alive update failed");
+		}
+		g_mutex_unlock(&myo->lock);
+		myo_event(myo, MYO_EVENT_READY, NULL, 0);
 
-	for(i = 0; i < NUM_SERVICES; i++) {
-		if(G_IS_DBUS_PROXY(myo_source->myo->services[i].proxy)) {
-			for(j = 0; j < myo_source->myo->services[i].num_chars; j++) {
-				if(!G_IS_DBUS_PROXY(myo_source->myo->services[i].char_proxies[j])) {
-					debug("Service %d char %d proxy not set", i, j);
-					return false;
-				}
-			}
+		if(myo->cache_hit) {
+			myo_cache_validate(myo);
 		} else {
-			debug("Service %d proxy not set", i);
-			return false;
+			myo_cache_store(myo);
 		}
 	}
 
-	myo_source->myo->myo_status = DISCOVERED;
-	return true;
-}
-
-static gboolean myo_init_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
-	MyoInitSource *myo_source = (MyoInitSource*) source;
-
-	if(myo_initialize((myobluez_myo_t) myo_source->myo) == MYOBLUEZ_OK) {
-		myo_source->myo->myo_status = INITIALIZED;
-	}
-
-	return G_SOURCE_CONTINUE;
+	//the main context keeps its own reference until we return
+	source_clear(&myo->source);
+	return G_SOURCE_REMOVE;
 }
 
 static GSource* myo_init_source_new(Myo *myo, GCancellable *cancellable) {
@@ -963,12 +3428,12 @@ static GSource* myo_init_source_new(Myo *myo, GCancellable *cancellable) {
 	return source;
 }
 
-static int scan_myos() {
+static int scan_myos(MyoBluezCtx *ctx) {
 	GList *objects;
 	GList *object;
 
 	objects = g_dbus_object_manager_get_objects(
-			(GDBusObjectManager*) bluez_manager);
+			(GDBusObjectManager*) ctx->bluez_manager);
 	if(NULL == objects) {
 		//failed
 		fprintf(stderr, "Manager did not give us objects!\n");
@@ -980,10 +3445,10 @@ static int scan_myos() {
 		object = NULL;
 		object = g_list_find_custom(objects, NULL, is_device);
 		if(object != NULL) {
-			set_myo(g_dbus_object_get_object_path((GDBusObject*) object->data));
-			objects = g_list_delete_link(objects, object);
+			set_myo(ctx, g_dbus_object_get_object_path((GDBusObject*) object->data));
+			objects = drop_object(objects, object);
 		}
-	} while(object != NULL && num_myos != MAX_MYOS);
+	} while(object != NULL && ctx->num_myos != MAX_MYOS);
 	debug("Finished searching objects for myo");
 
 	g_list_free_full(objects, g_object_unref);
@@ -991,97 +3456,586 @@ static int scan_myos() {
 	return 0;
 }
 
-void myobluez_deinit() {
-	int i, j, k;
+static void myo_free(Myo *myo) {
+	int j, k;
 	GVariant *reply;
+	GError *error = NULL;
+
+	if(myo->myo_status == INITIALIZED) {
+		myo_IMU_notify_enable((myobluez_myo_t) myo, false);
+		myo_arm_indicate_enable((myobluez_myo_t) myo, false);
+		myo_motion_indicate_enable((myobluez_myo_t) myo, false);
+		myo_battery_notify_enable((myobluez_myo_t) myo, false);
+		myo_update_enable((myobluez_myo_t) myo,
+			myohw_emg_mode_none,
+			myohw_imu_mode_none,
+			myohw_classifier_mode_disabled);
+	}
 
-	//unref stuff
-	for(i = 0; i < MAX_MYOS; i++) {
-		if(myos[i].myo_status == INITIALIZED) {
-			myo_IMU_notify_enable((myobluez_myo_t) &myos[i], false);
-			myo_arm_indicate_enable((myobluez_myo_t) &myos[i], false);
-			myo_update_enable((myobluez_myo_t) &myos[i],
-				myohw_emg_mode_none,
-				myohw_imu_mode_none,
-				myohw_classifier_mode_disabled);
-		}
-
-		for(k = 0; k < NUM_SERVICES; k++) {
-			for(j = 0; j < myos[i].services[k].num_chars; j++) {
-				if(G_IS_DBUS_PROXY(myos[i].services[k].char_proxies[j])) {
-					g_object_unref(myos[i].services[k].char_proxies[j]);
-					myos[i].services[k].char_proxies[j] = NULL;
-				}
-			}
-			if(G_IS_DBUS_PROXY(myos[i].services[k].proxy)) {
-				debug("Freeing service proxy");
-				g_object_unref(myos[i].services[k].proxy);
-				myos[i].services[k].proxy = NULL;
+	//the manager keeps its own proxies alive, so nothing may point back at
+	//this myo once it is gone
+	if(myo->imu_sig_id != 0) {
+		signal_disconnect(myo->imu_data.proxy, &myo->imu_sig_id);
+	}
+	if(myo->arm_sig_id != 0) {
+		signal_disconnect(myo->arm_data.proxy, &myo->arm_sig_id);
+	}
+	if(myo->emg_sig_id != 0) {
+		signal_disconnect(myo->emg_data.proxy, &myo->emg_sig_id);
+	}
+	if(myo->motion_sig_id != 0) {
+		signal_disconnect(myo->imu_events.proxy, &myo->motion_sig_id);
+	}
+	if(myo->battery_sig_id != 0) {
+		signal_disconnect(myo->battery_level.proxy, &myo->battery_sig_id);
+	}
+
+	for(k = 0; k < NUM_SERVICES; k++) {
+		for(j = 0; j < myo->services[k].num_chars; j++) {
+			if(G_IS_DBUS_PROXY(myo->services[k].chars[j].proxy)) {
+				g_object_unref(myo->services[k].chars[j].proxy);
+				myo->services[k].chars[j].proxy = NULL;
 			}
 		}
+		if(G_IS_DBUS_PROXY(myo->services[k].proxy)) {
+			debug("Freeing service proxy");
+			g_object_unref(myo->services[k].proxy);
+			myo->services[k].proxy = NULL;
+		}
+		free(myo->services[k].chars);
+		myo->services[k].chars = NULL;
+	}
 
-		if(G_IS_DBUS_PROXY(myos[i].proxy)) {
-			if(myos[i].conn_status == CONNECTED || myos[i].conn_status == CONNECTING) {
-				//disconnect
-				debug("Disconnecting from myo");
-				reply = g_dbus_proxy_call_sync(
-						myos[i].proxy, "Disconnect", NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL,
-						&error);
-				ASSERT(error, "Disconnect failed");
+	source_clear(&myo->retry);
+
+	if(myo->att != NULL) {
+		debug("Closing ATT link");
+		g_mutex_lock(&myo->lock);
+		att_link_free(myo->att);
+		myo->att = NULL;
+		g_mutex_unlock(&myo->lock);
+		g_atomic_int_set(&myo->conn_status, DISCONNECTED);
+	}
+
+	if(G_IS_DBUS_PROXY(myo->proxy)) {
+		signal_disconnect(myo->proxy, &myo->dev_sig_id);
+		if(myo->transport == MYOBLUEZ_TRANSPORT_DBUS &&
+				(myo->conn_status == CONNECTED || myo->conn_status == CONNECTING)) {
+			//disconnect
+			debug("Disconnecting from myo");
+			reply = g_dbus_proxy_call_sync(
+					myo->proxy, "Disconnect", NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+					&error);
+			ASSERT(error, "Disconnect failed");
+			if(reply != NULL) {
 				g_variant_unref(reply);
 			}
-			//TODO: maybe remove device to work around bluez bug
-			debug("Freeing myo proxy");
-			g_object_unref(myos[i].proxy);
-			myos[i].proxy = NULL;
 		}
+		//TODO: maybe remove device to work around bluez bug
+		debug("Freeing myo proxy");
+		g_object_unref(myo->proxy);
+		myo->proxy = NULL;
+	}
+
+	if(myo->cancellable != NULL) {
+		g_cancellable_cancel(myo->cancellable);
+	}
+
+	source_clear(&myo->source);
+
+	if(myo->cancellable != NULL) {
+		g_object_unref(myo->cancellable);
+		myo->cancellable = NULL;
+	}
+
+	myo_cache_free(myo->cache);
+	myo->cache = NULL;
+	myo->cache_hit = false;
+
+	myo_gesture_free(myo->gesture);
+	myo->gesture = NULL;
+
+	free(myo->fuse);
+	myo->fuse = NULL;
+	myo->on_fused = NULL;
+	myo->fused_user_data = NULL;
+
+	free(myo->ahrs);
+	myo->ahrs = NULL;
+	myo->on_ahrs = NULL;
+	myo->ahrs_user_data = NULL;
+
+	free(myo->quality);
+	myo->quality = NULL;
+
+	free(myo->spectrum);
+	myo->spectrum = NULL;
+	myo->on_spectrum = NULL;
+	myo->spectrum_user_data = NULL;
+
+	free(myo->emg_history);
+	free(myo->imu_history);
+	myo->emg_history = NULL;
+	myo->imu_history = NULL;
+
+	//nothing is dispatched anymore, no need to wait
+	free(myo->imu_cbs);
+	free(myo->arm_cbs);
+	free(myo->emg_cbs);
+	myo->imu_cbs = NULL;
+	myo->arm_cbs = NULL;
+	myo->emg_cbs = NULL;
+	myo->on_imu = NULL;
+	myo->on_arm = NULL;
+	myo->on_emg = NULL;
+	g_mutex_clear(&myo->cb_lock);
+
+	for(j = 0; j < MAX_RATES; j++) {
+		free(myo->emg_rates[j].decimator);
+		free(myo->imu_rates[j].decimator);
+	}
+	memset(myo->emg_rates, 0, sizeof(myo->emg_rates));
+	memset(myo->imu_rates, 0, sizeof(myo->imu_rates));
+	myo->num_subs = 0;
+	g_mutex_clear(&myo->sub_lock);
+
+	source_clear(&myo->adapt_timer);
+	myo_keepalive_stop(myo);
+	myo->keepalive = false;
+
+	g_mutex_clear(&myo->gesture_lock);
+	g_mutex_clear(&myo->fuse_lock);
+	g_mutex_clear(&myo->ahrs_lock);
+	g_mutex_clear(&myo->quality_lock);
+	g_mutex_clear(&myo->spectrum_lock);
+	g_mutex_clear(&myo->history_lock);
+	g_mutex_clear(&myo->link_lock);
+	g_mutex_clear(&myo->clock_lock);
+	g_mutex_clear(&myo->lock);
+}
+
+myobluez_ctx_t myobluez_ctx_new() {
+	MyoBluezCtx *ctx;
+	Myo *myo;
+	int i;
+
+	ctx = g_new0(MyoBluezCtx, 1);
+	ctx->context = g_main_context_ref_thread_default();
+	ctx->transport = MYOBLUEZ_TRANSPORT_DBUS;
+	ctx->cache_enabled = true;
+	ctx->keepalive_enabled = true;
+	ctx->required = MYOBLUEZ_NEED_ALL;
+	myo_event_queue_init(&ctx->events);
+	g_mutex_init(&ctx->budget_lock);
+	g_atomic_int_inc(&live_contexts);
+
+	for(i = 0; i < MAX_MYOS; i++) {
+		myo = &ctx->myos[i];
+		myo->ctx = ctx;
+		g_mutex_init(&myo->lock);
+		g_mutex_init(&myo->cb_lock);
+		g_mutex_init(&myo->gesture_lock);
+		g_mutex_init(&myo->fuse_lock);
+		g_mutex_init(&myo->ahrs_lock);
+		g_mutex_init(&myo->quality_lock);
+		g_mutex_init(&myo->spectrum_lock);
+		g_mutex_init(&myo->history_lock);
+		g_mutex_init(&myo->link_lock);
+		g_mutex_init(&myo->sub_lock);
+		myo_link_init(&myo->link, G_USEC_PER_SEC / MYO_EMG_NOTIFY_RATE, IMU_PERIOD_US);
+		g_mutex_init(&myo->clock_lock);
+		myo_ring_init(&myo->emg_ring, 8);
+		myo_ring_init(&myo->imu_ring, 10);
+		init_GattService(&myo->battery_service, BATT_UUID, BATT_CHAR_UUIDS, 1);
+		init_GattService(&myo->myo_control_service, MYO_UUID, MYO_CHAR_UUIDS, 3);
+		init_GattService(&myo->imu_service, IMU_UUID, IMU_CHAR_UUIDS, 2);
+		init_GattService(&myo->arm_service, ARM_UUID, ARM_CHAR_UUIDS, 1);
+		init_GattService(&myo->emg_service, EMG_UUID, EMG_CHAR_UUIDS, 1);
+	}
+
+	return ctx;
+}
+
+void myobluez_ctx_set_transport(myobluez_ctx_t ctx, myobluez_transport_t trans) {
+	ctx->transport = trans;
+}
+
+void myobluez_ctx_set_cache(myobluez_ctx_t ctx, bool enable) {
+	ctx->cache_enabled = enable;
+}
+
+void myobluez_ctx_set_required(myobluez_ctx_t ctx, unsigned int needs) {
+	ctx->required = needs & MYOBLUEZ_NEED_ALL;
+}
+
+int myobluez_ctx_set_bus_address(myobluez_ctx_t ctx, const char *address) {
+	if(ctx->connection != NULL) {
+		debug("Bus address has to be set before starting");
+		return MYOBLUEZ_ERROR;
+	}
+
+	g_free(ctx->bus_address);
+	ctx->bus_address = g_strdup(address);
+	return MYOBLUEZ_OK;
+}
+
+void myobluez_ctx_set_keepalive(myobluez_ctx_t ctx, bool enable) {
+	Myo *myo;
+	int i;
+
+	ctx->keepalive_enabled = enable;
+
+	//applies to myos already streaming too
+	for(i = 0; i < g_atomic_int_get(&ctx->num_myos); i++) {
+		myo = &ctx->myos[i];
+		g_mutex_lock(&myo->lock);
+		if(myo->myo_status == INITIALIZED && myo_keepalive_update(myo) != MYOBLUEZ_OK) {
+			debug("Keep-alive update failed");
+		}
+		g_mutex_unlock(&myo->lock);
+	}
+}
+
+int myobluez_ctx_start(myobluez_ctx_t ctx, int (*myo_init)(myobluez_myo_t), GError **error) {
+	const char *env;
+
+	if(getenv("MYOBLUEZ_TRACE") != NULL) {
+		myobluez_trace_enable(true);
+	}
+	env = getenv("MYOBLUEZ_TRANSPORT");
+	if(env != NULL && strcmp(env, "att") == 0) {
+		ctx->transport = MYOBLUEZ_TRANSPORT_ATT;
+	}
+
+	//number of myos to scan for, for clients that do not set it up themselves
+	env = getenv("MYOBLUEZ_DISCOVER");
+	if(env != NULL && ctx->discovery_target == 0) {
+		ctx->discovery_target = atoi(env) > 0 ? MIN(atoi(env), MAX_MYOS) : MAX_MYOS;
+	}
+
+	//a private bus with fake bluez peers, for soak runs
+	env = getenv("MYOBLUEZ_BUS_ADDRESS");
+	if(env != NULL && ctx->bus_address == NULL) {
+		ctx->bus_address = g_strdup(env);
+	}
+
+	ctx->myo_initialize = myo_init;
+
+	//the manager and every proxy made from its callbacks signal in the
+	//context that was thread-default when they were made
+	g_main_context_push_thread_default(ctx->context);
+
+	if(ctx->bus_address != NULL) {
+		ctx->connection = g_dbus_connection_new_for_address_sync(ctx->bus_address,
+				G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+				G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION, NULL, NULL, error);
+	} else {
+		ctx->connection = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, error);
+	}
+	if(ctx->connection == NULL) {
+		g_main_context_pop_thread_default(ctx->context);
+		return MYOBLUEZ_ERROR;
+	}
+	track_object(ctx->connection);
+
+	ctx->bluez_manager = track_object(g_dbus_object_manager_client_new_sync(
+			ctx->connection, G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
+			"org.bluez", "/", NULL, NULL, NULL, NULL, error));
+	if(ctx->bluez_manager == NULL) {
+		g_main_context_pop_thread_default(ctx->context);
+		return MYOBLUEZ_ERROR;
+	}
+
+	ctx->cb_id = signal_connect(ctx->bluez_manager, "object-added",
+			G_CALLBACK(object_added_cb), ctx);
+
+	scan_myos(ctx);
+	if(discovery_start(ctx) != MYOBLUEZ_OK) {
+		debug("Discovery not started");
+	}
+
+	g_main_context_pop_thread_default(ctx->context);
+
+	return MYOBLUEZ_OK;
+}
+
+int myobluez_ctx_set_discovery(myobluez_ctx_t ctx, const MyoDiscovery *discovery) {
+	if(ctx->bluez_manager != NULL) {
+		debug("Discovery has to be set before starting");
+		return MYOBLUEZ_ERROR;
+	}
+
+	g_strfreev(ctx->allowlist);
+	ctx->allowlist = NULL;
+	ctx->discovery_target = 0;
+	ctx->discovery_rssi = 0;
+
+	if(discovery != NULL) {
+		ctx->discovery_target = discovery->target > 0 ?
+				MIN(discovery->target, MAX_MYOS) : MAX_MYOS;
+		ctx->discovery_rssi = discovery->rssi;
+		if(discovery->allowlist != NULL) {
+			ctx->allowlist = g_strdupv((gchar**) discovery->allowlist);
+		}
+	}
+
+	return MYOBLUEZ_OK;
+}
+
+void myobluez_ctx_get_stats(myobluez_ctx_t ctx, MyoBluezStats *stats) {
+	const uint64_t *from = (const uint64_t*) &ctx->stats;
+	uint64_t *to = (uint64_t*) stats;
+	size_t i;
+
+	//one counter at a time, they only have to be consistent with themselves
+	for(i = 0; i < sizeof(MyoBluezStats) / sizeof(uint64_t); i++) {
+		to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+	}
+}
+
+void myobluez_get_resources(MyoBluezResources *resources) {
+	resources->contexts = g_atomic_int_get(&live_contexts);
+	resources->objects = g_atomic_int_get(&live_objects);
+	resources->signal_handlers = g_atomic_int_get(&live_handlers);
+	resources->sources = g_atomic_int_get(&live_sources);
+}
+
+int myobluez_ctx_set_budget(myobluez_ctx_t ctx, const MyoBudgetConfig *config) {
+	g_mutex_lock(&ctx->budget_lock);
+
+	g_atomic_int_set(&ctx->budget_enabled, config != NULL);
+	if(config != NULL) {
+		ctx->budget = *config;
+		if(ctx->budget.capacity == 0) {
+			ctx->budget.capacity = MYO_BUDGET_CAPACITY;
+		}
+		if(ctx->budget_timer == NULL) {
+			ctx->budget_tick_start = g_get_monotonic_time();
+			ctx->budget_timer = g_timeout_source_new(MYO_BUDGET_TICK_MS);
+			g_source_set_callback(ctx->budget_timer, budget_tick, ctx, NULL);
+			source_attach(ctx, ctx->budget_timer);
+		}
+	} else {
+		source_clear(&ctx->budget_timer);
+	}
+
+	g_mutex_unlock(&ctx->budget_lock);
+
+	//turning it off hands every myo back what it asked for
+	return budget_rebalance(ctx, NULL);
+}
+
+int myobluez_ctx_get_budget(myobluez_ctx_t ctx, MyoBudgetReport *reports, int max) {
+	MyoBudgetReport *report;
+	Myo *myo;
+	int i, n = 0;
+
+	g_mutex_lock(&ctx->budget_lock);
+
+	for(i = 0; i < g_atomic_int_get(&ctx->num_myos) && n < max; i++) {
+		myo = &ctx->myos[i];
+		if(!(ctx->budget_members & (1 << i))) {
+			continue;
+		}
+		report = &reports[n++];
+		g_mutex_lock(&myo->lock);
+		report->myo = (myobluez_myo_t) myo;
+		report->adapter = myo->budget_adapter;
+		report->priority = myo->priority;
+		report->requested_emg = myo->requested_emg;
+		report->requested_imu = myo->requested_imu;
+		report->emg = myo->emg_mode;
+		report->imu = myo->imu_mode;
+		report->projected = myo->budget_projected;
+		report->achieved = myo->budget_achieved;
+		g_mutex_unlock(&myo->lock);
+	}
+
+	g_mutex_unlock(&ctx->budget_lock);
+
+	return n;
+}
+
+int myobluez_ctx_drain_events(myobluez_ctx_t ctx, MyoEvent *events, int max,
+		unsigned int *dropped)
+{
+	return myo_event_queue_drain(&ctx->events, events, max, dropped);
+}
 
-		if(myos[i].source != NULL && !g_source_is_destroyed(myos[i].source)) {
-			g_source_destroy(myos[i].source);
+int myobluez_ctx_prepare(myobluez_ctx_t ctx, GPollFD *fds, int max_fds, int *timeout) {
+	//a retry with more room only fetches the fds again, preparing twice in
+	//one iteration is not allowed
+	if(!ctx->prepared) {
+		if(!g_main_context_acquire(ctx->context)) {
+			debug("Main context is owned by another thread");
+			return -1;
 		}
+		ctx->prepared = true;
+
+		//ready sources make the timeout 0
+		g_main_context_prepare(ctx->context, &ctx->max_priority);
+	}
+
+	return g_main_context_query(ctx->context, ctx->max_priority, timeout, fds, max_fds);
+}
+
+int myobluez_ctx_dispatch(myobluez_ctx_t ctx, GPollFD *fds, int num_fds) {
+	if(!ctx->prepared) {
+		debug("Dispatch without prepare");
+		return MYOBLUEZ_ERROR;
+	}
+
+	if(g_main_context_check(ctx->context, ctx->max_priority, fds, num_fds)) {
+		g_main_context_dispatch(ctx->context);
+	}
+
+	ctx->prepared = false;
+	g_main_context_release(ctx->context);
+	return MYOBLUEZ_OK;
+}
+
+void myobluez_ctx_free(myobluez_ctx_t ctx) {
+	DeviceWatch *watch;
+	GSList *l;
+	int i;
+
+	if(ctx == NULL) {
+		return;
 	}
 
-	if(cb_id != 0 && G_IS_OBJECT(bluez_manager)) {
+	//cancelling a StartDiscovery in flight only drops its reply, bluez has it
+	//already, and on a shared bus connection the scan would outlive us
+	discovery_stop(ctx);
+	if(ctx->discovery_cancellable != NULL) {
+		g_cancellable_cancel(ctx->discovery_cancellable);
+		g_object_unref(ctx->discovery_cancellable);
+		ctx->discovery_cancellable = NULL;
+	}
+	if(ctx->adapter != NULL) {
+		g_object_unref(ctx->adapter);
+		ctx->adapter = NULL;
+	}
+	g_strfreev(ctx->allowlist);
+	ctx->allowlist = NULL;
+
+	//myos are turned off one by one below, nothing left to share
+	g_atomic_int_set(&ctx->budget_enabled, false);
+	source_clear(&ctx->budget_timer);
+
+	//unref stuff
+	for(i = 0; i < MAX_MYOS; i++) {
+		myo_free(&ctx->myos[i]);
+	}
+
+	//devices whose UUIDs never showed up
+	for(l = ctx->watches; l != NULL; l = l->next) {
+		watch = (DeviceWatch*) l->data;
+		signal_disconnect(watch->proxy, &watch->sig_id);
+		g_object_unref(watch->proxy);
+		free(watch);
+	}
+	g_slist_free(ctx->watches);
+	ctx->watches = NULL;
+
+	if(ctx->cb_id != 0 && G_IS_OBJECT(ctx->bluez_manager)) {
 		debug("Disconnecting signal handler");
-		g_signal_handler_disconnect(bluez_manager, cb_id);
-		cb_id = 0;
+		signal_disconnect(ctx->bluez_manager, &ctx->cb_id);
 	}
-	
-	if(G_IS_OBJECT(bluez_manager)) {
+
+	if(G_IS_OBJECT(ctx->bluez_manager)) {
 		debug("Freeing bluez manager");
-		g_object_unref(bluez_manager);
-		bluez_manager = NULL;
+		g_object_unref(ctx->bluez_manager);
+		ctx->bluez_manager = NULL;
+	}
+
+	if(ctx->connection != NULL) {
+		g_object_unref(ctx->connection);
+		ctx->connection = NULL;
+	}
+	g_free(ctx->bus_address);
+
+	for(i = 0; i < MAX_MYOS; i++) {
+		g_free(ctx->adapters[i]);
 	}
+	g_mutex_clear(&ctx->budget_lock);
+	myo_event_queue_clear(&ctx->events);
+	if(ctx->prepared) {
+		g_main_context_release(ctx->context);
+	}
+	g_main_context_unref(ctx->context);
+	g_free(ctx);
+	g_atomic_int_add(&live_contexts, -1);
+}
+
+static MyoBluezCtx* get_default_ctx() {
+	if(default_ctx == NULL) {
+		default_ctx = myobluez_ctx_new();
+	}
+	return default_ctx;
+}
+
+void myobluez_deinit() {
+	myobluez_ctx_free(default_ctx);
+	default_ctx = NULL;
+}
+
+void myobluez_set_transport(myobluez_transport_t trans) {
+	myobluez_ctx_set_transport(get_default_ctx(), trans);
+}
+
+void myobluez_set_cache(bool enable) {
+	myobluez_ctx_set_cache(get_default_ctx(), enable);
+}
+
+void myobluez_set_keepalive(bool enable) {
+	myobluez_ctx_set_keepalive(get_default_ctx(), enable);
+}
+
+void myobluez_set_required(unsigned int needs) {
+	myobluez_ctx_set_required(get_default_ctx(), needs);
 }
 
 int myobluez_init(int (*myo_init)(myobluez_myo_t)) {
-	int i;
+	GError *error = NULL;
 
-	for(i = 0; i < MAX_MYOS; i++) {
-		init_GattService(&myos[i].battery_service, BATT_UUID, BATT_CHAR_UUIDS, 1);
-		init_GattService(&myos[i].myo_control_service, MYO_UUID, MYO_CHAR_UUIDS, 3);
-		init_GattService(&myos[i].imu_service, IMU_UUID, IMU_CHAR_UUIDS, 2);
-		init_GattService(&myos[i].arm_service, ARM_UUID, ARM_CHAR_UUIDS, 1);
-		init_GattService(&myos[i].emg_service, EMG_UUID, EMG_CHAR_UUIDS, 1);
-	}
-	num_myos = 0;
-
-	bluez_manager =
-			(GDBusObjectManagerClient*) g_dbus_object_manager_client_new_for_bus_sync(
-					G_BUS_TYPE_SYSTEM, G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-					"org.bluez", "/", NULL, NULL, NULL, NULL, &error);
-	ASSERT(error, "Get ObjectManager failed");
-	if(bluez_manager == NULL) {
+	if(myobluez_ctx_start(get_default_ctx(), myo_init, &error) != MYOBLUEZ_OK) {
+		ASSERT(error, "Get ObjectManager failed");
 		fprintf(stderr, "Error: Is Bluez running?\n");
+		myobluez_deinit();
 		return 1;
 	}
 
-	myo_initialize = myo_init;
+	return 0;
+}
+
+int myobluez_set_discovery(const MyoDiscovery *discovery) {
+	return myobluez_ctx_set_discovery(get_default_ctx(), discovery);
+}
 
-	cb_id = g_signal_connect(bluez_manager, "object-added",
-			G_CALLBACK(object_added_cb), NULL);
+int myobluez_set_budget(const MyoBudgetConfig *config) {
+	return myobluez_ctx_set_budget(get_default_ctx(), config);
+}
 
-	scan_myos();
+int myobluez_get_budget(MyoBudgetReport *reports, int max) {
+	return myobluez_ctx_get_budget(get_default_ctx(), reports, max);
+}
 
-	return 0;
+int myobluez_set_bus_address(const char *address) {
+	return myobluez_ctx_set_bus_address(get_default_ctx(), address);
+}
+
+void myobluez_get_stats(MyoBluezStats *stats) {
+	myobluez_ctx_get_stats(get_default_ctx(), stats);
+}
+
+int myobluez_drain_events(MyoEvent *events, int max, unsigned int *dropped) {
+	return myobluez_ctx_drain_events(get_default_ctx(), events, max, dropped);
+}
+
+int myobluez_prepare(GPollFD *fds, int max_fds, int *timeout) {
+	return myobluez_ctx_prepare(get_default_ctx(), fds, max_fds, timeout);
+}
+
+int myobluez_dispatch(GPollFD *fds, int num_fds) {
+	return myobluez_ctx_dispatch(get_default_ctx(), fds, num_fds);
 }
@@ -0,0 +1,99 @@
+#include "myo-bluez.h"
+#include "myo-bluez_adapt.h"
+
+static void adapt_push(MyoAdapt *adapt, myohw_emg_mode_t emg, myohw_imu_mode_t imu) {
+	MyoAdaptLevel *last = &adapt->levels[adapt->num_levels - 1];
+
+	if(adapt->num_levels == MYO_ADAPT_MAX_LEVELS || (last->emg == emg && last->imu == imu)) {
+		return;
+	}
+
+	adapt->levels[adapt->num_levels].emg = emg;
+	adapt->levels[adapt->num_levels].imu = imu;
+	adapt->num_levels++;
+}
+
+void myo_adapt_init(MyoAdapt *adapt, myohw_emg_mode_t emg, myohw_imu_mode_t imu) {
+	memset(adapt, 0, sizeof(MyoAdapt));
+
+	adapt->levels[0].emg = emg;
+	adapt->levels[0].imu = imu;
+	adapt->num_levels = 1;
+
+	//cheapest losses first: IMU events and raw data, then EMG filtering,
+	//then EMG altogether, and last IMU data in favour of events
+	if(imu == myohw_imu_mode_send_all || imu == myohw_imu_mode_send_raw) {
+		imu = myohw_imu_mode_send_data;
+		adapt_push(adapt, emg, imu);
+	}
+	if(emg == myohw_emg_mode_send_emg_raw) {
+		emg = myohw_emg_mode_send_emg;
+		adapt_push(adapt, emg, imu);
+	}
+	if(emg != myohw_emg_mode_none) {
+		emg = myohw_emg_mode_none;
+		adapt_push(adapt, emg, imu);
+	}
+	if(imu == myohw_imu_mode_send_data) {
+		imu = myohw_imu_mode_send_events;
+		adapt_push(adapt, emg, imu);
+	}
+}
+
+double myo_adapt_pressure(const MyoAdaptStats *stats) {
+	double pressure;
+
+	pressure = MAX(stats->load / MYO_ADAPT_LOAD_HIGH, stats->depth / MYO_ADAPT_DEPTH_HIGH);
+	if(stats->delivered >= 0.0) {
+		pressure = MAX(pressure,
+				(1.0 - MIN(stats->delivered, 1.0)) / (1.0 - MYO_ADAPT_DELIVERED_LOW));
+	}
+
+	return pressure;
+}
+
+bool myo_adapt_update(MyoAdapt *adapt, const MyoAdaptStats *stats) {
+	adapt->pressure = myo_adapt_pressure(stats);
+
+	if(adapt->pressure >= 1.0) {
+		adapt->high_ticks++;
+		adapt->low_ticks = 0;
+	} else if(adapt->pressure < MYO_ADAPT_LOW_PRESSURE) {
+		adapt->low_ticks++;
+		adapt->high_ticks = 0;
+	} else {
+		//in between keeps the level where it is
+		adapt->high_ticks = 0;
+		adapt->low_ticks = 0;
+	}
+
+	if(adapt->high_ticks >= MYO_ADAPT_DOWN_TICKS && adapt->level + 1 < adapt->num_levels) {
+		adapt->level++;
+	} else if(adapt->low_ticks >= MYO_ADAPT_UP_TICKS && adapt->level > 0) {
+		adapt->level--;
+	} else {
+		return false;
+	}
+
+	adapt->high_ticks = 0;
+	adapt->low_ticks = 0;
+	return true;
+}
+
+const MyoAdaptLevel* myo_adapt_current(const MyoAdapt *adapt) {
+	return &adapt->levels[adapt->level];
+}
+
+unsigned int myo_adapt_expected_rate(const MyoAdaptLevel *level, bool emg, bool imu) {
+	unsigned int rate = 0;
+
+	if(emg && level->emg != myohw_emg_mode_none) {
+		rate += MYO_EMG_NOTIFY_RATE;
+	}
+	if(imu && (level->imu == myohw_imu_mode_send_data || level->imu == myohw_imu_mode_send_all ||
+			level->imu == myohw_imu_mode_send_raw)) {
+		rate += MYO_IMU_RATE;
+	}
+
+	return rate;
+}
@@ -0,0 +1,199 @@
+#include <math.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_ahrs.h"
+
+//without timestamps every update integrates one raw IMU period
+#define AHRS_DT (1.0f / MYO_IMU_RATE)
+#define DEG_TO_RAD ((float) M_PI / 180.0f)
+
+void myo_ahrs_config_default(MyoAhrsConfig *config, myo_ahrs_filter_t filter) {
+	memset(config, 0, sizeof(MyoAhrsConfig));
+	config->filter = filter;
+	if(filter == MYO_AHRS_MAHONY) {
+		config->gain = MYO_AHRS_MAHONY_KP;
+		config->integral_gain = MYO_AHRS_MAHONY_KI;
+	} else {
+		config->gain = MYO_AHRS_MADGWICK_GAIN;
+	}
+	config->calibration_samples = MYO_AHRS_CALIBRATION_SAMPLES;
+}
+
+void myo_ahrs_init(MyoAhrs *ahrs, const MyoAhrsConfig *config) {
+	memset(ahrs, 0, sizeof(MyoAhrs));
+	ahrs->config = *config;
+	ahrs->q[0] = 1.0f;
+}
+
+void myo_ahrs_calibrate(MyoAhrs *ahrs, unsigned int samples) {
+	ahrs->config.calibration_samples = samples;
+	memset(ahrs->bias_sum, 0, sizeof(ahrs->bias_sum));
+	ahrs->bias_count = 0;
+}
+
+static inline float inv_norm(const float *v, int n) {
+	float sum = 0.0f;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		sum += v[i] * v[i];
+	}
+	return sum > 0.0f ? 1.0f / sqrtf(sum) : 0.0f;
+}
+
+static void normalize(float *v, int n) {
+	float inv = inv_norm(v, n);
+	int i;
+
+	for(i = 0; i < n; i++) {
+		v[i] *= inv;
+	}
+}
+
+//Madgwick's IMU update without magnetometer, g in rad/s
+static void madgwick_update(MyoAhrs *ahrs, const float *a, const float *g, float dt) {
+	float *q = ahrs->q;
+	float dot[4], s[4];
+	int i;
+
+	dot[0] = 0.5f * (-q[1] * g[0] - q[2] * g[1] - q[3] * g[2]);
+	dot[1] = 0.5f * (q[0] * g[0] + q[2] * g[2] - q[3] * g[1]);
+	dot[2] = 0.5f * (q[0] * g[1] - q[1] * g[2] + q[3] * g[0]);
+	dot[3] = 0.5f * (q[0] * g[2] + q[1] * g[1] - q[2] * g[0]);
+
+	//free fall leaves nothing to correct towards
+	if(a[0] != 0.0f || a[1] != 0.0f || a[2] != 0.0f) {
+		//gradient of the error between measured and estimated gravity
+		s[0] = 4.0f * q[0] * (q[1] * q[1] + q[2] * q[2]) + 2.0f * (q[2] * a[0] - q[1] * a[1]);
+		s[1] = 4.0f * q[1] * (q[0] * q[0] + q[3] * q[3] - 1.0f +
+				2.0f * (q[1] * q[1] + q[2] * q[2]) + a[2]) - 2.0f * (q[3] * a[0] + q[0] * a[1]);
+		s[2] = 4.0f * q[2] * (q[0] * q[0] + q[3] * q[3] - 1.0f +
+				2.0f * (q[1] * q[1] + q[2] * q[2]) + a[2]) + 2.0f * (q[0] * a[0] - q[3] * a[1]);
+		s[3] = 4.0f * q[3] * (q[1] * q[1] + q[2] * q[2]) - 2.0f * (q[1] * a[0] + q[2] * a[1]);
+		normalize(s, 4);
+		for(i = 0; i < 4; i++) {
+			dot[i] -= ahrs->config.gain * s[i];
+		}
+	}
+
+	for(i = 0; i < 4; i++) {
+		q[i] += dot[i] * dt;
+	}
+	normalize(q, 4);
+}
+
+//Mahony's complementary filter, g in rad/s
+static void mahony_update(MyoAhrs *ahrs, const float *a, const float *g, float dt) {
+	float *q = ahrs->q;
+	float v[3], e[3], w[3], q0, q1, q2;
+	int i;
+
+	memcpy(w, g, sizeof(w));
+
+	if(a[0] != 0.0f || a[1] != 0.0f || a[2] != 0.0f) {
+		//half the estimated gravity direction
+		v[0] = q[1] * q[3] - q[0] * q[2];
+		v[1] = q[0] * q[1] + q[2] * q[3];
+		v[2] = q[0] * q[0] - 0.5f + q[3] * q[3];
+
+		//half the error, cross product of measured and estimated
+		e[0] = a[1] * v[2] - a[2] * v[1];
+		e[1] = a[2] * v[0] - a[0] * v[2];
+		e[2] = a[0] * v[1] - a[1] * v[0];
+
+		for(i = 0; i < 3; i++) {
+			if(ahrs->config.integral_gain > 0.0f) {
+				ahrs->integral[i] += 2.0f * ahrs->config.integral_gain * e[i] * dt;
+				w[i] += ahrs->integral[i];
+			}
+			w[i] += 2.0f * ahrs->config.gain * e[i];
+		}
+	}
+
+	for(i = 0; i < 3; i++) {
+		w[i] *= 0.5f * dt;
+	}
+	q0 = q[0];
+	q1 = q[1];
+	q2 = q[2];
+	q[0] += -q1 * w[0] - q2 * w[1] - q[3] * w[2];
+	q[1] += q0 * w[0] + q2 * w[2] - q[3] * w[1];
+	q[2] += q0 * w[1] - q1 * w[2] + q[3] * w[0];
+	q[3] += q0 * w[2] + q1 * w[1] - q2 * w[0];
+	normalize(q, 4);
+}
+
+void myo_ahrs_update(MyoAhrs *ahrs, const float *accelerometer, const float *gyroscope, float dt) {
+	float a[3], g[3];
+	int i;
+
+	if(ahrs->bias_count < ahrs->config.calibration_samples) {
+		for(i = 0; i < 3; i++) {
+			ahrs->bias_sum[i] += gyroscope[i];
+		}
+		if(++ahrs->bias_count == ahrs->config.calibration_samples) {
+			for(i = 0; i < 3; i++) {
+				ahrs->config.gyro_bias[i] = ahrs->bias_sum[i] / ahrs->bias_count;
+			}
+		}
+	}
+
+	memcpy(a, accelerometer, sizeof(a));
+	normalize(a, 3);
+	for(i = 0; i < 3; i++) {
+		g[i] = (gyroscope[i] - ahrs->config.gyro_bias[i]) * DEG_TO_RAD;
+	}
+
+	if(ahrs->config.filter == MYO_AHRS_MAHONY) {
+		mahony_update(ahrs, a, g, dt);
+	} else {
+		madgwick_update(ahrs, a, g, dt);
+	}
+}
+
+void myo_ahrs_push(MyoAhrs *ahrs, const int16_t *imu, int64_t timestamp, MyoAhrsSample *out) {
+	float accelerometer[3], gyroscope[3];
+	float dt = AHRS_DT;
+	int i;
+
+	for(i = 0; i < 4; i++) {
+		out->device[i] = imu[i];
+	}
+	normalize(out->device, 4);
+
+	//start where the myo is so the two stay comparable
+	if(!ahrs->seeded && inv_norm(out->device, 4) > 0.0f) {
+		memcpy(ahrs->q, out->device, sizeof(ahrs->q));
+		ahrs->seeded = true;
+	}
+
+	for(i = 0; i < 3; i++) {
+		accelerometer[i] = imu[4 + i] / MYOHW_ACCELEROMETER_SCALE;
+		gyroscope[i] = imu[7 + i] / MYOHW_GYROSCOPE_SCALE;
+	}
+	if(timestamp != 0 && ahrs->last_timestamp != 0) {
+		dt = (timestamp - ahrs->last_timestamp) / 1e6f;
+		dt = dt < MYO_AHRS_MIN_DT ? MYO_AHRS_MIN_DT : (dt > MYO_AHRS_MAX_DT ? MYO_AHRS_MAX_DT : dt);
+	}
+	if(timestamp != 0) {
+		ahrs->last_timestamp = timestamp;
+	}
+	myo_ahrs_update(ahrs, accelerometer, gyroscope, dt);
+
+	out->timestamp = timestamp;
+	memcpy(out->orientation, ahrs->q, sizeof(out->orientation));
+}
+
+void myo_ahrs_process(MyoAhrs *ahrs, const int16_t *const *channels, const int64_t *timestamps,
+		int count, MyoAhrsSample *out)
+{
+	int16_t imu[10];
+	int i, j;
+
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < 10; j++) {
+			imu[j] = channels[j][i];
+		}
+		myo_ahrs_push(ahrs, imu, timestamps != NULL ? timestamps[i] : 0, &out[i]);
+	}
+}
@@ -0,0 +1,1032 @@
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/l2cap.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/hci_lib.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_att.h"
+
+#define ATT_OP_ERROR_RSP 0x01
+#define ATT_OP_MTU_REQ 0x02
+#define ATT_OP_MTU_RSP 0x03
+#define ATT_OP_FIND_INFO_REQ 0x04
+#define ATT_OP_FIND_INFO_RSP 0x05
+#define ATT_OP_READ_BY_TYPE_REQ 0x08
+#define ATT_OP_READ_BY_TYPE_RSP 0x09
+#define ATT_OP_READ_REQ 0x0A
+#define ATT_OP_READ_RSP 0x0B
+#define ATT_OP_WRITE_REQ 0x12
+#define ATT_OP_WRITE_RSP 0x13
+#define ATT_OP_HANDLE_NOTIFY 0x1B
+#define ATT_OP_HANDLE_IND 0x1D
+#define ATT_OP_HANDLE_CONF 0x1E
+
+#define ATT_ECODE_ATTR_NOT_FOUND 0x0A
+
+#define GATT_CHARAC_UUID 0x2803
+#define GATT_CLIENT_CHARAC_CFG_UUID 0x2902
+
+#define GATT_CHR_PROP_NOTIFY 0x10
+#define GATT_CHR_PROP_INDICATE 0x20
+
+#define ATT_PDU_SIZE ATT_MAX_MTU
+
+typedef struct {
+	uint16_t decl_handle;
+	uint16_t value_handle;
+	uint16_t end_handle;
+	uint16_t cccd_handle;
+	uint8_t properties;
+	uint8_t uuid[16];
+} AttChar;
+
+typedef struct {
+	uint16_t len;
+	uint8_t pdu[ATT_MAX_MTU];
+} AttPdu;
+
+typedef struct AttRequest AttRequest;
+
+struct AttRequest {
+	uint8_t pdu[ATT_MAX_MTU];
+	uint16_t len;
+	uint8_t rsp_op;
+
+	//handles the raw response in the link's context, otherwise cb gets it
+	void (*rsp_cb)(AttLink *link, AttRequest *req);
+	att_done_cb_t cb;
+	void *user_data;
+
+	//on the waiting thread's stack, done once the response is in
+	bool sync;
+	bool done;
+
+	int err;
+	uint16_t rsp_len;
+	uint8_t rsp[ATT_PDU_SIZE];
+};
+
+struct AttLink {
+	int fd;
+	uint16_t mtu;
+
+	AttChar *chars;
+	int num_chars;
+
+	GMainContext *context;
+	GSource *watch;
+	//delivers what was read outside of the watch
+	GSource *flush;
+
+	att_connect_cb_t connect_cb;
+	att_notify_cb_t notify_cb;
+	att_disconnect_cb_t disconnect_cb;
+	void *user_data;
+
+	//held while touching the queues or reading the socket, never while
+	//waiting, so requests can come from any thread
+	GMutex lock;
+	AttPdu pending[ATT_PENDING];
+	int num_pending;
+	int max_pending;
+
+	//AttRequest not sent yet, the one in flight and when it times out
+	GQueue requests;
+	AttRequest *current;
+	gint64 deadline;
+	GSource *timer;
+	//async requests whose callback is still to run
+	GQueue done;
+	//wakes threads waiting on a response someone else read
+	int wake;
+	bool failed;
+
+	att_done_cb_t discover_cb;
+	void *discover_data;
+	int discover_index;
+};
+
+//Bluetooth base UUID, little endian
+static const uint8_t BASE_UUID[16] = {
+		0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+		0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+static void uuid_from_16(uint16_t uuid16, uint8_t *uuid) {
+	memcpy(uuid, BASE_UUID, 16);
+	uuid[12] = uuid16 & 0xFF;
+	uuid[13] = uuid16 >> 8;
+}
+
+static int uuid_from_string(const char *str, uint8_t *uuid) {
+	int i = 15;
+	unsigned int byte;
+
+	while(*str != '\0' && i >= 0) {
+		if(*str == '-') {
+			str++;
+			continue;
+		}
+		if(sscanf(str, "%2x", &byte) != 1) {
+			return -1;
+		}
+		uuid[i--] = (uint8_t) byte;
+		str += 2;
+	}
+
+	return i == -1 ? 0 : -1;
+}
+
+static gboolean att_link_io_cb(GIOChannel *channel, GIOCondition cond, gpointer user_data);
+
+static AttLink* att_link_alloc(int fd, GMainContext *ctx) {
+	AttLink *link;
+
+	link = calloc(1, sizeof(AttLink));
+	if(link == NULL) {
+		return NULL;
+	}
+
+	link->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(link->wake < 0) {
+		free(link);
+		return NULL;
+	}
+
+	link->fd = fd;
+	link->mtu = ATT_DEFAULT_MTU;
+	link->context = g_main_context_ref(ctx);
+	g_mutex_init(&link->lock);
+	g_queue_init(&link->requests);
+	g_queue_init(&link->done);
+
+	return link;
+}
+
+static void att_link_watch(AttLink *link, GIOCondition cond) {
+	GIOChannel *channel;
+
+	if(link->watch != NULL) {
+		g_source_destroy(link->watch);
+		g_source_unref(link->watch);
+	}
+
+	channel = g_io_channel_unix_new(link->fd);
+	link->watch = g_io_create_watch(channel, cond | G_IO_HUP | G_IO_ERR | G_IO_NVAL);
+	g_source_set_callback(link->watch, (GSourceFunc) att_link_io_cb, link, NULL);
+	g_source_attach(link->watch, link->context);
+	g_io_channel_unref(channel);
+}
+
+AttLink* att_link_connect(const char *address, bool random_address, GMainContext *ctx,
+		att_connect_cb_t connect_cb, void *user_data)
+{
+	struct sockaddr_l2 addr;
+	struct bt_security sec;
+	AttLink *link;
+	int fd;
+
+	fd = socket(AF_BLUETOOTH, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, BTPROTO_L2CAP);
+	if(fd < 0) {
+		debug("ATT socket failed; %s", strerror(errno));
+		return NULL;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.l2_family = AF_BLUETOOTH;
+	addr.l2_cid = htobs(ATT_CID);
+	addr.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+	bacpy(&addr.l2_bdaddr, BDADDR_ANY);
+	if(bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		debug("ATT bind failed; %s", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	//the myo does not need pairing
+	memset(&sec, 0, sizeof(sec));
+	sec.level = BT_SECURITY_LOW;
+	if(setsockopt(fd, SOL_BLUETOOTH, BT_SECURITY, &sec, sizeof(sec)) < 0) {
+		debug("ATT set security failed; %s", strerror(errno));
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.l2_family = AF_BLUETOOTH;
+	addr.l2_cid = htobs(ATT_CID);
+	addr.l2_bdaddr_type = random_address ? BDADDR_LE_RANDOM : BDADDR_LE_PUBLIC;
+	if(str2ba(address, &addr.l2_bdaddr) < 0) {
+		debug("Invalid address %s", address);
+		close(fd);
+		return NULL;
+	}
+
+	if(connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+		debug("ATT connect failed; %s", strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	link = att_link_alloc(fd, ctx);
+	if(link == NULL) {
+		close(fd);
+		return NULL;
+	}
+	link->connect_cb = connect_cb;
+	link->user_data = user_data;
+
+	//writable once the LE link is up
+	att_link_watch(link, G_IO_OUT);
+
+	return link;
+}
+
+static void att_source_clear(GSource **source) {
+	if(*source != NULL) {
+		g_source_destroy(*source);
+		g_source_unref(*source);
+		*source = NULL;
+	}
+}
+
+void att_link_free(AttLink *link) {
+	AttRequest *req;
+
+	if(link == NULL) {
+		return;
+	}
+
+	att_source_clear(&link->watch);
+	g_mutex_lock(&link->lock);
+	att_source_clear(&link->flush);
+	att_source_clear(&link->timer);
+	g_mutex_unlock(&link->lock);
+
+	//nobody waits on a link that is freed, so only async requests are left
+	//and their callbacks are dropped with it
+	if(link->current != NULL && !link->current->sync) {
+		free(link->current);
+	}
+	while((req = g_queue_pop_head(&link->requests)) != NULL) {
+		free(req);
+	}
+	while((req = g_queue_pop_head(&link->done)) != NULL) {
+		free(req);
+	}
+
+	if(link->fd >= 0) {
+		close(link->fd);
+	}
+	close(link->wake);
+	g_main_context_unref(link->context);
+	g_mutex_clear(&link->lock);
+
+	free(link->chars);
+	free(link);
+}
+
+void att_link_set_handlers(AttLink *link, att_notify_cb_t notify_cb,
+		att_disconnect_cb_t disconnect_cb, void *user_data)
+{
+	link->notify_cb = notify_cb;
+	link->disconnect_cb = disconnect_cb;
+	link->user_data = user_data;
+}
+
+static int att_send(AttLink *link, const uint8_t *pdu, size_t len) {
+	if(write(link->fd, pdu, len) != (ssize_t) len) {
+		debug("ATT write failed; %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void att_handle_value(AttLink *link, const uint8_t *pdu, size_t len) {
+	uint8_t conf = ATT_OP_HANDLE_CONF;
+
+	if(len < 3) {
+		return;
+	}
+
+	if(pdu[0] == ATT_OP_HANDLE_IND) {
+		att_send(link, &conf, 1);
+	}
+
+	if(link->notify_cb != NULL) {
+		link->notify_cb(link, bt_get_le16(&pdu[1]), &pdu[3], len - 3, link->user_data);
+	}
+}
+
+static void att_deliver(AttLink *link, AttRequest *req) {
+	if(req->rsp_cb != NULL) {
+		req->rsp_cb(link, req);
+	} else if(req->cb != NULL) {
+		req->cb(link, req->err, NULL, 0, req->user_data);
+	} else if(req->err != 0) {
+		debug("ATT request 0x%02x failed; %d", req->pdu[0], req->err);
+	}
+	free(req);
+}
+
+//Runs finished requests' callbacks and notifications in the order they came
+static void att_flush_pending(AttLink *link) {
+	AttRequest *req;
+	AttPdu pdu;
+
+	//a callback may make a request of its own which queues more, so always
+	//take from the front
+	for(;;) {
+		g_mutex_lock(&link->lock);
+		req = g_queue_pop_head(&link->done);
+		if(req == NULL) {
+			if(link->num_pending == 0) {
+				g_mutex_unlock(&link->lock);
+				break;
+			}
+			pdu = link->pending[0];
+			link->num_pending--;
+			memmove(&link->pending[0], &link->pending[1], link->num_pending * sizeof(AttPdu));
+		}
+		g_mutex_unlock(&link->lock);
+
+		if(req != NULL) {
+			att_deliver(link, req);
+		} else {
+			att_handle_value(link, pdu.pdu, pdu.len);
+		}
+	}
+}
+
+static gboolean att_flush_cb(gpointer user_data) {
+	AttLink *link = (AttLink*) user_data;
+
+	g_mutex_lock(&link->lock);
+	g_source_unref(link->flush);
+	link->flush = NULL;
+	g_mutex_unlock(&link->lock);
+
+	att_flush_pending(link);
+	return G_SOURCE_REMOVE;
+}
+
+//Callbacks only ever run in the link's context, and never inside whatever
+//read the socket. Must hold the lock
+static void att_schedule_flush(AttLink *link) {
+	if((link->num_pending > 0 || !g_queue_is_empty(&link->done)) && link->flush == NULL) {
+		link->flush = g_idle_source_new();
+		g_source_set_callback(link->flush, att_flush_cb, link, NULL);
+		g_source_attach(link->flush, link->context);
+	}
+}
+
+//Must hold the lock
+static void att_queue_value(AttLink *link, const uint8_t *pdu, size_t len) {
+	if(link->num_pending < ATT_PENDING) {
+		memcpy(link->pending[link->num_pending].pdu, pdu, len);
+		link->pending[link->num_pending].len = len;
+		link->num_pending++;
+		link->max_pending = MAX(link->max_pending, link->num_pending);
+	} else {
+		debug("ATT pending queue full, dropping notification");
+	}
+}
+
+//Must hold the lock
+static void att_complete(AttLink *link, AttRequest *req, int err, const uint8_t *rsp,
+		size_t len)
+{
+	uint64_t one = 1;
+
+	req->err = err;
+	req->rsp_len = len;
+	if(len > 0) {
+		memcpy(req->rsp, rsp, len);
+	}
+
+	if(req->sync) {
+		req->done = true;
+		if(write(link->wake, &one, sizeof(one)) != sizeof(one)) {
+			debug("ATT wake failed; %s", strerror(errno));
+		}
+	} else {
+		g_queue_push_tail(&link->done, req);
+	}
+}
+
+static gboolean att_timeout_cb(gpointer user_data);
+
+//Sends the next request unless one is in flight. Must hold the lock
+static void att_send_next(AttLink *link) {
+	AttRequest *req;
+
+	while(link->current == NULL && (req = g_queue_pop_head(&link->requests)) != NULL) {
+		if(link->failed || att_send(link, req->pdu, req->len) != 0) {
+			att_complete(link, req, ATT_ERR_LINK, NULL, 0);
+			continue;
+		}
+
+		link->current = req;
+		link->deadline = g_get_monotonic_time() + ATT_TIMEOUT_MS * G_GINT64_CONSTANT(1000);
+		link->timer = g_timeout_source_new(ATT_TIMEOUT_MS);
+		g_source_set_callback(link->timer, att_timeout_cb, link, NULL);
+		g_source_attach(link->timer, link->context);
+	}
+}
+
+//Must hold the lock
+static void att_finish_current(AttLink *link, int err, const uint8_t *rsp, size_t len) {
+	AttRequest *req = link->current;
+
+	att_source_clear(&link->timer);
+	link->current = NULL;
+	att_complete(link, req, err, rsp, len);
+	att_send_next(link);
+}
+
+//After a timeout ATT allows no further requests on the bearer, so the link
+//is shut down, which the watch sees as a disconnect. Must hold the lock
+static void att_fail(AttLink *link) {
+	AttRequest *req;
+
+	if(link->failed) {
+		return;
+	}
+	link->failed = true;
+	shutdown(link->fd, SHUT_RDWR);
+
+	if(link->current != NULL) {
+		att_finish_current(link, ATT_ERR_LINK, NULL, 0);
+	}
+	while((req = g_queue_pop_head(&link->requests)) != NULL) {
+		att_complete(link, req, ATT_ERR_LINK, NULL, 0);
+	}
+}
+
+//Must hold the lock
+static void att_check_timeout(AttLink *link) {
+	if(link->current != NULL && g_get_monotonic_time() >= link->deadline) {
+		debug("ATT request 0x%02x timed out", link->current->pdu[0]);
+		att_fail(link);
+	}
+}
+
+static gboolean att_timeout_cb(gpointer user_data) {
+	AttLink *link = (AttLink*) user_data;
+
+	g_mutex_lock(&link->lock);
+	att_check_timeout(link);
+	att_schedule_flush(link);
+	g_mutex_unlock(&link->lock);
+
+	return G_SOURCE_REMOVE;
+}
+
+//Must hold the lock
+static void att_handle_pdu(AttLink *link, const uint8_t *pdu, size_t len) {
+	AttRequest *req = link->current;
+
+	if(pdu[0] == ATT_OP_HANDLE_NOTIFY || pdu[0] == ATT_OP_HANDLE_IND) {
+		att_queue_value(link, pdu, len);
+	} else if(req != NULL && pdu[0] == ATT_OP_ERROR_RSP && len >= 5 && pdu[1] == req->pdu[0]) {
+		att_finish_current(link, -pdu[4], NULL, 0);
+	} else if(req != NULL && pdu[0] == req->rsp_op) {
+		att_finish_current(link, 0, pdu, len);
+	} else {
+		debug("Unexpected ATT opcode 0x%02x", pdu[0]);
+	}
+}
+
+//Reads whatever is queued on the socket, one pdu per read. Stops early once
+//the pending queue is full if the caller can deliver it. Must hold the lock
+static void att_read_all(AttLink *link, bool stop_when_full) {
+	uint8_t buf[ATT_PDU_SIZE];
+	ssize_t len;
+
+	while((len = read(link->fd, buf, sizeof(buf))) > 0) {
+		att_handle_pdu(link, buf, len);
+		if(stop_when_full && link->num_pending == ATT_PENDING) {
+			break;
+		}
+	}
+}
+
+//Must hold the lock
+static void att_queue_request(AttLink *link, AttRequest *req) {
+	g_queue_push_tail(&link->requests, req);
+	att_send_next(link);
+	att_schedule_flush(link);
+}
+
+static int att_request_async(AttLink *link, const uint8_t *pdu, size_t len, uint8_t rsp_op,
+		void (*rsp_cb)(AttLink*, AttRequest*), att_done_cb_t cb, void *user_data)
+{
+	AttRequest *req;
+
+	req = calloc(1, sizeof(AttRequest));
+	if(req == NULL) {
+		return -1;
+	}
+	memcpy(req->pdu, pdu, len);
+	req->len = len;
+	req->rsp_op = rsp_op;
+	req->rsp_cb = rsp_cb;
+	req->cb = cb;
+	req->user_data = user_data;
+
+	g_mutex_lock(&link->lock);
+	att_queue_request(link, req);
+	g_mutex_unlock(&link->lock);
+
+	return 0;
+}
+
+//Queues a request and waits for its response, which is left in rsp (at
+//least ATT_PDU_SIZE long). The waiting thread reads the socket itself, so
+//it does not matter what the link's context is doing. Returns the response
+//length or a negative error
+static int att_request(AttLink *link, const uint8_t *pdu, size_t len, uint8_t rsp_op,
+		uint8_t *rsp)
+{
+	AttRequest req;
+	struct pollfd pfds[2];
+	uint64_t count;
+	gint64 wait;
+
+	memset(&req, 0, sizeof(req));
+	memcpy(req.pdu, pdu, len);
+	req.len = len;
+	req.rsp_op = rsp_op;
+	req.sync = true;
+
+	pfds[0].fd = link->fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = link->wake;
+	pfds[1].events = POLLIN;
+
+	g_mutex_lock(&link->lock);
+	att_queue_request(link, &req);
+	for(;;) {
+		att_read_all(link, false);
+		att_check_timeout(link);
+		if(req.done) {
+			break;
+		}
+
+		wait = link->current != NULL ? link->deadline - g_get_monotonic_time() :
+				ATT_TIMEOUT_MS * G_GINT64_CONSTANT(1000);
+		g_mutex_unlock(&link->lock);
+		poll(pfds, 2, (int) MAX((wait + 999) / 1000, 1));
+		if(pfds[1].revents & POLLIN) {
+			if(read(link->wake, &count, sizeof(count)) < 0) {
+				debug("ATT wake failed; %s", strerror(errno));
+			}
+		}
+		g_mutex_lock(&link->lock);
+	}
+	//whatever came in meanwhile goes out from the context
+	att_schedule_flush(link);
+	g_mutex_unlock(&link->lock);
+
+	if(req.err != 0) {
+		return req.err;
+	}
+	memcpy(rsp, req.rsp, req.rsp_len);
+	return req.rsp_len;
+}
+
+static gboolean att_link_io_cb(GIOChannel *channel, GIOCondition cond, gpointer user_data) {
+	AttLink *link = (AttLink*) user_data;
+	socklen_t optlen;
+	int err;
+
+	if(link->connect_cb != NULL) {
+		att_connect_cb_t connect_cb = link->connect_cb;
+
+		link->connect_cb = NULL;
+		err = 0;
+		optlen = sizeof(err);
+		if(getsockopt(link->fd, SOL_SOCKET, SO_ERROR, &err, &optlen) < 0) {
+			err = errno;
+		}
+		if(err == 0 && (cond & (G_IO_HUP | G_IO_ERR))) {
+			err = ECONNREFUSED;
+		}
+
+		//swap the connect watch for a notification watch
+		g_source_unref(link->watch);
+		link->watch = NULL;
+		if(err == 0) {
+			att_link_watch(link, G_IO_IN);
+		}
+
+		connect_cb(link, err, link->user_data);
+		return G_SOURCE_REMOVE;
+	}
+
+	if(cond & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) {
+		debug("ATT link closed");
+		g_mutex_lock(&link->lock);
+		att_fail(link);
+		g_mutex_unlock(&link->lock);
+		att_flush_pending(link);
+
+		g_source_unref(link->watch);
+		link->watch = NULL;
+		if(link->disconnect_cb != NULL) {
+			link->disconnect_cb(link, link->user_data);
+		}
+		return G_SOURCE_REMOVE;
+	}
+
+	//drain everything that is queued. A thread waiting on a response may
+	//have got there first, in which case the read finds nothing
+	g_mutex_lock(&link->lock);
+	att_read_all(link, true);
+	g_mutex_unlock(&link->lock);
+
+	att_flush_pending(link);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void att_mtu_rsp(AttLink *link, AttRequest *req) {
+	uint16_t mtu = bt_get_le16(&req->pdu[1]);
+
+	if(req->err == 0 && req->rsp_len >= 3) {
+		g_mutex_lock(&link->lock);
+		link->mtu = MAX(ATT_DEFAULT_MTU, MIN(mtu, bt_get_le16(&req->rsp[1])));
+		g_mutex_unlock(&link->lock);
+		debug("ATT MTU %u", link->mtu);
+	}
+	//otherwise not supported by the peer, stay at the default
+
+	if(req->cb != NULL) {
+		req->cb(link, req->err, NULL, 0, req->user_data);
+	}
+}
+
+int att_link_exchange_mtu(AttLink *link, uint16_t mtu, att_done_cb_t cb, void *user_data) {
+	uint8_t req[3];
+
+	req[0] = ATT_OP_MTU_REQ;
+	bt_put_le16(MIN(mtu, ATT_MAX_MTU), &req[1]);
+
+	return att_request_async(link, req, sizeof(req), ATT_OP_MTU_RSP, att_mtu_rsp, cb, user_data);
+}
+
+uint16_t att_link_get_mtu(AttLink *link) {
+	uint16_t mtu;
+
+	g_mutex_lock(&link->lock);
+	mtu = link->mtu;
+	g_mutex_unlock(&link->lock);
+
+	return mtu;
+}
+
+int att_link_take_max_pending(AttLink *link) {
+	int max_pending;
+
+	g_mutex_lock(&link->lock);
+	max_pending = link->max_pending;
+	link->max_pending = link->num_pending;
+	g_mutex_unlock(&link->lock);
+
+	return max_pending;
+}
+
+//Discovery goes characteristic declarations first, then the CCCD of every
+//characteristic that notifies, one request per step
+
+static void att_discover_chars(AttLink *link, uint16_t start);
+static void att_discover_next_cccd(AttLink *link, uint16_t start);
+
+static void att_discover_done(AttLink *link, int err) {
+	att_done_cb_t cb = link->discover_cb;
+
+	link->discover_cb = NULL;
+	if(err == 0) {
+		debug("ATT discovered %d characteristics", link->num_chars);
+	}
+	if(cb != NULL) {
+		cb(link, err, NULL, 0, link->discover_data);
+	}
+}
+
+static void att_discover_chars_end(AttLink *link) {
+	int i;
+
+	for(i = 0; i < link->num_chars; i++) {
+		link->chars[i].end_handle = (i + 1 < link->num_chars) ?
+				link->chars[i + 1].decl_handle - 1 : 0xFFFF;
+	}
+	link->discover_index = 0;
+	att_discover_next_cccd(link, 0);
+}
+
+static void att_discover_chars_rsp(AttLink *link, AttRequest *req) {
+	int entry_len, i, len = req->rsp_len;
+	const uint8_t *entry, *rsp = req->rsp;
+	uint16_t start = 0;
+	AttChar *chars, *chr;
+
+	if(req->err == -ATT_ECODE_ATTR_NOT_FOUND) {
+		att_discover_chars_end(link);
+		return;
+	}
+	if(req->err != 0 || len < 2) {
+		att_discover_done(link, req->err != 0 ? req->err : -1);
+		return;
+	}
+
+	//handle, properties, value handle, then a 16 or 128 bit uuid
+	entry_len = rsp[1];
+	if(entry_len != 7 && entry_len != 21) {
+		debug("Bad characteristic declaration length %d", entry_len);
+		att_discover_done(link, -1);
+		return;
+	}
+
+	for(i = 2; i + entry_len <= len; i += entry_len) {
+		entry = &rsp[i];
+
+		chars = realloc(link->chars, (link->num_chars + 1) * sizeof(AttChar));
+		if(chars == NULL) {
+			att_discover_done(link, -1);
+			return;
+		}
+		link->chars = chars;
+		chr = &link->chars[link->num_chars++];
+		memset(chr, 0, sizeof(AttChar));
+
+		chr->decl_handle = bt_get_le16(&entry[0]);
+		chr->properties = entry[2];
+		chr->value_handle = bt_get_le16(&entry[3]);
+		if(entry_len == 7) {
+			uuid_from_16(bt_get_le16(&entry[5]), chr->uuid);
+		} else {
+			memcpy(chr->uuid, &entry[5], 16);
+		}
+
+		start = chr->decl_handle + 1;
+	}
+
+	//0 when the last declaration sat at 0xFFFF
+	if(start == 0) {
+		att_discover_chars_end(link);
+	} else {
+		att_discover_chars(link, start);
+	}
+}
+
+static void att_discover_chars(AttLink *link, uint16_t start) {
+	uint8_t req[7];
+
+	req[0] = ATT_OP_READ_BY_TYPE_REQ;
+	bt_put_le16(start, &req[1]);
+	bt_put_le16(0xFFFF, &req[3]);
+	bt_put_le16(GATT_CHARAC_UUID, &req[5]);
+
+	if(att_request_async(link, req, sizeof(req), ATT_OP_READ_BY_TYPE_RSP,
+			att_discover_chars_rsp, NULL, NULL) != 0) {
+		att_discover_done(link, -1);
+	}
+}
+
+static void att_discover_cccd_rsp(AttLink *link, AttRequest *req) {
+	AttChar *chr = &link->chars[link->discover_index];
+	uint16_t start = 0;
+	int i;
+
+	if(req->err != 0 && req->err != -ATT_ECODE_ATTR_NOT_FOUND) {
+		att_discover_done(link, req->err);
+		return;
+	}
+
+	//format 1 is 16 bit uuids, which is all a cccd can be
+	if(req->err == 0 && req->rsp_len >= 2 && req->rsp[1] == 0x01) {
+		for(i = 2; i + 4 <= req->rsp_len; i += 4) {
+			if(bt_get_le16(&req->rsp[i + 2]) == GATT_CLIENT_CHARAC_CFG_UUID) {
+				chr->cccd_handle = bt_get_le16(&req->rsp[i]);
+				start = 0;
+				break;
+			}
+			start = bt_get_le16(&req->rsp[i]) + 1;
+		}
+	}
+
+	if(start == 0 || start > chr->end_handle) {
+		link->discover_index++;
+		start = 0;
+	}
+	att_discover_next_cccd(link, start);
+}
+
+//Asks for the descriptors of the current characteristic from start, or of
+//the next one that notifies when start is 0
+static void att_discover_next_cccd(AttLink *link, uint16_t start) {
+	uint8_t req[5];
+	AttChar *chr;
+
+	if(start == 0) {
+		while(link->discover_index < link->num_chars && !(link->chars[link->discover_index].properties &
+				(GATT_CHR_PROP_NOTIFY | GATT_CHR_PROP_INDICATE))) {
+			link->discover_index++;
+		}
+		if(link->discover_index == link->num_chars) {
+			att_discover_done(link, 0);
+			return;
+		}
+		chr = &link->chars[link->discover_index];
+		start = chr->value_handle + 1;
+		if(start == 0 || start > chr->end_handle) {
+			link->discover_index++;
+			att_discover_next_cccd(link, 0);
+			return;
+		}
+	} else {
+		chr = &link->chars[link->discover_index];
+	}
+
+	req[0] = ATT_OP_FIND_INFO_REQ;
+	bt_put_le16(start, &req[1]);
+	bt_put_le16(chr->end_handle, &req[3]);
+
+	if(att_request_async(link, req, sizeof(req), ATT_OP_FIND_INFO_RSP,
+			att_discover_cccd_rsp, NULL, NULL) != 0) {
+		att_discover_done(link, -1);
+	}
+}
+
+int att_link_discover(AttLink *link, att_done_cb_t cb, void *user_data) {
+	if(link->discover_cb != NULL) {
+		return -1;
+	}
+
+	free(link->chars);
+	link->chars = NULL;
+	link->num_chars = 0;
+	link->discover_cb = cb;
+	link->discover_data = user_data;
+
+	att_discover_chars(link, 0x0001);
+	return 0;
+}
+
+uint16_t att_link_find_char(AttLink *link, const char *uuid, uint16_t *cccd_handle) {
+	uint8_t uuid_le[16];
+	int i;
+
+	if(uuid_from_string(uuid, uuid_le) != 0) {
+		return 0;
+	}
+
+	for(i = 0; i < link->num_chars; i++) {
+		if(memcmp(link->chars[i].uuid, uuid_le, 16) == 0) {
+			if(cccd_handle != NULL) {
+				*cccd_handle = link->chars[i].cccd_handle;
+			}
+			return link->chars[i].value_handle;
+		}
+	}
+
+	return 0;
+}
+
+static void att_read_rsp(AttLink *link, AttRequest *req) {
+	if(req->cb == NULL) {
+		return;
+	}
+	if(req->err != 0 || req->rsp_len < 1) {
+		req->cb(link, req->err != 0 ? req->err : -1, NULL, 0, req->user_data);
+		return;
+	}
+	req->cb(link, 0, &req->rsp[1], req->rsp_len - 1, req->user_data);
+}
+
+int att_link_read_async(AttLink *link, uint16_t handle, att_done_cb_t cb, void *user_data) {
+	uint8_t req[3];
+
+	req[0] = ATT_OP_READ_REQ;
+	bt_put_le16(handle, &req[1]);
+
+	return att_request_async(link, req, sizeof(req), ATT_OP_READ_RSP, att_read_rsp, cb,
+			user_data);
+}
+
+int att_link_read(AttLink *link, uint16_t handle, uint8_t *value, size_t len) {
+	uint8_t req[3], rsp[ATT_PDU_SIZE];
+	int rsp_len;
+
+	req[0] = ATT_OP_READ_REQ;
+	bt_put_le16(handle, &req[1]);
+
+	rsp_len = att_request(link, req, sizeof(req), ATT_OP_READ_RSP, rsp);
+	if(rsp_len < 1) {
+		return -1;
+	}
+
+	rsp_len = MIN((size_t) rsp_len - 1, len);
+	memcpy(value, &rsp[1], rsp_len);
+	return rsp_len;
+}
+
+//Returns the pdu length, or 0 if the value does not fit the MTU
+static size_t att_write_pdu(AttLink *link, uint16_t handle, const uint8_t *value, size_t len,
+		uint8_t *pdu)
+{
+	if(len + 3 > att_link_get_mtu(link)) {
+		return 0;
+	}
+
+	pdu[0] = ATT_OP_WRITE_REQ;
+	bt_put_le16(handle, &pdu[1]);
+	memcpy(&pdu[3], value, len);
+	return len + 3;
+}
+
+int att_link_write_async(AttLink *link, uint16_t handle, const uint8_t *value, size_t len,
+		att_done_cb_t cb, void *user_data)
+{
+	uint8_t req[ATT_MAX_MTU];
+	size_t req_len;
+
+	req_len = att_write_pdu(link, handle, value, len, req);
+	if(req_len == 0) {
+		return -1;
+	}
+
+	return att_request_async(link, req, req_len, ATT_OP_WRITE_RSP, NULL, cb, user_data);
+}
+
+int att_link_write(AttLink *link, uint16_t handle, const uint8_t *value, size_t len) {
+	uint8_t req[ATT_MAX_MTU], rsp[ATT_PDU_SIZE];
+	size_t req_len;
+
+	req_len = att_write_pdu(link, handle, value, len, req);
+	if(req_len == 0) {
+		return -1;
+	}
+
+	return att_request(link, req, req_len, ATT_OP_WRITE_RSP, rsp) < 1 ? -1 : 0;
+}
+
+int att_link_set_conn_params(AttLink *link, uint16_t min_interval, uint16_t max_interval,
+		uint16_t latency, uint16_t supervision_timeout)
+{
+	struct l2cap_conninfo info;
+	struct sockaddr_l2 src;
+	le_connection_update_cp cp;
+	socklen_t len;
+	char address[18];
+	int dev_id, dd, ret;
+
+	len = sizeof(info);
+	if(getsockopt(link->fd, SOL_L2CAP, L2CAP_CONNINFO, &info, &len) < 0) {
+		debug("ATT get connection info failed; %s", strerror(errno));
+		return -1;
+	}
+
+	//the connection handle only means something to the adapter the link
+	//went out on
+	len = sizeof(src);
+	if(getsockname(link->fd, (struct sockaddr*) &src, &len) < 0) {
+		debug("ATT get source address failed; %s", strerror(errno));
+		return -1;
+	}
+	ba2str(&src.l2_bdaddr, address);
+	dev_id = hci_devid(address);
+	if(dev_id < 0) {
+		debug("No adapter for %s", address);
+		return -1;
+	}
+
+	dd = hci_open_dev(dev_id);
+	if(dd < 0) {
+		return -1;
+	}
+
+	memset(&cp, 0, sizeof(cp));
+	cp.handle = htobs(info.hci_handle);
+	cp.min_interval = htobs(min_interval);
+	cp.max_interval = htobs(max_interval);
+	cp.latency = htobs(latency);
+	cp.supervision_timeout = htobs(supervision_timeout);
+	cp.min_ce_length = htobs(0x0001);
+	cp.max_ce_length = htobs(0x0001);
+
+	//needs CAP_NET_ADMIN, without it we keep whatever the controller picked.
+	//The outcome comes as an LE event that nobody needs to wait for
+	ret = hci_send_cmd(dd, OGF_LE_CTL, OCF_LE_CONN_UPDATE, LE_CONN_UPDATE_CP_SIZE, &cp);
+	if(ret < 0) {
+		debug("Connection update failed; %s", strerror(errno));
+	}
+
+	hci_close_dev(dd);
+	return ret < 0 ? -1 : 0;
+}
@@ -0,0 +1,124 @@
+#include "myo-bluez.h"
+#include "myo-bluez_adapt.h"
+#include "myo-bluez_budget.h"
+
+unsigned int myo_budget_rate(myohw_emg_mode_t emg, myohw_imu_mode_t imu) {
+	MyoAdaptLevel level = { emg, imu };
+
+	return myo_adapt_expected_rate(&level, true, true);
+}
+
+static unsigned int level_rate(const MyoAdapt *ladder) {
+	const MyoAdaptLevel *level = myo_adapt_current(ladder);
+
+	return myo_budget_rate(level->emg, level->imu);
+}
+
+//Fills members with the requests on adapter, highest priority first
+static int budget_members(const MyoBudgetRequest *requests, int count, int adapter,
+		int *members)
+{
+	int i, j, n = 0, tmp;
+
+	for(i = 0; i < count; i++) {
+		if(requests[i].adapter != adapter) {
+			continue;
+		}
+		//insertion sort, stable so equal priorities keep request order
+		members[n] = i;
+		for(j = n++; j > 0 && requests[members[j - 1]].priority < requests[members[j]].priority; j--) {
+			tmp = members[j];
+			members[j] = members[j - 1];
+			members[j - 1] = tmp;
+		}
+	}
+
+	return n;
+}
+
+static void budget_priority(const MyoBudgetConfig *config, MyoAdapt *ladders,
+		const int *members, int n)
+{
+	unsigned int left = config->capacity, rate;
+	MyoAdapt *ladder;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		ladder = &ladders[members[i]];
+		while((rate = level_rate(ladder)) > left && ladder->level + 1 < ladder->num_levels) {
+			ladder->level++;
+		}
+		left -= MIN(rate, left);
+	}
+}
+
+static void budget_fair_share(const MyoBudgetConfig *config, MyoAdapt *ladders,
+		const int *members, int n)
+{
+	unsigned int total = 0, rate, most;
+	MyoAdapt *ladder, *victim;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		total += level_rate(&ladders[members[i]]);
+	}
+
+	while(total > config->capacity) {
+		//the largest share gives first, among equals the lowest priority
+		victim = NULL;
+		most = 0;
+		for(i = n - 1; i >= 0; i--) {
+			ladder = &ladders[members[i]];
+			rate = level_rate(ladder);
+			if(ladder->level + 1 < ladder->num_levels && (victim == NULL || rate > most)) {
+				victim = ladder;
+				most = rate;
+			}
+		}
+		if(victim == NULL) {
+			break;
+		}
+		victim->level++;
+		total = total - most + level_rate(victim);
+	}
+}
+
+void myo_budget_assign(const MyoBudgetConfig *config, const MyoBudgetRequest *requests,
+		int count, MyoBudgetGrant *grants)
+{
+	MyoAdapt ladders[MYO_BUDGET_MAX_REQUESTS];
+	int members[MYO_BUDGET_MAX_REQUESTS];
+	const MyoAdaptLevel *level;
+	bool done[MYO_BUDGET_MAX_REQUESTS];
+	int i, j, n;
+
+	count = MIN(count, MYO_BUDGET_MAX_REQUESTS);
+	for(i = 0; i < count; i++) {
+		myo_adapt_init(&ladders[i], requests[i].emg, requests[i].imu);
+		done[i] = false;
+	}
+
+	//one adapter at a time
+	for(i = 0; i < count; i++) {
+		if(done[i]) {
+			continue;
+		}
+		n = budget_members(requests, count, requests[i].adapter, members);
+		for(j = 0; j < n; j++) {
+			done[members[j]] = true;
+		}
+
+		if(config->policy == MYO_BUDGET_FAIR_SHARE) {
+			budget_fair_share(config, ladders, members, n);
+		} else {
+			budget_priority(config, ladders, members, n);
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		level = myo_adapt_current(&ladders[i]);
+		grants[i].emg = level->emg;
+		grants[i].imu = level->imu;
+		grants[i].projected = myo_budget_rate(level->emg, level->imu);
+	}
+}
@@ -0,0 +1,186 @@
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_cache.h"
+
+#define CACHE_DIR "myo-bluez"
+
+#define MYO_GROUP "Myo"
+#define PATH_GROUP "Paths"
+#define HANDLE_GROUP "Handles"
+
+MyoCache* myo_cache_open(const char *address) {
+	MyoCache *cache;
+	char *name, *dir;
+	GError *err = NULL;
+
+	dir = g_build_filename(g_get_user_cache_dir(), CACHE_DIR, NULL);
+	name = g_strdup_printf("%s.conf", address);
+	//keep colons out of file names
+	g_strdelimit(name, ":", '_');
+
+	cache = calloc(1, sizeof(MyoCache));
+	cache->file = g_build_filename(dir, name, NULL);
+	cache->keyfile = g_key_file_new();
+	g_free(name);
+	g_free(dir);
+
+	cache->loaded = g_key_file_load_from_file(cache->keyfile, cache->file,
+			G_KEY_FILE_NONE, &err);
+	if(err != NULL) {
+		if(!g_error_matches(err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+			debug("Failed to load cache %s; %s", cache->file, err->message);
+		}
+		g_clear_error(&err);
+	}
+
+	return cache;
+}
+
+void myo_cache_free(MyoCache *cache) {
+	if(cache == NULL) {
+		return;
+	}
+
+	g_key_file_free(cache->keyfile);
+	g_free(cache->file);
+	free(cache);
+}
+
+int myo_cache_save(MyoCache *cache) {
+	GError *err = NULL;
+	char *dir;
+
+	dir = g_path_get_dirname(cache->file);
+	if(g_mkdir_with_parents(dir, 0700) != 0) {
+		debug("Failed to create cache dir %s; %s", dir, strerror(errno));
+		g_free(dir);
+		return MYOBLUEZ_ERROR;
+	}
+	g_free(dir);
+
+	if(!g_key_file_save_to_file(cache->keyfile, cache->file, &err)) {
+		debug("Failed to save cache %s; %s", cache->file, err->message);
+		g_clear_error(&err);
+		return MYOBLUEZ_ERROR;
+	}
+
+	cache->loaded = true;
+	return MYOBLUEZ_OK;
+}
+
+void myo_cache_clear(MyoCache *cache) {
+	g_key_file_free(cache->keyfile);
+	cache->keyfile = g_key_file_new();
+	cache->loaded = false;
+	g_unlink(cache->file);
+}
+
+bool myo_cache_get_version(MyoCache *cache, myohw_fw_version_t *version) {
+	char *str;
+	unsigned int major, minor, patch, hardware_rev;
+	int n;
+
+	str = g_key_file_get_string(cache->keyfile, MYO_GROUP, "Version", NULL);
+	if(str == NULL) {
+		return false;
+	}
+
+	n = sscanf(str, "%u.%u.%u.%u", &major, &minor, &patch, &hardware_rev);
+	g_free(str);
+	if(n != 4) {
+		return false;
+	}
+
+	version->major = major;
+	version->minor = minor;
+	version->patch = patch;
+	version->hardware_rev = hardware_rev;
+	return true;
+}
+
+void myo_cache_set_version(MyoCache *cache, const myohw_fw_version_t *version) {
+	char *str;
+
+	str = g_strdup_printf("%u.%u.%u.%u", version->major, version->minor,
+			version->patch, version->hardware_rev);
+	g_key_file_set_string(cache->keyfile, MYO_GROUP, "Version", str);
+	g_free(str);
+}
+
+bool myo_cache_get_info(MyoCache *cache, myohw_fw_info_t *info) {
+	char *str;
+	guchar *raw;
+	gsize len;
+
+	str = g_key_file_get_string(cache->keyfile, MYO_GROUP, "Info", NULL);
+	if(str == NULL) {
+		return false;
+	}
+
+	raw = g_base64_decode(str, &len);
+	g_free(str);
+	if(len != sizeof(myohw_fw_info_t)) {
+		g_free(raw);
+		return false;
+	}
+
+	memcpy(info, raw, sizeof(myohw_fw_info_t));
+	g_free(raw);
+	return true;
+}
+
+void myo_cache_set_info(MyoCache *cache, const myohw_fw_info_t *info) {
+	char *str;
+
+	str = g_base64_encode((const guchar*) info, sizeof(myohw_fw_info_t));
+	g_key_file_set_string(cache->keyfile, MYO_GROUP, "Info", str);
+	g_free(str);
+}
+
+char* myo_cache_get_name(MyoCache *cache) {
+	return g_key_file_get_string(cache->keyfile, MYO_GROUP, "Name", NULL);
+}
+
+void myo_cache_set_name(MyoCache *cache, const char *name) {
+	g_key_file_set_string(cache->keyfile, MYO_GROUP, "Name", name);
+}
+
+char* myo_cache_get_path(MyoCache *cache, const char *uuid) {
+	return g_key_file_get_string(cache->keyfile, PATH_GROUP, uuid, NULL);
+}
+
+void myo_cache_set_path(MyoCache *cache, const char *uuid, const char *path) {
+	g_key_file_set_string(cache->keyfile, PATH_GROUP, uuid, path);
+}
+
+bool myo_cache_get_handles(MyoCache *cache, const char *uuid, uint16_t *handle, uint16_t *cccd) {
+	char *str;
+	unsigned int value_handle, cccd_handle;
+	int n;
+
+	str = g_key_file_get_string(cache->keyfile, HANDLE_GROUP, uuid, NULL);
+	if(str == NULL) {
+		return false;
+	}
+
+	n = sscanf(str, "%u,%u", &value_handle, &cccd_handle);
+	g_free(str);
+	if(n != 2 || value_handle == 0 || value_handle > 0xFFFF || cccd_handle > 0xFFFF) {
+		return false;
+	}
+
+	*handle = value_handle;
+	*cccd = cccd_handle;
+	return true;
+}
+
+void myo_cache_set_handles(MyoCache *cache, const char *uuid, uint16_t handle, uint16_t cccd) {
+	char *str;
+
+	str = g_strdup_printf("%u,%u", handle, cccd);
+	g_key_file_set_string(cache->keyfile, HANDLE_GROUP, uuid, str);
+	g_free(str);
+}
@@ -1,4 +1,6 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <glib.h>
 
@@ -19,7 +21,7 @@ void on_imu(myohw_imu_data_t data) {
 	);
 }
 
-void on_arm(myohw_classifier_event_t event) {
+void on_classifier(myohw_classifier_event_t event) {
 	switch(event.type) {
 		case myohw_classifier_event_arm_synced:
 			printf(
@@ -30,7 +32,7 @@ void on_arm(myohw_classifier_event_t event) {
 			);
 			break;
 		case myohw_classifier_event_arm_unsynced:
-			debug("Unsynced");
+			printf("Unsynced\n");
 			break;
 		case myohw_classifier_event_pose:
 			printf(
@@ -41,19 +43,69 @@ void on_arm(myohw_classifier_event_t event) {
 			);
 			break;
 		case myohw_classifier_event_unlocked:
-			debug("Unlocked");
+			printf("Unlocked\n");
 			break;
 		case myohw_classifier_event_locked:
-			debug("Locked");
+			printf("Locked\n");
 			break;
 		case myohw_classifier_event_sync_failed:
-			debug("Sync failed");
+			printf("Sync failed\n");
 			break;
 		default:
 			debug("Unknown event type %d", event.type);
 	}
 }
 
+//low rate events all come through the queue
+gboolean drain_events(gpointer user_data) {
+	MyoEvent events[32];
+	unsigned int dropped;
+	int i, n;
+
+	do {
+		n = myobluez_drain_events(events, 32, &dropped);
+		if(dropped > 0) {
+			printf("%u events dropped\n", dropped);
+		}
+
+		for(i = 0; i < n; i++) {
+			switch(events[i].type) {
+				case MYO_EVENT_CONNECTED:
+				case MYO_EVENT_DISCONNECTED:
+				case MYO_EVENT_READY:
+					debug("Connection event %d", events[i].type);
+					break;
+				case MYO_EVENT_CLASSIFIER:
+					on_classifier(events[i].classifier);
+					break;
+				case MYO_EVENT_MOTION:
+					printf("Tap x%d, direction %d\n",
+							events[i].motion.tap_count, events[i].motion.tap_direction);
+					break;
+				case MYO_EVENT_BATTERY:
+					printf("Battery: %d%%\n", events[i].battery);
+					break;
+				case MYO_EVENT_QUALITY:
+					printf("EMG channel %d quality: 0x%x\n",
+							events[i].quality.channel + 1, events[i].quality.flags);
+					break;
+				case MYO_EVENT_LINK:
+					if(events[i].link.kind == MYO_LINK_RSSI) {
+						printf("RSSI: %d dBm\n", events[i].link.rssi);
+					} else {
+						printf("%s gap of %ums, %u lost (%s)\n",
+								events[i].link.stream == MYO_LINK_EMG ? "EMG" : "IMU",
+								events[i].link.gap_ms, events[i].link.lost,
+								events[i].link.kind == MYO_LINK_STALL ? "host stall" : "radio");
+					}
+					break;
+			}
+		}
+	} while(n == 32);
+
+	return G_SOURCE_CONTINUE;
+}
+
 void on_emg(int16_t *emg, uint8_t moving) {
 	printf(
 			"On_EMG:\n"
@@ -87,13 +139,15 @@ int myo_initialize(myobluez_myo_t myo) {
 	printf("device name: %s\n", name);
 
 	myo_imu_cb_register(myo, on_imu);
-	myo_arm_cb_register(myo, on_arm);
 	myo_emg_cb_register(myo, on_emg);
 
 	//enable IMU data
 	myo_IMU_notify_enable(myo, true);
 	//enable on/off arm notifications
 	myo_arm_indicate_enable(myo, true);
+	//taps and battery level
+	myo_motion_indicate_enable(myo, true);
+	myo_battery_notify_enable(myo, true);
 
 	myo_update_enable(
 			myo,
@@ -107,6 +161,17 @@ int myo_initialize(myobluez_myo_t myo) {
 	return MYOBLUEZ_OK;
 }
 
+void client_trace_dump(int sig) {
+	int fd;
+
+	fd = open("myo-bluez.trace", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		return;
+	}
+	myobluez_trace_dump(fd);
+	close(fd);
+}
+
 void client_stop(int sig) {
 	myobluez_deinit();
 
@@ -123,10 +188,12 @@ void client_stop(int sig) {
 
 int main(void) {
 	signal(SIGINT, client_stop);
+	signal(SIGUSR1, client_trace_dump);
 
 	loop = g_main_loop_new(NULL, false);
 
 	myobluez_init(myo_initialize);
+	g_timeout_add(100, drain_events, NULL);
 
 	debug("Running Main Loop");
 	g_main_loop_run(loop);
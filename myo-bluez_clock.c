@@ -0,0 +1,111 @@
+#include <math.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_clock.h"
+
+//quantile of the residuals the stamps are put on
+#define FLOOR_QUANTILE 0.05
+
+void myo_clock_init(MyoClock *clock, double nominal_us) {
+	memset(clock, 0, sizeof(MyoClock));
+	clock->nominal_us = MAX(nominal_us, 1.0);
+	clock->b = clock->nominal_us;
+	clock->stats.period_us = clock->b;
+}
+
+//Starts the fit over at an arrival, keeping the period
+static void clock_anchor(MyoClock *clock, int64_t arrival, uint64_t index) {
+	clock->t0 = arrival;
+	clock->n0 = index;
+	clock->a = 0.0;
+	//the offset is unknown to about a period, the period to 1000ppm
+	clock->p[0][0] = clock->nominal_us * clock->nominal_us;
+	clock->p[0][1] = clock->p[1][0] = 0.0;
+	clock->p[1][1] = clock->nominal_us * clock->nominal_us * 1e-6;
+	clock->late = 0;
+	clock->stats.floor_us = 0.0;
+	clock->stats.anchors++;
+}
+
+static void clock_fit(MyoClock *clock, double x, double e) {
+	MyoClockStats *stats = &clock->stats;
+	double c, pp0, pp1, den, k0, k1;
+
+	c = MAX(MYO_CLOCK_HUBER * stats->jitter_us, clock->nominal_us);
+	stats->jitter_us += (fabs(e) - stats->jitter_us) / 64.0;
+	stats->floor_us += clock->nominal_us / 32.0 *
+			(FLOOR_QUANTILE - (e < stats->floor_us ? 1.0 : 0.0));
+	e = CLAMP(e, -c, c);
+
+	pp0 = clock->p[0][0] + clock->p[0][1] * x;
+	pp1 = clock->p[1][0] + clock->p[1][1] * x;
+	den = MYO_CLOCK_FORGET + pp0 + x * pp1;
+	k0 = pp0 / den;
+	k1 = pp1 / den;
+	clock->a += k0 * e;
+	clock->b += k1 * e;
+
+	clock->p[0][0] = (clock->p[0][0] - k0 * pp0) / MYO_CLOCK_FORGET;
+	clock->p[0][1] = (clock->p[0][1] - k0 * pp1) / MYO_CLOCK_FORGET;
+	clock->p[1][0] = (clock->p[1][0] - k1 * pp0) / MYO_CLOCK_FORGET;
+	clock->p[1][1] = (clock->p[1][1] - k1 * pp1) / MYO_CLOCK_FORGET;
+}
+
+void myo_clock_push(MyoClock *clock, int count, int64_t arrival, int64_t *stamps) {
+	MyoClockStats *stats = &clock->stats;
+	uint64_t index = clock->n + count - 1, skip;
+	double x, e, threshold;
+	int64_t stamp;
+	int i;
+
+	if(clock->last == 0 || arrival - clock->last > MYO_CLOCK_RESET_US) {
+		clock_anchor(clock, arrival, index);
+	} else {
+		x = (double) (index - clock->n0);
+		e = (arrival - clock->t0) - (clock->a + clock->b * x);
+		threshold = MAX(MYO_CLOCK_GAP_FACTOR * count * clock->nominal_us,
+				2 * MYO_CLOCK_HUBER * stats->jitter_us);
+
+		if(e > threshold) {
+			//either samples went missing or the host fell behind, in which
+			//case the queued arrivals catch up, the fit waits until the
+			//arrivals stay equally late
+			if(clock->late == 0 || e < clock->late_min - count * clock->nominal_us / 2) {
+				clock->late = 0;
+				clock->late_min = e;
+			}
+			clock->late_min = MIN(clock->late_min, e);
+			if(++clock->late == MYO_CLOCK_SETTLE) {
+				//the least late arrival had about the least latency
+				skip = (uint64_t) llround((clock->late_min - stats->floor_us) / clock->b);
+				index += skip;
+				stats->gaps++;
+				stats->skipped += skip;
+				clock->late = 0;
+			}
+		} else if(e < -threshold) {
+			//arrivals are never that early, the fit is off
+			clock_anchor(clock, arrival, index);
+		} else {
+			if(clock->late > 0) {
+				stats->stalls++;
+				clock->late = 0;
+			}
+			clock_fit(clock, x, e);
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		x = (double) (index - (count - 1 - i)) - (double) clock->n0;
+		stamp = clock->t0 + llround(clock->a + clock->b * x + stats->floor_us);
+		//a refit never takes time back
+		stamps[i] = MAX(stamp, clock->last_stamp + 1);
+		clock->last_stamp = stamps[i];
+	}
+
+	clock->n = index + 1;
+	clock->last = arrival;
+	stats->samples += count;
+	stats->period_us = clock->b;
+	stats->drift_ppm = (clock->b / clock->nominal_us - 1.0) * 1e6;
+}
@@ -0,0 +1,446 @@
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "myo-bluez_codec.h"
+
+#define MAX_WIDTH 32
+//a block is MYO_CODEC_BLOCK values of width bits, so 2 bytes per bit of width
+#define BLOCK_BYTES(WIDTH) ((WIDTH) * MYO_CODEC_BLOCK / 8)
+#define NUM_BLOCKS(N) (((N) + MYO_CODEC_BLOCK - 1) / MYO_CODEC_BLOCK)
+#define MAX_RESIDUALS (NUM_BLOCKS(MYO_CODEC_MAX_SAMPLES) * MYO_CODEC_BLOCK)
+
+struct MyoRecorder {
+	FILE *file;
+	int num_emg;
+	int num_imu;
+	uint64_t emg_timestamp;
+	uint64_t imu_timestamp;
+	int16_t emg[MYO_CODEC_MAX_SAMPLES][MYO_CODEC_EMG_CHANNELS];
+	myohw_imu_data_t imu[MYO_CODEC_MAX_SAMPLES];
+	uint8_t buf[];
+};
+
+static inline uint32_t zigzag(int32_t value) {
+	return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+	return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static void put_le16(uint8_t *out, uint16_t value) {
+	out[0] = value & 0xff;
+	out[1] = value >> 8;
+}
+
+static uint16_t get_le16(const uint8_t *in) {
+	return in[0] | (uint16_t) in[1] << 8;
+}
+
+static void put_le32(uint8_t *out, uint32_t value) {
+	put_le16(out, value & 0xffff);
+	put_le16(out + 2, value >> 16);
+}
+
+static uint32_t get_le32(const uint8_t *in) {
+	return get_le16(in) | (uint32_t) get_le16(in + 2) << 16;
+}
+
+static void put_le64(uint8_t *out, uint64_t value) {
+	put_le32(out, value & 0xffffffff);
+	put_le32(out + 4, value >> 32);
+}
+
+static uint64_t get_le64(const uint8_t *in) {
+	return get_le32(in) | (uint64_t) get_le32(in + 4) << 32;
+}
+
+static void imu_to_channels(const myohw_imu_data_t *sample, int16_t *channels) {
+	channels[0] = sample->orientation.w;
+	channels[1] = sample->orientation.x;
+	channels[2] = sample->orientation.y;
+	channels[3] = sample->orientation.z;
+	memcpy(&channels[4], sample->accelerometer, sizeof(sample->accelerometer));
+	memcpy(&channels[7], sample->gyroscope, sizeof(sample->gyroscope));
+}
+
+static void channels_to_imu(const int16_t *channels, myohw_imu_data_t *sample) {
+	sample->orientation.w = channels[0];
+	sample->orientation.x = channels[1];
+	sample->orientation.y = channels[2];
+	sample->orientation.z = channels[3];
+	memcpy(sample->accelerometer, &channels[4], sizeof(sample->accelerometer));
+	memcpy(sample->gyroscope, &channels[7], sizeof(sample->gyroscope));
+}
+
+//Writes each block as a width byte followed by the packed values, the
+//residuals must be zero padded to a whole block
+static uint8_t* pack_residuals(const uint32_t *residuals, int num, uint8_t *out) {
+	uint64_t acc;
+	uint32_t max;
+	int b, i, width, bits;
+
+	for(b = 0; b < NUM_BLOCKS(num); b++, residuals += MYO_CODEC_BLOCK) {
+		max = 0;
+		for(i = 0; i < MYO_CODEC_BLOCK; i++) {
+			max |= residuals[i];
+		}
+		width = max ? 32 - __builtin_clz(max) : 0;
+		*out++ = width;
+
+		acc = 0;
+		bits = 0;
+		for(i = 0; i < MYO_CODEC_BLOCK; i++) {
+			acc |= (uint64_t) residuals[i] << bits;
+			for(bits += width; bits >= 8; bits -= 8) {
+				*out++ = acc & 0xff;
+				acc >>= 8;
+			}
+		}
+	}
+
+	return out;
+}
+
+//Returns the end of the packed data, or NULL when it runs past end
+static const uint8_t* unpack_residuals(const uint8_t *in, const uint8_t *end, int num,
+		uint32_t *residuals) {
+	//a whole block plus room for the last 8 byte load
+	uint8_t block[BLOCK_BYTES(MAX_WIDTH) + 8];
+	uint64_t word, mask;
+	int b, i, width, pos;
+
+	for(b = 0; b < NUM_BLOCKS(num); b++, residuals += MYO_CODEC_BLOCK) {
+		if(in >= end || *in > MAX_WIDTH || end - in - 1 < BLOCK_BYTES(*in)) {
+			return NULL;
+		}
+		width = *in++;
+		mask = (UINT64_C(1) << width) - 1;
+
+		memcpy(block, in, BLOCK_BYTES(width));
+		memset(block + BLOCK_BYTES(width), 0, sizeof(block) - BLOCK_BYTES(width));
+		in += BLOCK_BYTES(width);
+
+		//no dependency between lanes, so this vectorizes
+		for(i = 0; i < MYO_CODEC_BLOCK; i++) {
+			pos = i * width;
+			memcpy(&word, &block[pos >> 3], sizeof(word));
+			residuals[i] = (le64toh(word) >> (pos & 7)) & mask;
+		}
+	}
+
+	return in;
+}
+
+static uint8_t* put_header(myo_codec_stream_t stream, int num_samples, uint64_t timestamp,
+		uint8_t *out) {
+	memcpy(out, MYO_CODEC_MAGIC, 4);
+	out[4] = stream;
+	out[5] = MYO_CODEC_VERSION;
+	put_le16(out + 6, num_samples);
+	//size is filled in once the payload is written
+	put_le32(out + 8, 0);
+	put_le32(out + 12, 0);
+	put_le64(out + 16, timestamp);
+	return out + MYO_CODEC_HEADER_SIZE;
+}
+
+static int finish_chunk(uint8_t *chunk, const uint8_t *end) {
+	put_le32(chunk + 8, end - chunk - MYO_CODEC_HEADER_SIZE);
+	return end - chunk;
+}
+
+size_t myo_codec_max_size(myo_codec_stream_t stream, int num_samples) {
+	size_t channels = stream == MYO_CODEC_EMG ? MYO_CODEC_EMG_CHANNELS : MYO_CODEC_IMU_CHANNELS;
+	size_t size = MYO_CODEC_HEADER_SIZE;
+
+	//first samples verbatim, a predictor byte per IMU channel, worst case blocks
+	size += stream == MYO_CODEC_EMG ? channels * sizeof(int16_t) :
+			2 * channels * sizeof(int16_t) + channels;
+	size += channels * NUM_BLOCKS(num_samples) * (1 + BLOCK_BYTES(MAX_WIDTH));
+
+	return size;
+}
+
+//EMG: first sample verbatim, then per channel zigzag deltas
+int myo_codec_encode_emg(const int16_t (*samples)[MYO_CODEC_EMG_CHANNELS], int num_samples,
+		uint64_t timestamp, uint8_t *out) {
+	uint32_t residuals[MAX_RESIDUALS];
+	uint8_t *chunk = out;
+	int c, n;
+
+	if(num_samples < 1 || num_samples > MYO_CODEC_MAX_SAMPLES) {
+		return -1;
+	}
+
+	out = put_header(MYO_CODEC_EMG, num_samples, timestamp, out);
+	for(c = 0; c < MYO_CODEC_EMG_CHANNELS; c++) {
+		put_le16(out, samples[0][c]);
+		out += sizeof(int16_t);
+	}
+
+	for(c = 0; c < MYO_CODEC_EMG_CHANNELS; c++) {
+		memset(residuals, 0, sizeof(residuals));
+		for(n = 1; n < num_samples; n++) {
+			residuals[n - 1] = zigzag((int32_t) samples[n][c] - samples[n - 1][c]);
+		}
+		out = pack_residuals(residuals, num_samples - 1, out);
+	}
+
+	return finish_chunk(chunk, out);
+}
+
+//IMU: first two samples verbatim, then per channel the residuals of whichever
+//of a constant or linear predictor does better on this chunk
+int myo_codec_encode_imu(const myohw_imu_data_t *samples, int num_samples, uint64_t timestamp,
+		uint8_t *out) {
+	int16_t channels[MYO_CODEC_MAX_SAMPLES][MYO_CODEC_IMU_CHANNELS];
+	uint32_t residuals[2][MAX_RESIDUALS];
+	uint64_t cost[2];
+	uint8_t *chunk = out;
+	int c, n, i, order;
+	int32_t x;
+
+	if(num_samples < 1 || num_samples > MYO_CODEC_MAX_SAMPLES) {
+		return -1;
+	}
+
+	for(n = 0; n < num_samples; n++) {
+		imu_to_channels(&samples[n], channels[n]);
+	}
+
+	out = put_header(MYO_CODEC_IMU, num_samples, timestamp, out);
+	for(n = 0; n < MIN(num_samples, 2); n++) {
+		for(c = 0; c < MYO_CODEC_IMU_CHANNELS; c++) {
+			put_le16(out, channels[n][c]);
+			out += sizeof(int16_t);
+		}
+	}
+
+	for(c = 0; c < MYO_CODEC_IMU_CHANNELS; c++) {
+		memset(residuals, 0, sizeof(residuals));
+		cost[0] = cost[1] = 0;
+		for(n = 2; n < num_samples; n++) {
+			x = channels[n][c];
+			residuals[0][n - 2] = zigzag(x - channels[n - 1][c]);
+			residuals[1][n - 2] = zigzag(x - (2 * channels[n - 1][c] - channels[n - 2][c]));
+			for(i = 0; i < 2; i++) {
+				cost[i] += residuals[i][n - 2];
+			}
+		}
+
+		order = cost[1] < cost[0] ? 1 : 0;
+		*out++ = order;
+		out = pack_residuals(residuals[order], num_samples - 2, out);
+	}
+
+	return finish_chunk(chunk, out);
+}
+
+int myo_codec_chunk_info(const uint8_t *buf, size_t len, MyoCodecHeader *header) {
+	MyoCodecHeader tmp;
+
+	if(header == NULL) {
+		header = &tmp;
+	}
+
+	if(len < MYO_CODEC_HEADER_SIZE || memcmp(buf, MYO_CODEC_MAGIC, 4) != 0) {
+		return -1;
+	}
+
+	memcpy(header->magic, buf, 4);
+	header->stream = buf[4];
+	header->version = buf[5];
+	header->num_samples = get_le16(buf + 6);
+	header->size = get_le32(buf + 8);
+	header->reserved = get_le32(buf + 12);
+	header->timestamp = get_le64(buf + 16);
+
+	if(header->version != MYO_CODEC_VERSION || header->num_samples < 1 ||
+			header->num_samples > MYO_CODEC_MAX_SAMPLES ||
+			header->size > len - MYO_CODEC_HEADER_SIZE) {
+		return -1;
+	}
+
+	return MYO_CODEC_HEADER_SIZE + header->size;
+}
+
+int myo_codec_decode_emg(const uint8_t *buf, size_t len,
+		int16_t (*samples)[MYO_CODEC_EMG_CHANNELS], int max_samples) {
+	MyoCodecHeader header;
+	uint32_t residuals[MAX_RESIDUALS];
+	const uint8_t *in, *end;
+	int c, n, size;
+
+	size = myo_codec_chunk_info(buf, len, &header);
+	if(size < 0 || header.stream != MYO_CODEC_EMG || header.num_samples > max_samples ||
+			header.size < MYO_CODEC_EMG_CHANNELS * sizeof(int16_t)) {
+		return -1;
+	}
+
+	in = buf + MYO_CODEC_HEADER_SIZE;
+	end = buf + size;
+	for(c = 0; c < MYO_CODEC_EMG_CHANNELS; c++) {
+		samples[0][c] = get_le16(in);
+		in += sizeof(int16_t);
+	}
+
+	for(c = 0; c < MYO_CODEC_EMG_CHANNELS; c++) {
+		in = unpack_residuals(in, end, header.num_samples - 1, residuals);
+		if(in == NULL) {
+			return -1;
+		}
+		for(n = 1; n < header.num_samples; n++) {
+			samples[n][c] = samples[n - 1][c] + unzigzag(residuals[n - 1]);
+		}
+	}
+
+	return header.num_samples;
+}
+
+int myo_codec_decode_imu(const uint8_t *buf, size_t len, myohw_imu_data_t *samples,
+		int max_samples) {
+	int16_t channels[MYO_CODEC_MAX_SAMPLES][MYO_CODEC_IMU_CHANNELS];
+	MyoCodecHeader header;
+	uint32_t residuals[MAX_RESIDUALS];
+	const uint8_t *in, *end;
+	int c, n, order, size, verbatim;
+
+	size = myo_codec_chunk_info(buf, len, &header);
+	if(size < 0 || header.stream != MYO_CODEC_IMU || header.num_samples > max_samples) {
+		return -1;
+	}
+
+	verbatim = MIN(header.num_samples, 2);
+	if(header.size < verbatim * MYO_CODEC_IMU_CHANNELS * sizeof(int16_t)) {
+		return -1;
+	}
+
+	in = buf + MYO_CODEC_HEADER_SIZE;
+	end = buf + size;
+	for(n = 0; n < verbatim; n++) {
+		for(c = 0; c < MYO_CODEC_IMU_CHANNELS; c++) {
+			channels[n][c] = get_le16(in);
+			in += sizeof(int16_t);
+		}
+	}
+
+	for(c = 0; c < MYO_CODEC_IMU_CHANNELS; c++) {
+		if(in >= end || *in > 1) {
+			return -1;
+		}
+		order = *in++;
+		in = unpack_residuals(in, end, header.num_samples - 2, residuals);
+		if(in == NULL) {
+			return -1;
+		}
+		for(n = 2; n < header.num_samples; n++) {
+			channels[n][c] = unzigzag(residuals[n - 2]) + (order ?
+					2 * channels[n - 1][c] - channels[n - 2][c] : channels[n - 1][c]);
+		}
+	}
+
+	for(n = 0; n < header.num_samples; n++) {
+		channels_to_imu(channels[n], &samples[n]);
+	}
+
+	return header.num_samples;
+}
+
+MyoRecorder* myo_recorder_new(FILE *file) {
+	MyoRecorder *recorder;
+
+	recorder = calloc(1, sizeof(MyoRecorder) + MAX(
+			myo_codec_max_size(MYO_CODEC_EMG, MYO_CODEC_MAX_SAMPLES),
+			myo_codec_max_size(MYO_CODEC_IMU, MYO_CODEC_MAX_SAMPLES)));
+	if(recorder == NULL) {
+		return NULL;
+	}
+	recorder->file = file;
+
+	return recorder;
+}
+
+static int recorder_write(MyoRecorder *recorder, int size) {
+	if(size < 0 || fwrite(recorder->buf, 1, size, recorder->file) != (size_t) size) {
+		return -1;
+	}
+	return 0;
+}
+
+static int recorder_flush_emg(MyoRecorder *recorder) {
+	int ret = 0;
+
+	if(recorder->num_emg > 0) {
+		ret = recorder_write(recorder, myo_codec_encode_emg((const int16_t (*)[MYO_CODEC_EMG_CHANNELS]) recorder->emg,
+				recorder->num_emg, recorder->emg_timestamp, recorder->buf));
+		recorder->num_emg = 0;
+	}
+
+	return ret;
+}
+
+static int recorder_flush_imu(MyoRecorder *recorder) {
+	int ret = 0;
+
+	if(recorder->num_imu > 0) {
+		ret = recorder_write(recorder, myo_codec_encode_imu(recorder->imu, recorder->num_imu,
+				recorder->imu_timestamp, recorder->buf));
+		recorder->num_imu = 0;
+	}
+
+	return ret;
+}
+
+int myo_recorder_add_emg(MyoRecorder *recorder, const int16_t *sample, uint64_t timestamp) {
+	if(recorder->num_emg == 0) {
+		recorder->emg_timestamp = timestamp;
+	}
+
+	memcpy(recorder->emg[recorder->num_emg++], sample, sizeof(recorder->emg[0]));
+
+	if(recorder->num_emg == MYO_CODEC_MAX_SAMPLES) {
+		return recorder_flush_emg(recorder);
+	}
+	return 0;
+}
+
+int myo_recorder_add_imu(MyoRecorder *recorder, const myohw_imu_data_t *data, uint64_t timestamp) {
+	if(recorder->num_imu == 0) {
+		recorder->imu_timestamp = timestamp;
+	}
+
+	recorder->imu[recorder->num_imu++] = *data;
+
+	if(recorder->num_imu == MYO_CODEC_MAX_SAMPLES) {
+		return recorder_flush_imu(recorder);
+	}
+	return 0;
+}
+
+int myo_recorder_flush(MyoRecorder *recorder) {
+	int ret;
+
+	ret = recorder_flush_emg(recorder);
+	ret |= recorder_flush_imu(recorder);
+	if(fflush(recorder->file) != 0) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
+int myo_recorder_free(MyoRecorder *recorder) {
+	int ret;
+
+	if(recorder == NULL) {
+		return 0;
+	}
+
+	ret = myo_recorder_flush(recorder);
+	free(recorder);
+
+	return ret;
+}
@@ -0,0 +1,223 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "myo-bluez_codec.h"
+#include "myo-bluez_rate.h"
+
+//synthetic recording length when no file is given, a minute at the native rates
+#define SYNTH_EMG_SAMPLES (MYO_EMG_RATE * 60)
+#define SYNTH_IMU_SAMPLES (MYO_IMU_RATE * 60)
+#define DECODE_ROUNDS 50
+
+typedef struct {
+	int16_t (*emg)[MYO_CODEC_EMG_CHANNELS];
+	int num_emg;
+	myohw_imu_data_t *imu;
+	int num_imu;
+} Samples;
+
+static double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double noise() {
+	return (rand() / (double) RAND_MAX - 0.5) * 2.0;
+}
+
+//bursts of muscle activity over a small noise floor, and a slow rotation
+static void synthesize(Samples *samples) {
+	double t, activity, angle;
+	int n, c;
+
+	samples->num_emg = SYNTH_EMG_SAMPLES;
+	samples->emg = calloc(samples->num_emg, sizeof(*samples->emg));
+	for(n = 0; n < samples->num_emg; n++) {
+		t = n / (double) MYO_EMG_RATE;
+		activity = sin(t * 0.8) > 0.3 ? 400.0 : 30.0;
+		for(c = 0; c < MYO_CODEC_EMG_CHANNELS; c++) {
+			samples->emg[n][c] = (int16_t) (activity * (0.5 + 0.5 * sin(c + t * 0.3)) * noise());
+		}
+	}
+
+	samples->num_imu = SYNTH_IMU_SAMPLES;
+	samples->imu = calloc(samples->num_imu, sizeof(*samples->imu));
+	for(n = 0; n < samples->num_imu; n++) {
+		t = n / (double) MYO_IMU_RATE;
+		angle = sin(t * 0.5);
+		samples->imu[n].orientation.w = cos(angle / 2) * 16384;
+		samples->imu[n].orientation.x = 0;
+		samples->imu[n].orientation.y = 0;
+		samples->imu[n].orientation.z = sin(angle / 2) * 16384;
+		for(c = 0; c < 3; c++) {
+			samples->imu[n].accelerometer[c] = (c == 2 ? 2048 : 0) + 20 * noise();
+			samples->imu[n].gyroscope[c] = (c == 2 ? 0.25 * cos(t * 0.5) * 180 / M_PI * 16 : 0)
+					+ 8 * noise();
+		}
+	}
+}
+
+static int load(const char *path, Samples *samples) {
+	MyoCodecHeader header;
+	uint8_t *buf;
+	long len;
+	int pos, size, decoded;
+	FILE *file;
+
+	file = fopen(path, "rb");
+	if(file == NULL) {
+		perror(path);
+		return -1;
+	}
+	fseek(file, 0, SEEK_END);
+	len = ftell(file);
+	rewind(file);
+	buf = malloc(len);
+	if(fread(buf, 1, len, file) != (size_t) len) {
+		perror(path);
+		fclose(file);
+		free(buf);
+		return -1;
+	}
+	fclose(file);
+
+	memset(samples, 0, sizeof(Samples));
+	for(pos = 0; pos < len; pos += size) {
+		size = myo_codec_chunk_info(buf + pos, len - pos, &header);
+		if(size < 0) {
+			fprintf(stderr, "%s: bad chunk at %d\n", path, pos);
+			break;
+		}
+
+		if(header.stream == MYO_CODEC_EMG) {
+			samples->emg = realloc(samples->emg,
+					(samples->num_emg + header.num_samples) * sizeof(*samples->emg));
+			decoded = myo_codec_decode_emg(buf + pos, size, &samples->emg[samples->num_emg],
+					header.num_samples);
+		} else if(header.stream == MYO_CODEC_IMU) {
+			samples->imu = realloc(samples->imu,
+					(samples->num_imu + header.num_samples) * sizeof(*samples->imu));
+			decoded = myo_codec_decode_imu(buf + pos, size, &samples->imu[samples->num_imu],
+					header.num_samples);
+		} else {
+			decoded = header.num_samples;
+		}
+		if(decoded != header.num_samples) {
+			fprintf(stderr, "%s: decoding the chunk at %d failed\n", path, pos);
+			break;
+		}
+		if(header.stream == MYO_CODEC_EMG) {
+			samples->num_emg += decoded;
+		} else if(header.stream == MYO_CODEC_IMU) {
+			samples->num_imu += decoded;
+		}
+	}
+
+	if(pos < len) {
+		free(buf);
+		free(samples->emg);
+		free(samples->imu);
+		return -1;
+	}
+
+	free(buf);
+	return 0;
+}
+
+//Encodes the stream into chunks, checks the round trip and times decoding
+static int bench(const char *name, myo_codec_stream_t stream, const void *data, int num_samples,
+		size_t sample_size) {
+	uint8_t *encoded, *decoded;
+	size_t max, total = 0;
+	double start, elapsed;
+	int n, chunk, round, size, ret = 0;
+
+	if(num_samples == 0) {
+		printf("%s: no samples\n", name);
+		return 0;
+	}
+
+	max = myo_codec_max_size(stream, MYO_CODEC_MAX_SAMPLES);
+	encoded = malloc((num_samples / MYO_CODEC_MAX_SAMPLES + 1) * max);
+	decoded = malloc(num_samples * sample_size);
+
+	for(n = 0; n < num_samples; n += chunk) {
+		chunk = num_samples - n < MYO_CODEC_MAX_SAMPLES ? num_samples - n : MYO_CODEC_MAX_SAMPLES;
+		if(stream == MYO_CODEC_EMG) {
+			size = myo_codec_encode_emg((const int16_t (*)[MYO_CODEC_EMG_CHANNELS]) data + n,
+					chunk, 0, encoded + total);
+		} else {
+			size = myo_codec_encode_imu((const myohw_imu_data_t*) data + n, chunk, 0,
+					encoded + total);
+		}
+		total += size;
+	}
+
+	start = now();
+	for(round = 0; round < DECODE_ROUNDS && ret == 0; round++) {
+		for(n = 0, size = 0; n < num_samples; n += chunk) {
+			if(stream == MYO_CODEC_EMG) {
+				chunk = myo_codec_decode_emg(encoded + size, total - size,
+						(int16_t (*)[MYO_CODEC_EMG_CHANNELS]) decoded + n, num_samples - n);
+			} else {
+				chunk = myo_codec_decode_imu(encoded + size, total - size,
+						(myohw_imu_data_t*) decoded + n, num_samples - n);
+			}
+			if(chunk < 0) {
+				fprintf(stderr, "%s: decoding failed\n", name);
+				ret = -1;
+				break;
+			}
+			size += myo_codec_chunk_info(encoded + size, total - size, NULL);
+		}
+	}
+	elapsed = now() - start;
+
+	if(ret == 0 && memcmp(data, decoded, num_samples * sample_size) != 0) {
+		fprintf(stderr, "%s: round trip mismatch\n", name);
+		ret = -1;
+	}
+
+	if(ret == 0) {
+		printf("%s: %d samples, %zu -> %zu bytes, ratio %.2f, decode %.1f MB/s, %.1f Msamples/s\n",
+				name, num_samples, num_samples * sample_size, total,
+				(double) (num_samples * sample_size) / total,
+				num_samples * sample_size * DECODE_ROUNDS / elapsed / 1e6,
+				num_samples * (double) DECODE_ROUNDS / elapsed / 1e6);
+	}
+
+	free(encoded);
+	free(decoded);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	Samples samples;
+	int ret;
+
+	if(argc > 2) {
+		fprintf(stderr, "Usage: %s [recording]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc == 2) {
+		if(load(argv[1], &samples) != 0) {
+			return 1;
+		}
+	} else {
+		synthesize(&samples);
+	}
+
+	ret = bench("emg", MYO_CODEC_EMG, samples.emg, samples.num_emg, sizeof(*samples.emg));
+	ret |= bench("imu", MYO_CODEC_IMU, samples.imu, samples.num_imu, sizeof(*samples.imu));
+
+	free(samples.emg);
+	free(samples.imu);
+
+	return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <math.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_decimate.h"
+
+int myo_decimator_factor(unsigned int native_rate, unsigned int rate) {
+	if(rate == 0 || rate > native_rate || native_rate % rate != 0) {
+		return 0;
+	}
+	if(native_rate / rate > MYO_DECIMATE_MAX_FACTOR) {
+		return 0;
+	}
+	return (int) (native_rate / rate);
+}
+
+void myo_decimator_init(MyoDecimator *decimator, int factor, int channels) {
+	double cutoff, x, window, sum = 0.0;
+	int i, mid;
+
+	memset(decimator, 0, sizeof(MyoDecimator));
+	decimator->factor = CLAMP(factor, 1, MYO_DECIMATE_MAX_FACTOR);
+	decimator->channels = CLAMP(channels, 1, MYO_DECIMATE_MAX_CHANNELS);
+
+	if(decimator->factor == 1) {
+		decimator->num_taps = 1;
+		decimator->taps[0] = 1.0f;
+		return;
+	}
+
+	//cut off at the new Nyquist frequency, Hamming windowed
+	decimator->num_taps = decimator->factor * MYO_DECIMATE_TAPS_PER_PHASE + 1;
+	cutoff = 0.5 / decimator->factor;
+	mid = decimator->num_taps / 2;
+	for(i = 0; i < decimator->num_taps; i++) {
+		x = i - mid;
+		window = 0.54 - 0.46 * cos(2.0 * M_PI * i / (decimator->num_taps - 1));
+		decimator->taps[i] = (float) (window *
+				(x == 0 ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x)));
+		sum += decimator->taps[i];
+	}
+
+	//unity gain at DC
+	for(i = 0; i < decimator->num_taps; i++) {
+		decimator->taps[i] /= sum;
+	}
+}
+
+bool myo_decimator_push(MyoDecimator *decimator, const float *in, float *out) {
+	const float *window;
+	float acc;
+	int c, i, n = decimator->num_taps;
+
+	for(c = 0; c < decimator->channels; c++) {
+		decimator->history[c][decimator->pos] = in[c];
+		decimator->history[c][decimator->pos + n] = in[c];
+	}
+	decimator->pos = (decimator->pos + 1) % n;
+
+	if(++decimator->phase < decimator->factor) {
+		return false;
+	}
+	decimator->phase = 0;
+
+	//oldest to newest, the taps are symmetric
+	for(c = 0; c < decimator->channels; c++) {
+		window = &decimator->history[c][decimator->pos];
+		acc = 0.0f;
+		for(i = 0; i < n; i++) {
+			acc += decimator->taps[i] * window[i];
+		}
+		out[c] = acc;
+	}
+
+	return true;
+}
@@ -0,0 +1,48 @@
+#include "myo-bluez.h"
+#include "myo-bluez_event.h"
+
+void myo_event_queue_init(MyoEventQueue *queue) {
+	memset(queue, 0, sizeof(MyoEventQueue));
+	g_mutex_init(&queue->lock);
+}
+
+void myo_event_queue_clear(MyoEventQueue *queue) {
+	g_mutex_clear(&queue->lock);
+}
+
+void myo_event_queue_push(MyoEventQueue *queue, const MyoEvent *event) {
+	g_mutex_lock(&queue->lock);
+
+	if(queue->count == MYO_EVENT_QUEUE_SIZE) {
+		queue->head = (queue->head + 1) % MYO_EVENT_QUEUE_SIZE;
+		queue->count--;
+		queue->dropped++;
+	}
+	queue->events[(queue->head + queue->count) % MYO_EVENT_QUEUE_SIZE] = *event;
+	queue->count++;
+
+	g_mutex_unlock(&queue->lock);
+}
+
+int myo_event_queue_drain(MyoEventQueue *queue, MyoEvent *events, int max, unsigned int *dropped) {
+	int n, run;
+
+	g_mutex_lock(&queue->lock);
+
+	n = CLAMP(max, 0, queue->count);
+	//at most two runs, split where the ring wraps
+	run = MIN(n, MYO_EVENT_QUEUE_SIZE - queue->head);
+	memcpy(events, &queue->events[queue->head], run * sizeof(MyoEvent));
+	memcpy(&events[run], queue->events, (n - run) * sizeof(MyoEvent));
+	queue->head = (queue->head + n) % MYO_EVENT_QUEUE_SIZE;
+	queue->count -= n;
+
+	if(dropped != NULL) {
+		*dropped = queue->dropped;
+		queue->dropped = 0;
+	}
+
+	g_mutex_unlock(&queue->lock);
+
+	return n;
+}
@@ -0,0 +1,167 @@
+#include <math.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_fuse.h"
+
+void myo_fuse_init(MyoFuse *fuse) {
+	memset(fuse, 0, sizeof(MyoFuse));
+}
+
+void myo_fuse_slerp(const float *a, const float *b, float t, float *out) {
+	float dot = 0.0f, sign = 1.0f, theta, wa, wb, norm = 0.0f;
+	int i;
+
+	for(i = 0; i < 4; i++) {
+		dot += a[i] * b[i];
+	}
+	//q and -q are the same rotation, go the short way round
+	if(dot < 0.0f) {
+		dot = -dot;
+		sign = -1.0f;
+	}
+
+	if(dot > 0.9995f) {
+		//nearly parallel, lerp is as good and does not divide by ~0
+		wa = 1.0f - t;
+		wb = t;
+	} else {
+		theta = acosf(dot);
+		wa = sinf((1.0f - t) * theta) / sinf(theta);
+		wb = sinf(t * theta) / sinf(theta);
+	}
+
+	for(i = 0; i < 4; i++) {
+		out[i] = wa * a[i] + sign * wb * b[i];
+		norm += out[i] * out[i];
+	}
+	norm = sqrtf(norm);
+	for(i = 0; i < 4 && norm > 0.0f; i++) {
+		out[i] /= norm;
+	}
+}
+
+static void fuse_set_imu(MyoFusedFrame *frame, const MyoFuseImu *imu, myo_fuse_imu_t kind) {
+	frame->imu = kind;
+	memcpy(frame->orientation, imu->orientation, sizeof(frame->orientation));
+	memcpy(frame->accelerometer, imu->accelerometer, sizeof(frame->accelerometer));
+	memcpy(frame->gyroscope, imu->gyroscope, sizeof(frame->gyroscope));
+}
+
+//Fills in the IMU part from the two IMU samples at hand
+static void fuse_resolve(MyoFuse *fuse, MyoFusedFrame *frame) {
+	const MyoFuseImu *prev = &fuse->prev, *next = &fuse->next;
+	float t;
+	int i;
+
+	if(fuse->num_imu == 0) {
+		frame->imu = MYO_FUSE_NO_IMU;
+		memset(frame->orientation, 0, sizeof(frame->orientation));
+		memset(frame->accelerometer, 0, sizeof(frame->accelerometer));
+		memset(frame->gyroscope, 0, sizeof(frame->gyroscope));
+		return;
+	}
+
+	if(fuse->num_imu == 1 || frame->timestamp >= next->timestamp) {
+		fuse_set_imu(frame, next, MYO_FUSE_HELD);
+		return;
+	}
+	if(frame->timestamp <= prev->timestamp) {
+		fuse_set_imu(frame, prev, MYO_FUSE_HELD);
+		return;
+	}
+	if(next->timestamp - prev->timestamp > MYO_FUSE_MAX_GAP_US) {
+		fuse_set_imu(frame, frame->timestamp - prev->timestamp <
+				next->timestamp - frame->timestamp ? prev : next, MYO_FUSE_HELD);
+		return;
+	}
+
+	t = (float) (frame->timestamp - prev->timestamp) / (next->timestamp - prev->timestamp);
+	frame->imu = MYO_FUSE_INTERPOLATED;
+	myo_fuse_slerp(prev->orientation, next->orientation, t, frame->orientation);
+	for(i = 0; i < 3; i++) {
+		frame->accelerometer[i] = prev->accelerometer[i] +
+				t * (next->accelerometer[i] - prev->accelerometer[i]);
+		frame->gyroscope[i] = prev->gyroscope[i] + t * (next->gyroscope[i] - prev->gyroscope[i]);
+	}
+}
+
+static void fuse_pop(MyoFuse *fuse, MyoFusedFrame *out) {
+	*out = fuse->pending[fuse->head];
+	fuse_resolve(fuse, out);
+	fuse->head = (fuse->head + 1) % MYO_FUSE_MAX_PENDING;
+	fuse->num_pending--;
+}
+
+//Lets out what waited too long as of now
+static int fuse_expire(MyoFuse *fuse, int64_t now, MyoFusedFrame *out) {
+	int n = 0;
+
+	while(fuse->num_pending > 0 &&
+			now - fuse->pending[fuse->head].timestamp > MYO_FUSE_MAX_LATENCY_US) {
+		fuse_pop(fuse, &out[n++]);
+	}
+
+	return n;
+}
+
+int myo_fuse_push_emg(MyoFuse *fuse, const int16_t *emg, int64_t timestamp, MyoFusedFrame *out) {
+	MyoFusedFrame *frame;
+	int n;
+
+	n = fuse_expire(fuse, timestamp, out);
+
+	//already covered by the IMU and nothing older waiting
+	if(fuse->num_pending == 0 && fuse->num_imu > 0 && timestamp <= fuse->next.timestamp) {
+		frame = &out[n++];
+		frame->timestamp = timestamp;
+		memcpy(frame->emg, emg, sizeof(frame->emg));
+		fuse_resolve(fuse, frame);
+		return n;
+	}
+
+	if(fuse->num_pending == MYO_FUSE_MAX_PENDING) {
+		fuse_pop(fuse, &out[n++]);
+	}
+
+	frame = &fuse->pending[(fuse->head + fuse->num_pending) % MYO_FUSE_MAX_PENDING];
+	frame->timestamp = timestamp;
+	memcpy(frame->emg, emg, sizeof(frame->emg));
+	fuse->num_pending++;
+
+	return n;
+}
+
+int myo_fuse_push_imu(MyoFuse *fuse, const myohw_imu_data_t *data, int64_t timestamp,
+		MyoFusedFrame *out) {
+	MyoFuseImu *imu;
+	float norm = 0.0f;
+	int i, n = 0;
+
+	fuse->prev = fuse->next;
+	fuse->num_imu = MIN(fuse->num_imu + 1, 2);
+
+	imu = &fuse->next;
+	imu->timestamp = timestamp;
+	imu->orientation[0] = data->orientation.w;
+	imu->orientation[1] = data->orientation.x;
+	imu->orientation[2] = data->orientation.y;
+	imu->orientation[3] = data->orientation.z;
+	for(i = 0; i < 4; i++) {
+		norm += imu->orientation[i] * imu->orientation[i];
+	}
+	norm = sqrtf(norm);
+	for(i = 0; i < 4; i++) {
+		imu->orientation[i] = norm > 0.0f ? imu->orientation[i] / norm : (i == 0);
+	}
+	for(i = 0; i < 3; i++) {
+		imu->accelerometer[i] = data->accelerometer[i] / MYOHW_ACCELEROMETER_SCALE;
+		imu->gyroscope[i] = data->gyroscope[i] / MYOHW_GYROSCOPE_SCALE;
+	}
+
+	while(fuse->num_pending > 0 && fuse->pending[fuse->head].timestamp <= timestamp) {
+		fuse_pop(fuse, &out[n++]);
+	}
+	n += fuse_expire(fuse, timestamp, &out[n]);
+
+	return n;
+}
@@ -0,0 +1,506 @@
+#include <math.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_gesture.h"
+
+#define MODEL_GROUP "Model"
+#define CLASS_GROUP "Class%d"
+
+//added to the pooled covariance so channels that never move do not make it
+//singular, features are normalized so this is relative to unit variance
+#define LDA_SHRINKAGE 0.01
+
+struct MyoGestureTrainer {
+	MyoGestureWindow window;
+	int stride;
+	int since_last;
+	myohw_pose_t pose;
+
+	//MYO_GESTURE_FEATURES floats per window
+	GArray *features;
+	GArray *labels;
+};
+
+int myo_gesture_ms_to_samples(unsigned int ms) {
+	return (int) ((ms * MYO_EMG_RATE + 500) / 1000);
+}
+
+void myo_gesture_window_init(MyoGestureWindow *window, int samples) {
+	window->window = CLAMP(samples, MYO_GESTURE_MIN_WINDOW, MYO_GESTURE_MAX_WINDOW);
+	myo_gesture_window_reset(window);
+}
+
+void myo_gesture_window_reset(MyoGestureWindow *window) {
+	window->head = 0;
+	window->count = 0;
+	memset(window->abs_sum, 0, sizeof(window->abs_sum));
+	memset(window->length, 0, sizeof(window->length));
+	memset(window->crossings, 0, sizeof(window->crossings));
+	memset(window->slope_changes, 0, sizeof(window->slope_changes));
+}
+
+static inline int crossing(int a, int b) {
+	return ((a < 0 && b > 0) || (a > 0 && b < 0)) && abs(a - b) >= MYO_GESTURE_THRESHOLD;
+}
+
+static inline int slope_change(int a, int b, int c) {
+	return ((b > a && b > c) || (b < a && b < c)) &&
+			(abs(b - a) >= MYO_GESTURE_THRESHOLD || abs(b - c) >= MYO_GESTURE_THRESHOLD);
+}
+
+void myo_gesture_window_push(MyoGestureWindow *window, const int16_t *sample) {
+	const int16_t *o0, *o1, *o2, *prev, *prev2;
+	int i, size = window->window;
+
+	//drop what the oldest sample contributed
+	if(window->count == size) {
+		o0 = window->samples[window->head];
+		o1 = window->samples[(window->head + 1) % size];
+		o2 = window->samples[(window->head + 2) % size];
+		for(i = 0; i < MYO_GESTURE_CHANNELS; i++) {
+			window->abs_sum[i] -= abs(o0[i]);
+			window->length[i] -= abs(o1[i] - o0[i]);
+			window->crossings[i] -= crossing(o0[i], o1[i]);
+			window->slope_changes[i] -= slope_change(o0[i], o1[i], o2[i]);
+		}
+		window->head = (window->head + 1) % size;
+		window->count--;
+	}
+
+	prev = window->count >= 1 ?
+			window->samples[(window->head + window->count - 1) % size] : NULL;
+	prev2 = window->count >= 2 ?
+			window->samples[(window->head + window->count - 2) % size] : NULL;
+
+	for(i = 0; i < MYO_GESTURE_CHANNELS; i++) {
+		window->abs_sum[i] += abs(sample[i]);
+		if(prev != NULL) {
+			window->length[i] += abs(sample[i] - prev[i]);
+			window->crossings[i] += crossing(prev[i], sample[i]);
+		}
+		if(prev2 != NULL) {
+			window->slope_changes[i] += slope_change(prev2[i], prev[i], sample[i]);
+		}
+	}
+
+	memcpy(window->samples[(window->head + window->count) % size], sample,
+			sizeof(window->samples[0]));
+	window->count++;
+}
+
+bool myo_gesture_window_full(const MyoGestureWindow *window) {
+	return window->count == window->window;
+}
+
+void myo_gesture_window_features(const MyoGestureWindow *window, float *features) {
+	float n, pairs, triples;
+	int i;
+
+	n = (float) window->count;
+	pairs = MAX(n - 1.0f, 1.0f);
+	triples = MAX(n - 2.0f, 1.0f);
+
+	for(i = 0; i < MYO_GESTURE_CHANNELS; i++) {
+		features[i * MYO_GESTURE_CHANNEL_FEATURES + 0] = window->abs_sum[i] / n;
+		features[i * MYO_GESTURE_CHANNEL_FEATURES + 1] = window->length[i] / pairs;
+		features[i * MYO_GESTURE_CHANNEL_FEATURES + 2] = window->crossings[i] / pairs;
+		features[i * MYO_GESTURE_CHANNEL_FEATURES + 3] = window->slope_changes[i] / triples;
+	}
+}
+
+myohw_pose_t myo_gesture_classify(const MyoGestureModel *model, const float *features) {
+	float x[MYO_GESTURE_FEATURES];
+	float score, best_score = -INFINITY;
+	int i, c, best = 0;
+
+	for(i = 0; i < MYO_GESTURE_FEATURES; i++) {
+		x[i] = (features[i] - model->mean[i]) * model->scale[i];
+	}
+
+	for(c = 0; c < model->num_classes; c++) {
+		score = model->bias[c];
+		for(i = 0; i < MYO_GESTURE_FEATURES; i++) {
+			score += model->weights[c][i] * x[i];
+		}
+		if(score > best_score) {
+			best_score = score;
+			best = c;
+		}
+	}
+
+	return model->num_classes > 0 ? model->poses[best] : myohw_pose_unknown;
+}
+
+MyoGesture* myo_gesture_new(const MyoGestureModel *model, unsigned int window_ms,
+		unsigned int stride_ms)
+{
+	MyoGesture *gesture;
+
+	if(model->num_classes < 1 || model->num_classes > MYO_GESTURE_MAX_CLASSES) {
+		return NULL;
+	}
+
+	gesture = calloc(1, sizeof(MyoGesture));
+	if(gesture == NULL) {
+		return NULL;
+	}
+
+	gesture->model = *model;
+	myo_gesture_window_init(&gesture->window, myo_gesture_ms_to_samples(window_ms));
+	gesture->stride = MAX(myo_gesture_ms_to_samples(stride_ms), 1);
+	gesture->pose = myohw_pose_unknown;
+
+	return gesture;
+}
+
+void myo_gesture_free(MyoGesture *gesture) {
+	free(gesture);
+}
+
+bool myo_gesture_push(MyoGesture *gesture, const int16_t *sample, myohw_pose_t *pose) {
+	float features[MYO_GESTURE_FEATURES];
+	myohw_pose_t current;
+
+	myo_gesture_window_push(&gesture->window, sample);
+	if(!myo_gesture_window_full(&gesture->window)) {
+		return false;
+	}
+	if(++gesture->since_last < gesture->stride) {
+		return false;
+	}
+	gesture->since_last = 0;
+
+	myo_gesture_window_features(&gesture->window, features);
+	current = myo_gesture_classify(&gesture->model, features);
+	if(current == gesture->pose) {
+		return false;
+	}
+
+	gesture->pose = current;
+	*pose = current;
+	return true;
+}
+
+MyoGestureTrainer* myo_gesture_trainer_new(unsigned int window_ms, unsigned int stride_ms) {
+	MyoGestureTrainer *trainer;
+
+	trainer = calloc(1, sizeof(MyoGestureTrainer));
+	if(trainer == NULL) {
+		return NULL;
+	}
+
+	myo_gesture_window_init(&trainer->window, myo_gesture_ms_to_samples(window_ms));
+	trainer->stride = MAX(myo_gesture_ms_to_samples(stride_ms), 1);
+	trainer->pose = myohw_pose_unknown;
+	trainer->features = g_array_new(false, false, sizeof(float) * MYO_GESTURE_FEATURES);
+	trainer->labels = g_array_new(false, false, sizeof(myohw_pose_t));
+
+	return trainer;
+}
+
+void myo_gesture_trainer_free(MyoGestureTrainer *trainer) {
+	if(trainer == NULL) {
+		return;
+	}
+
+	g_array_free(trainer->features, true);
+	g_array_free(trainer->labels, true);
+	free(trainer);
+}
+
+void myo_gesture_trainer_split(MyoGestureTrainer *trainer) {
+	myo_gesture_window_reset(&trainer->window);
+	trainer->since_last = 0;
+	trainer->pose = myohw_pose_unknown;
+}
+
+void myo_gesture_trainer_add(MyoGestureTrainer *trainer, const int16_t *sample, myohw_pose_t pose) {
+	float features[MYO_GESTURE_FEATURES];
+
+	//never let a window straddle two labels
+	if(pose != trainer->pose) {
+		myo_gesture_trainer_split(trainer);
+		trainer->pose = pose;
+	}
+
+	myo_gesture_window_push(&trainer->window, sample);
+	if(!myo_gesture_window_full(&trainer->window) || ++trainer->since_last < trainer->stride) {
+		return;
+	}
+	trainer->since_last = 0;
+
+	myo_gesture_window_features(&trainer->window, features);
+	g_array_append_val(trainer->features, features);
+	g_array_append_val(trainer->labels, pose);
+}
+
+static int cholesky(double *a, int n) {
+	int i, j, k;
+	double sum;
+
+	for(j = 0; j < n; j++) {
+		sum = a[j * n + j];
+		for(k = 0; k < j; k++) {
+			sum -= a[j * n + k] * a[j * n + k];
+		}
+		if(sum <= 0.0) {
+			return MYOBLUEZ_ERROR;
+		}
+		a[j * n + j] = sqrt(sum);
+
+		for(i = j + 1; i < n; i++) {
+			sum = a[i * n + j];
+			for(k = 0; k < j; k++) {
+				sum -= a[i * n + k] * a[j * n + k];
+			}
+			a[i * n + j] = sum / a[j * n + j];
+		}
+	}
+
+	return MYOBLUEZ_OK;
+}
+
+//Solves L L^T x = b in place
+static void cholesky_solve(const double *l, int n, double *b) {
+	int i, k;
+
+	for(i = 0; i < n; i++) {
+		for(k = 0; k < i; k++) {
+			b[i] -= l[i * n + k] * b[k];
+		}
+		b[i] /= l[i * n + i];
+	}
+	for(i = n - 1; i >= 0; i--) {
+		for(k = i + 1; k < n; k++) {
+			b[i] -= l[k * n + i] * b[k];
+		}
+		b[i] /= l[i * n + i];
+	}
+}
+
+int myo_gesture_trainer_fit(MyoGestureTrainer *trainer, MyoGestureModel *model) {
+	static const int F = MYO_GESTURE_FEATURES;
+	double mean[MYO_GESTURE_FEATURES], scale[MYO_GESTURE_FEATURES];
+	double class_mean[MYO_GESTURE_MAX_CLASSES][MYO_GESTURE_FEATURES];
+	double cov[MYO_GESTURE_FEATURES * MYO_GESTURE_FEATURES];
+	double x[MYO_GESTURE_FEATURES], w[MYO_GESTURE_FEATURES], bias;
+	int counts[MYO_GESTURE_MAX_CLASSES];
+	int *classes;
+	const float *f;
+	myohw_pose_t pose;
+	guint n, s;
+	int c, i, j, num_classes = 0;
+
+	n = trainer->labels->len;
+	memset(model, 0, sizeof(MyoGestureModel));
+	memset(counts, 0, sizeof(counts));
+	memset(mean, 0, sizeof(mean));
+	memset(scale, 0, sizeof(scale));
+	memset(class_mean, 0, sizeof(class_mean));
+	memset(cov, 0, sizeof(cov));
+
+	classes = malloc(MAX(n, 1) * sizeof(int));
+	if(classes == NULL) {
+		return MYOBLUEZ_ERROR;
+	}
+
+	//map labels to classes in order of appearance
+	for(s = 0; s < n; s++) {
+		pose = g_array_index(trainer->labels, myohw_pose_t, s);
+		for(c = 0; c < num_classes && model->poses[c] != pose; c++);
+		if(c == num_classes) {
+			if(num_classes == MYO_GESTURE_MAX_CLASSES) {
+				debug("Too many gesture classes");
+				free(classes);
+				return MYOBLUEZ_ERROR;
+			}
+			model->poses[num_classes++] = pose;
+		}
+		classes[s] = c;
+		counts[c]++;
+	}
+
+	if(num_classes < 2 || n <= (guint) num_classes) {
+		debug("Not enough training windows, %u for %d classes", n, num_classes);
+		free(classes);
+		return MYOBLUEZ_ERROR;
+	}
+	model->num_classes = num_classes;
+
+	//normalization
+	for(s = 0; s < n; s++) {
+		f = &g_array_index(trainer->features, float, s * F);
+		for(i = 0; i < F; i++) {
+			mean[i] += f[i];
+			scale[i] += (double) f[i] * f[i];
+		}
+	}
+	for(i = 0; i < F; i++) {
+		mean[i] /= n;
+		scale[i] = sqrt(MAX(scale[i] / n - mean[i] * mean[i], 0.0));
+		scale[i] = scale[i] > 1e-6 ? 1.0 / scale[i] : 1.0;
+		model->mean[i] = (float) mean[i];
+		model->scale[i] = (float) scale[i];
+	}
+
+	for(s = 0; s < n; s++) {
+		f = &g_array_index(trainer->features, float, s * F);
+		for(i = 0; i < F; i++) {
+			class_mean[classes[s]][i] += (f[i] - mean[i]) * scale[i];
+		}
+	}
+	for(c = 0; c < num_classes; c++) {
+		for(i = 0; i < F; i++) {
+			class_mean[c][i] /= counts[c];
+		}
+	}
+
+	//pooled within class covariance
+	for(s = 0; s < n; s++) {
+		f = &g_array_index(trainer->features, float, s * F);
+		for(i = 0; i < F; i++) {
+			x[i] = (f[i] - mean[i]) * scale[i] - class_mean[classes[s]][i];
+		}
+		for(i = 0; i < F; i++) {
+			for(j = 0; j <= i; j++) {
+				cov[i * F + j] += x[i] * x[j];
+			}
+		}
+	}
+	for(i = 0; i < F; i++) {
+		for(j = 0; j <= i; j++) {
+			cov[i * F + j] /= (n - num_classes);
+			cov[j * F + i] = cov[i * F + j];
+		}
+		cov[i * F + i] += LDA_SHRINKAGE;
+	}
+	free(classes);
+
+	if(cholesky(cov, F) != MYOBLUEZ_OK) {
+		debug("Gesture covariance is not positive definite");
+		return MYOBLUEZ_ERROR;
+	}
+
+	for(c = 0; c < num_classes; c++) {
+		memcpy(w, class_mean[c], sizeof(w));
+		cholesky_solve(cov, F, w);
+
+		bias = log((double) counts[c] / n);
+		for(i = 0; i < F; i++) {
+			bias -= 0.5 * class_mean[c][i] * w[i];
+			model->weights[c][i] = (float) w[i];
+		}
+		model->bias[c] = (float) bias;
+	}
+
+	return MYOBLUEZ_OK;
+}
+
+static bool get_floats(GKeyFile *keyfile, const char *group, const char *key, float *out, gsize len) {
+	gdouble *values;
+	gsize i, got;
+
+	values = g_key_file_get_double_list(keyfile, group, key, &got, NULL);
+	if(values == NULL || got != len) {
+		g_free(values);
+		return false;
+	}
+
+	for(i = 0; i < len; i++) {
+		out[i] = (float) values[i];
+	}
+	g_free(values);
+	return true;
+}
+
+static void set_floats(GKeyFile *keyfile, const char *group, const char *key, const float *in, gsize len) {
+	gdouble values[MYO_GESTURE_FEATURES];
+	gsize i;
+
+	for(i = 0; i < len; i++) {
+		values[i] = in[i];
+	}
+	g_key_file_set_double_list(keyfile, group, key, values, len);
+}
+
+int myo_gesture_model_load(MyoGestureModel *model, const char *file) {
+	GKeyFile *keyfile;
+	GError *err = NULL;
+	gint *poses;
+	gsize num_poses;
+	char group[16];
+	float bias;
+	int c;
+
+	keyfile = g_key_file_new();
+	if(!g_key_file_load_from_file(keyfile, file, G_KEY_FILE_NONE, &err)) {
+		debug("Failed to load gesture model %s; %s", file, err->message);
+		g_clear_error(&err);
+		g_key_file_free(keyfile);
+		return MYOBLUEZ_ERROR;
+	}
+
+	memset(model, 0, sizeof(MyoGestureModel));
+
+	poses = g_key_file_get_integer_list(keyfile, MODEL_GROUP, "Poses", &num_poses, NULL);
+	if(poses == NULL || num_poses < 1 || num_poses > MYO_GESTURE_MAX_CLASSES ||
+			!get_floats(keyfile, MODEL_GROUP, "Mean", model->mean, MYO_GESTURE_FEATURES) ||
+			!get_floats(keyfile, MODEL_GROUP, "Scale", model->scale, MYO_GESTURE_FEATURES)) {
+		goto invalid;
+	}
+
+	model->num_classes = (int) num_poses;
+	for(c = 0; c < model->num_classes; c++) {
+		model->poses[c] = (myohw_pose_t) poses[c];
+
+		snprintf(group, sizeof(group), CLASS_GROUP, c);
+		if(!get_floats(keyfile, group, "Weights", model->weights[c], MYO_GESTURE_FEATURES) ||
+				!get_floats(keyfile, group, "Bias", &bias, 1)) {
+			goto invalid;
+		}
+		model->bias[c] = bias;
+	}
+
+	g_free(poses);
+	g_key_file_free(keyfile);
+	return MYOBLUEZ_OK;
+
+invalid:
+	debug("Invalid gesture model %s", file);
+	g_free(poses);
+	g_key_file_free(keyfile);
+	memset(model, 0, sizeof(MyoGestureModel));
+	return MYOBLUEZ_ERROR;
+}
+
+int myo_gesture_model_save(const MyoGestureModel *model, const char *file) {
+	GKeyFile *keyfile;
+	GError *err = NULL;
+	gint poses[MYO_GESTURE_MAX_CLASSES];
+	char group[16];
+	int c, ret = MYOBLUEZ_OK;
+
+	keyfile = g_key_file_new();
+
+	for(c = 0; c < model->num_classes; c++) {
+		poses[c] = model->poses[c];
+	}
+	g_key_file_set_integer_list(keyfile, MODEL_GROUP, "Poses", poses, model->num_classes);
+	set_floats(keyfile, MODEL_GROUP, "Mean", model->mean, MYO_GESTURE_FEATURES);
+	set_floats(keyfile, MODEL_GROUP, "Scale", model->scale, MYO_GESTURE_FEATURES);
+
+	for(c = 0; c < model->num_classes; c++) {
+		snprintf(group, sizeof(group), CLASS_GROUP, c);
+		set_floats(keyfile, group, "Weights", model->weights[c], MYO_GESTURE_FEATURES);
+		set_floats(keyfile, group, "Bias", &model->bias[c], 1);
+	}
+
+	if(!g_key_file_save_to_file(keyfile, file, &err)) {
+		debug("Failed to save gesture model %s; %s", file, err->message);
+		g_clear_error(&err);
+		ret = MYOBLUEZ_ERROR;
+	}
+
+	g_key_file_free(keyfile);
+	return ret;
+}
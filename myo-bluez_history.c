@@ -0,0 +1,206 @@
+#include "myo-bluez.h"
+#include "myo-bluez_history.h"
+
+void myo_history_init(MyoHistory *history, int channels, int64_t period_us) {
+	memset(history, 0, sizeof(MyoHistory));
+	history->channels = CLAMP(channels, 1, MYO_HISTORY_MAX_CHANNELS);
+	history->period_us = MAX(period_us, 1);
+}
+
+static void bucket_merge(MyoHistoryBucket *dst, const MyoHistoryBucket *src, int channels) {
+	int i;
+
+	if(dst->count == 0) {
+		dst->start = src->start;
+		for(i = 0; i < channels; i++) {
+			dst->min[i] = INT16_MAX;
+			dst->max[i] = INT16_MIN;
+		}
+	}
+	dst->count += src->count;
+	for(i = 0; i < channels; i++) {
+		dst->min[i] = MIN(dst->min[i], src->min[i]);
+		dst->max[i] = MAX(dst->max[i], src->max[i]);
+		dst->sum[i] += src->sum[i];
+	}
+}
+
+//Moves a level's open bucket into its ring and up into the next level's
+static void level_close(MyoHistory *history, int l) {
+	MyoHistoryLevel *level = &history->levels[l], *up = NULL;
+
+	level->buckets[level->head] = level->open;
+	level->head = (level->head + 1) % MYO_HISTORY_BUCKETS;
+	level->count = MIN(level->count + 1, MYO_HISTORY_BUCKETS);
+
+	if(l + 1 < MYO_HISTORY_LEVELS) {
+		up = &history->levels[l + 1];
+		bucket_merge(&up->open, &level->open, history->channels);
+		up->children++;
+	}
+	memset(&level->open, 0, sizeof(MyoHistoryBucket));
+	level->children = 0;
+
+	if(l + 1 < MYO_HISTORY_LEVELS && up->children == MYO_HISTORY_FANOUT) {
+		level_close(history, l + 1);
+	}
+}
+
+void myo_history_push(MyoHistory *history, const int16_t *sample, int64_t timestamp) {
+	MyoHistoryBucket one;
+	int i, l;
+
+	if(history->raw_count > 0 && timestamp - history->last > MYO_HISTORY_GAP_US) {
+		for(l = 0; l < MYO_HISTORY_LEVELS; l++) {
+			if(history->levels[l].children > 0) {
+				level_close(history, l);
+			}
+		}
+	}
+	history->last = timestamp;
+
+	memcpy(history->raw[history->raw_head], sample, history->channels * sizeof(int16_t));
+	history->raw_time[history->raw_head] = timestamp;
+	history->raw_head = (history->raw_head + 1) % MYO_HISTORY_RAW;
+	history->raw_count = MIN(history->raw_count + 1, MYO_HISTORY_RAW);
+
+	one.start = timestamp;
+	one.count = 1;
+	for(i = 0; i < history->channels; i++) {
+		one.min[i] = one.max[i] = one.sum[i] = sample[i];
+	}
+	bucket_merge(&history->levels[0].open, &one, history->channels);
+	if(++history->levels[0].children == MYO_HISTORY_FANOUT) {
+		level_close(history, 0);
+	}
+}
+
+//Start of the oldest sample or bucket a level still has, INT64_MAX if none
+static int64_t level_oldest(const MyoHistory *history, int level) {
+	const MyoHistoryLevel *l;
+
+	if(level == 0) {
+		if(history->raw_count == 0) {
+			return INT64_MAX;
+		}
+		return history->raw_time[(history->raw_head - history->raw_count + MYO_HISTORY_RAW) %
+				MYO_HISTORY_RAW];
+	}
+
+	l = &history->levels[level - 1];
+	if(l->count > 0) {
+		return l->buckets[(l->head - l->count + MYO_HISTORY_BUCKETS) % MYO_HISTORY_BUCKETS].start;
+	}
+	return l->open.count > 0 ? l->open.start : INT64_MAX;
+}
+
+static void point_merge(MyoHistoryPoint *points, const MyoHistoryBucket *bucket, int channels,
+		int64_t from, int64_t span, unsigned int width)
+{
+	MyoHistoryPoint *p;
+	int i;
+
+	p = &points[(bucket->start - from) * width / span * channels];
+	for(i = 0; i < channels; i++) {
+		p[i].min = MIN(p[i].min, bucket->min[i]);
+		p[i].max = MAX(p[i].max, bucket->max[i]);
+		p[i].mean += bucket->sum[i];
+		p[i].count += bucket->count;
+	}
+}
+
+int myo_history_read(const MyoHistory *history, int64_t from, int64_t to,
+		unsigned int width, MyoHistoryPoint *points)
+{
+	const int channels = history->channels;
+	const int64_t span = to - from;
+	const MyoHistoryLevel *l;
+	MyoHistoryBucket one;
+	int64_t bucket_us;
+	int level, lo, hi, mid, n, cap, oldest, i, c;
+
+	if(width == 0 || span <= 0) {
+		return -1;
+	}
+
+	for(i = 0; i < (int) width * channels; i++) {
+		points[i].min = INT16_MAX;
+		points[i].max = INT16_MIN;
+		points[i].mean = 0.0f;
+		points[i].count = 0;
+	}
+
+	//coarsest level with buckets no longer than a column
+	level = 0;
+	for(bucket_us = history->period_us * MYO_HISTORY_FANOUT;
+			level < MYO_HISTORY_LEVELS && bucket_us <= span / width;
+			bucket_us *= MYO_HISTORY_FANOUT) {
+		level++;
+	}
+	//finer levels forget sooner, go up while that leaves out part of the range
+	while(level < MYO_HISTORY_LEVELS && level_oldest(history, level) > from &&
+			level_oldest(history, level + 1) < level_oldest(history, level)) {
+		level++;
+	}
+
+	if(level == 0) {
+		n = history->raw_count;
+		cap = MYO_HISTORY_RAW;
+		oldest = (history->raw_head - n + cap) % cap;
+		l = NULL;
+	} else {
+		l = &history->levels[level - 1];
+		n = l->count;
+		cap = MYO_HISTORY_BUCKETS;
+		oldest = (l->head - n + cap) % cap;
+	}
+
+	//starts only go up, find the first one in range
+	lo = 0;
+	hi = n;
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if((l == NULL ? history->raw_time[(oldest + mid) % cap] :
+				l->buckets[(oldest + mid) % cap].start) < from) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for(i = lo; i < n; i++) {
+		if(l == NULL) {
+			one.start = history->raw_time[(oldest + i) % cap];
+			one.count = 1;
+			for(c = 0; c < channels; c++) {
+				one.min[c] = one.max[c] = one.sum[c] = history->raw[(oldest + i) % cap][c];
+			}
+			if(one.start >= to) {
+				break;
+			}
+			point_merge(points, &one, channels, from, span, width);
+		} else {
+			if(l->buckets[(oldest + i) % cap].start >= to) {
+				break;
+			}
+			point_merge(points, &l->buckets[(oldest + i) % cap], channels, from, span, width);
+		}
+	}
+	//the newest samples are in the open buckets of this level and the ones below
+	for(c = level - 1; c >= 0; c--) {
+		l = &history->levels[c];
+		if(l->open.count > 0 && l->open.start >= from && l->open.start < to) {
+			point_merge(points, &l->open, channels, from, span, width);
+		}
+	}
+
+	for(i = 0; i < (int) width * channels; i++) {
+		if(points[i].count > 0) {
+			points[i].mean /= points[i].count;
+		} else {
+			points[i].min = points[i].max = 0;
+		}
+	}
+
+	return level;
+}
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_link.h"
+
+void myo_link_init(MyoLink *link, int64_t emg_interval_us, int64_t imu_interval_us) {
+	memset(link, 0, sizeof(MyoLink));
+	link->nominal_us[MYO_LINK_EMG] = MAX(emg_interval_us, 1);
+	link->nominal_us[MYO_LINK_IMU] = MAX(imu_interval_us, 1);
+}
+
+void myo_link_restart(MyoLink *link, myo_link_stream_t stream) {
+	link->last[stream] = 0;
+	link->run[stream] = 0;
+	link->owed[stream] = 0;
+}
+
+//A run ended, whatever it brought beyond its first notification made up
+//for the gap before it
+static myo_link_event_t run_end(MyoLink *link, myo_link_stream_t stream, int64_t *gap_us,
+		uint32_t *lost)
+{
+	MyoLinkStream *s = &link->stats.streams[stream];
+	uint32_t owed = link->owed[stream], caught;
+
+	if(owed == 0) {
+		return MYO_LINK_NONE;
+	}
+	link->owed[stream] = 0;
+
+	caught = MIN(link->run[stream] - 1, owed);
+	*gap_us = link->owed_gap_us[stream];
+	*lost = owed - caught;
+	s->lost += *lost;
+	if(2 * caught >= owed) {
+		s->stalls++;
+		return MYO_LINK_STALL;
+	}
+	s->losses++;
+	return MYO_LINK_LOSS;
+}
+
+myo_link_event_t myo_link_arrival(MyoLink *link, myo_link_stream_t stream, int64_t timestamp,
+		int64_t *gap_us, uint32_t *lost)
+{
+	MyoLinkStream *s = &link->stats.streams[stream];
+	const int64_t nominal = link->nominal_us[stream];
+	myo_link_event_t ret = MYO_LINK_NONE;
+	int64_t d;
+
+	s->notifications++;
+	if(link->last[stream] == 0) {
+		link->last[stream] = timestamp;
+		link->run[stream] = 1;
+		return MYO_LINK_NONE;
+	}
+	d = timestamp - link->last[stream];
+	link->last[stream] = timestamp;
+
+	s->interval_us += (d - s->interval_us) / 16.0f;
+	s->jitter_us += (llabs(d - nominal) - s->jitter_us) / 16.0f;
+
+	if(d < nominal / MYO_LINK_BURST_FRACTION) {
+		if(++link->run[stream] == MYO_LINK_BURST) {
+			s->bursts++;
+		}
+		s->longest_burst = MAX(s->longest_burst, link->run[stream]);
+		return MYO_LINK_NONE;
+	}
+
+	ret = run_end(link, stream, gap_us, lost);
+	link->run[stream] = 1;
+
+	if(d > MYO_LINK_MAX_GAP_US) {
+		return ret;
+	}
+	if(d > MYO_LINK_GAP_FACTOR * nominal) {
+		s->gaps++;
+		s->gap_us += d;
+		s->longest_gap_us = MAX(s->longest_gap_us, d);
+		link->owed[stream] = d / nominal - 1;
+		link->owed_gap_us[stream] = d;
+	}
+
+	return ret;
+}
+
+void myo_link_connected(MyoLink *link, int64_t timestamp) {
+	link->stats.connects++;
+	link->stats.connected_since = timestamp;
+}
+
+void myo_link_disconnected(MyoLink *link, int64_t timestamp) {
+	MyoLinkDrop *drop;
+	int i;
+
+	if(link->stats.connected_since != 0) {
+		link->stats.drops++;
+		drop = &link->stats.history[link->history_head];
+		drop->connected = link->stats.connected_since;
+		drop->disconnected = timestamp;
+		link->history_head = (link->history_head + 1) % MYO_LINK_HISTORY;
+		link->stats.history_count = MIN(link->stats.history_count + 1, MYO_LINK_HISTORY);
+	}
+	link->stats.connected_since = 0;
+
+	for(i = 0; i < MYO_LINK_STREAMS; i++) {
+		myo_link_restart(link, i);
+	}
+}
+
+void myo_link_copy(const MyoLink *link, MyoLinkStats *stats) {
+	const int count = link->stats.history_count;
+	int i;
+
+	*stats = link->stats;
+	for(i = 0; i < count; i++) {
+		stats->history[i] = link->stats.history[(link->history_head - count + i +
+				MYO_LINK_HISTORY) % MYO_LINK_HISTORY];
+	}
+}
@@ -0,0 +1,138 @@
+#include <math.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_quality.h"
+
+//where a line frequency lands once sampled, between 0 and half the rate
+#define LINE_ALIAS(f) ((f) % MYO_EMG_RATE > MYO_EMG_RATE / 2 ? \
+		MYO_EMG_RATE - (f) % MYO_EMG_RATE : (f) % MYO_EMG_RATE)
+//a full cycle at a bin frequency has 2|X|^2 / n equal to its AC energy, at
+//half the rate the bin is real and it is |X|^2 / n. A line frequency that
+//lands on DC, like 50Hz at 50Hz, cannot be told from the channel's offset
+//and is not counted.
+#define LINE_SCALE(f) (LINE_ALIAS(f) == 0 ? 0.0f : 2 * LINE_ALIAS(f) == MYO_EMG_RATE ? 1.0f : 2.0f)
+
+//2cos(2 pi f / rate)
+static float goertzel_coeff(int f) {
+	return 2.0f * cosf(2.0f * (float) M_PI * LINE_ALIAS(f) / MYO_EMG_RATE);
+}
+
+static void window_reset(MyoQualityWindow *window) {
+	memset(window, 0, sizeof(MyoQualityWindow));
+	window->min = INT16_MAX;
+	window->max = INT16_MIN;
+}
+
+void myo_quality_init(MyoQuality *quality) {
+	int i;
+
+	memset(quality, 0, sizeof(MyoQuality));
+	for(i = 0; i < MYO_QUALITY_CHANNELS; i++) {
+		window_reset(&quality->windows[i]);
+	}
+	quality->coeff50 = goertzel_coeff(50);
+	quality->coeff60 = goertzel_coeff(60);
+}
+
+static inline void goertzel(float *s, float coeff, float x) {
+	float next = x + coeff * s[0] - s[1];
+
+	s[1] = s[0];
+	s[0] = next;
+}
+
+static inline float goertzel_power(const float *s, float coeff) {
+	return s[0] * s[0] + s[1] * s[1] - coeff * s[0] * s[1];
+}
+
+//Closes a full window, returns the channel's new flags
+static uint8_t window_close(const MyoQuality *quality, MyoQualityChannel *channel,
+		MyoQualityWindow *window)
+{
+	const float n = MYO_QUALITY_WINDOW;
+	float energy, line;
+	uint8_t flags = 0;
+	int16_t run;
+
+	channel->mean = window->sum / n;
+	channel->rms = sqrtf(window->sum_sq / n);
+	channel->min = window->min;
+	channel->max = window->max;
+
+	energy = window->sum_sq - n * channel->mean * channel->mean;
+	line = MAX(LINE_SCALE(50) * goertzel_power(window->s50, quality->coeff50),
+			LINE_SCALE(60) * goertzel_power(window->s60, quality->coeff60)) / n;
+	channel->line_noise = energy > 0.0f ? MIN(line / energy, 1.0f) : 0.0f;
+
+	if(window->saturated > MYO_QUALITY_MAX_SATURATED) {
+		flags |= MYO_QUALITY_SATURATED;
+	}
+	if(window->max - window->min <= MYO_QUALITY_FLAT_RANGE) {
+		flags |= MYO_QUALITY_FLAT;
+	} else if(channel->line_noise > MYO_QUALITY_MAX_LINE_NOISE) {
+		flags |= MYO_QUALITY_LINE_NOISE;
+	}
+	if(window->burst) {
+		flags |= MYO_QUALITY_CLIPPING;
+	}
+
+	//a burst can straddle windows
+	run = window->run;
+	window_reset(window);
+	window->run = run;
+	return flags;
+}
+
+uint8_t myo_quality_push(MyoQuality *quality, const int16_t *sample) {
+	MyoQualityChannel *channel;
+	MyoQualityWindow *window;
+	uint8_t changed = 0, flags;
+	bool close;
+	int i, x;
+
+	close = ++quality->count == MYO_QUALITY_WINDOW;
+	if(close) {
+		quality->count = 0;
+	}
+
+	for(i = 0; i < MYO_QUALITY_CHANNELS; i++) {
+		channel = &quality->channels[i];
+		window = &quality->windows[i];
+		x = sample[i];
+
+		channel->samples++;
+		window->sum += x;
+		window->sum_sq += (int64_t) x * x;
+		window->min = MIN(window->min, x);
+		window->max = MAX(window->max, x);
+		goertzel(window->s50, quality->coeff50, x);
+		goertzel(window->s60, quality->coeff60, x);
+
+		if(x == INT16_MIN || x == INT16_MAX) {
+			channel->saturated++;
+			window->saturated++;
+			//counted once per burst, when it gets long enough
+			if(++window->run == MYO_QUALITY_BURST) {
+				channel->bursts++;
+				window->burst = true;
+			}
+		} else {
+			window->run = 0;
+		}
+
+		flags = channel->flags;
+		if(window->burst) {
+			//reported right away instead of at the end of the window
+			flags |= MYO_QUALITY_CLIPPING;
+		}
+		if(close) {
+			flags = window_close(quality, channel, window);
+		}
+		if(flags != channel->flags) {
+			channel->flags = flags;
+			changed |= 1 << i;
+		}
+	}
+
+	return changed;
+}
@@ -0,0 +1,84 @@
+#include <string.h>
+#include <sys/param.h>
+
+#include "myo-bluez_ring.h"
+
+#define RING_MASK (MYO_RING_CAPACITY - 1)
+
+void myo_ring_init(MyoRing *ring, int channels) {
+	memset(ring, 0, sizeof(MyoRing));
+	ring->channels = MIN(channels, MYO_RING_MAX_CHANNELS);
+}
+
+void myo_ring_push(MyoRing *ring, const int16_t *sample, int64_t timestamp) {
+	uint64_t seq = ring->head;
+	int c, pos = seq & RING_MASK;
+
+	//readers have to see the reservation before any of the overwriting
+	__atomic_store_n(&ring->reserved, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for(c = 0; c < ring->channels; c++) {
+		ring->data[c][pos] = sample[c];
+	}
+	ring->timestamps[pos] = timestamp;
+
+	__atomic_store_n(&ring->head, seq + 1, __ATOMIC_RELEASE);
+}
+
+//Copies [first, end) out in at most two runs per column, split where the
+//ring wraps
+static void ring_copy(MyoRing *ring, uint64_t first, uint64_t end, int16_t *const *channels,
+		float *const *fchannels, const float *scale, int64_t *timestamps) {
+	int c, i, pos, run, done, n = end - first;
+
+	for(done = 0; done < n; done += run) {
+		pos = (first + done) & RING_MASK;
+		run = MIN(n - done, MYO_RING_CAPACITY - pos);
+
+		for(c = 0; c < ring->channels; c++) {
+			if(channels != NULL) {
+				memcpy(&channels[c][done], &ring->data[c][pos], run * sizeof(int16_t));
+			}
+			if(fchannels != NULL) {
+				for(i = 0; i < run; i++) {
+					fchannels[c][done + i] = ring->data[c][pos + i] * scale[c];
+				}
+			}
+		}
+		if(timestamps != NULL) {
+			memcpy(&timestamps[done], &ring->timestamps[pos], run * sizeof(int64_t));
+		}
+	}
+}
+
+int myo_ring_read(MyoRing *ring, uint64_t since, int max, int16_t *const *channels,
+		float *const *fchannels, const float *scale, int64_t *timestamps, uint64_t *first) {
+	uint64_t start, end, reserved;
+
+	max = MIN(max, MYO_RING_MAX_READ);
+	if(max <= 0) {
+		*first = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		return 0;
+	}
+
+	for(;;) {
+		end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		start = MAX(since, end - MIN(end, (uint64_t) max));
+		if(start >= end) {
+			*first = end;
+			return 0;
+		}
+
+		ring_copy(ring, start, end, channels, fchannels, scale, timestamps);
+
+		//the copy has to be done before looking at how far the writer got,
+		//the sample it is writing overwrites reserved - 1 - capacity
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		reserved = __atomic_load_n(&ring->reserved, __ATOMIC_RELAXED);
+		if(reserved - start <= MYO_RING_CAPACITY) {
+			*first = start;
+			return end - start;
+		}
+	}
+}
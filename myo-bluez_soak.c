@@ -0,0 +1,1169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "myo-bluez.h"
+
+//Soak test against a fake bluez. Every simulated myo is a Device1 with the
+//myo's GATT services, exported on the bus in MYOBLUEZ_BUS_ADDRESS from a
+//thread of its own. They stream EMG, IMU and classifier events while
+//connected, and a myo picked at random drops its connection at random
+//intervals. See make soak.
+
+#define SOAK_MAX_MYOS 32
+//as many as one context holds
+#define SOAK_MYOS_PER_CTX 4
+#define SOAK_MAX_CTXS (SOAK_MAX_MYOS / SOAK_MYOS_PER_CTX)
+#define SOAK_REPORT_S 5
+//latencies are binned per us up to this, slower ones go in the last bin
+#define SOAK_LATENCY_MAX_US 100000
+//delivered share of what was sent below which the run fails
+#define SOAK_MIN_DELIVERED 0.9
+//RSS growth after setup above which the run fails
+#define SOAK_MAX_RSS_GROWTH_KB 8192
+
+#define SIM_ADAPTER_PATH "/org/bluez/hci0"
+#define SIM_NUM_SERVICES 5
+#define SIM_NUM_CHARS 8
+//every sent EMG sample is kept this long for the receiving end to find,
+//a power of 2, about 10s at 50Hz
+#define SIM_SENT_RING 512
+#define SIM_CLASSIFIER_MS 500
+
+#define PROPERTIES_IFACE "org.freedesktop.DBus.Properties"
+#define ADAPTER_IFACE "org.bluez.Adapter1"
+#define DEVICE_IFACE "org.bluez.Device1"
+#define GATT_SERVICE_IFACE "org.bluez.GattService1"
+#define GATT_CHARACTERISTIC_IFACE "org.bluez.GattCharacteristic1"
+
+static const char *SERVICE_UUIDS[SIM_NUM_SERVICES] = {
+		"0000180f-0000-1000-8000-00805f9b34fb",
+		"d5060001-a904-deb9-4748-2c7f4a124842",
+		"d5060002-a904-deb9-4748-2c7f4a124842",
+		"d5060003-a904-deb9-4748-2c7f4a124842",
+		"d5060004-a904-deb9-4748-2c7f4a124842"
+};
+
+typedef enum {
+	CHAR_BATTERY,
+	CHAR_INFO,
+	CHAR_VERSION,
+	CHAR_COMMAND,
+	CHAR_IMU,
+	CHAR_MOTION,
+	CHAR_CLASSIFIER,
+	CHAR_EMG
+} SimCharId;
+
+static const struct {
+	int service;
+	const char *UUID;
+} CHARS[SIM_NUM_CHARS] = {
+		{0, "00002a19-0000-1000-8000-00805f9b34fb"},
+		{1, "d5060101-a904-deb9-4748-2c7f4a124842"},
+		{1, "d5060201-a904-deb9-4748-2c7f4a124842"},
+		{1, "d5060401-a904-deb9-4748-2c7f4a124842"},
+		{2, "d5060402-a904-deb9-4748-2c7f4a124842"},
+		{2, "d5060502-a904-deb9-4748-2c7f4a124842"},
+		{3, "d5060103-a904-deb9-4748-2c7f4a124842"},
+		{4, "d5060104-a904-deb9-4748-2c7f4a124842"}
+};
+
+static const gchar INTROSPECTION[] =
+		"<node>"
+		"<interface name='org.freedesktop.DBus.ObjectManager'>"
+		"<method name='GetManagedObjects'>"
+		"<arg name='objects' type='a{oa{sa{sv}}}' direction='out'/>"
+		"</method>"
+		"</interface>"
+		"<interface name='org.bluez.Adapter1'>"
+		"<method name='StartDiscovery'/>"
+		"<method name='StopDiscovery'/>"
+		"<method name='SetDiscoveryFilter'>"
+		"<arg name='filter' type='a{sv}' direction='in'/>"
+		"</method>"
+		"<property name='Address' type='s' access='read'/>"
+		"<property name='Powered' type='b' access='read'/>"
+		"</interface>"
+		"<interface name='org.bluez.Device1'>"
+		"<method name='Connect'/>"
+		"<method name='Disconnect'/>"
+		"<property name='Address' type='s' access='read'/>"
+		"<property name='AddressType' type='s' access='read'/>"
+		"<property name='Alias' type='s' access='read'/>"
+		"<property name='UUIDs' type='as' access='read'/>"
+		"<property name='Adapter' type='o' access='read'/>"
+		"<property name='Connected' type='b' access='read'/>"
+		"<property name='ServicesResolved' type='b' access='read'/>"
+		"<property name='RSSI' type='n' access='read'/>"
+		"</interface>"
+		"<interface name='org.bluez.GattService1'>"
+		"<property name='UUID' type='s' access='read'/>"
+		"<property name='Device' type='o' access='read'/>"
+		"<property name='Primary' type='b' access='read'/>"
+		"</interface>"
+		"<interface name='org.bluez.GattCharacteristic1'>"
+		"<method name='ReadValue'>"
+		"<arg name='options' type='a{sv}' direction='in'/>"
+		"<arg name='value' type='ay' direction='out'/>"
+		"</method>"
+		"<method name='WriteValue'>"
+		"<arg name='value' type='ay' direction='in'/>"
+		"<arg name='options' type='a{sv}' direction='in'/>"
+		"</method>"
+		"<method name='StartNotify'/>"
+		"<method name='StopNotify'/>"
+		"<property name='UUID' type='s' access='read'/>"
+		"<property name='Service' type='o' access='read'/>"
+		"<property name='Value' type='ay' access='read'/>"
+		"<property name='Notifying' type='b' access='read'/>"
+		"</interface>"
+		"</node>";
+
+typedef struct SimBluez SimBluez;
+typedef struct SimMyo SimMyo;
+
+typedef struct {
+	SimMyo *myo;
+	int service;
+	gchar *path;
+	bool notifying;
+} SimChar;
+
+typedef struct {
+	SimMyo *myo;
+	const char *UUID;
+	gchar *path;
+} SimService;
+
+typedef struct {
+	int16_t emg[8];
+	gint64 at;
+} SimSent;
+
+struct SimMyo {
+	SimBluez *bluez;
+	gchar *path;
+	gchar address[18];
+	gchar alias[16];
+	bool connected;
+	SimService services[SIM_NUM_SERVICES];
+	SimChar chars[SIM_NUM_CHARS];
+	//what went out as which sample, so the receiving end can tell the
+	//send time and what was lost without anything in the payload
+	GMutex lock;
+	uint32_t seq;
+	SimSent sent[SIM_SENT_RING];
+	//notifications sent, read from the main thread
+	gint emg_sent;
+	gint imu_sent;
+	gint arm_sent;
+};
+
+//Everything but the counters is only touched from the bluez thread once
+//it runs
+struct SimBluez {
+	gchar *address;
+	GDBusConnection *connection;
+	GDBusNodeInfo *node;
+	GMainContext *context;
+	GMainLoop *loop;
+	GThread *thread;
+	GArray *registrations;
+	SimMyo myos[SOAK_MAX_MYOS];
+	int num_myos;
+	unsigned int disconnect_s;
+	guint32 seed;
+	//picks who drops and when, so a seed gives the same schedule
+	GRand *rand;
+	//the samples and poses that are sent
+	GRand *noise;
+	gint drops;
+	gint connected;
+	GMutex lock;
+	GCond started;
+	//0 while starting, 1 once the name is owned, -1 if that failed
+	int state;
+};
+
+typedef struct {
+	myobluez_myo_t myo;
+	bool registered;
+	SimMyo *sim;
+	uint64_t emg;
+	uint64_t imu;
+	uint64_t arm;
+	//EMG samples that never arrived, from the sample indices
+	uint64_t lost;
+	//delivered samples that matched nothing that was sent
+	uint64_t unknown;
+	uint32_t next_seq;
+} SoakSlot;
+
+typedef struct {
+	SimBluez bluez;
+	myobluez_ctx_t ctxs[SOAK_MAX_CTXS];
+	gchar **allowlists[SOAK_MAX_CTXS];
+	int num_ctxs;
+	SoakSlot slots[SOAK_MAX_MYOS];
+	int num_slots;
+	guint32 latency[SOAK_LATENCY_MAX_US + 1];
+	uint64_t num_latencies;
+	uint64_t last_emg;
+	gint64 start;
+	gint64 last_report;
+	long rss_start;
+	double cpu_s;
+	unsigned int seconds;
+	GMainLoop *loop;
+} Soak;
+
+//myo_init has no user_data
+static Soak soak;
+
+static long rss_kb() {
+	long size, resident = 0;
+	FILE *file;
+
+	file = fopen("/proc/self/statm", "r");
+	if(file == NULL) {
+		return 0;
+	}
+	if(fscanf(file, "%ld %ld", &size, &resident) != 2) {
+		resident = 0;
+	}
+	fclose(file);
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* fake bluez, runs in its own thread and main context */
+
+static void sim_properties_changed(SimBluez *bluez, const gchar *path, const gchar *iface,
+		GVariantBuilder *changed)
+{
+	g_dbus_connection_emit_signal(bluez->connection, NULL, path, PROPERTIES_IFACE,
+			"PropertiesChanged", g_variant_new("(sa{sv}as)", iface, changed, NULL), NULL);
+}
+
+static void sim_property_changed(SimBluez *bluez, const gchar *path, const gchar *iface,
+		const gchar *name, GVariant *value)
+{
+	GVariantBuilder changed;
+
+	g_variant_builder_init(&changed, G_VARIANT_TYPE("a{sv}"));
+	g_variant_builder_add(&changed, "{sv}", name, value);
+	sim_properties_changed(bluez, path, iface, &changed);
+}
+
+//Like bluez, ServicesResolved follows Connected. Notify sessions are kept
+//across a reconnect, as bluez does for a device it has cached.
+static void sim_set_connected(SimBluez *bluez, SimMyo *myo, bool connected) {
+	if(myo->connected == connected) {
+		return;
+	}
+	myo->connected = connected;
+	g_atomic_int_add(&bluez->connected, connected ? 1 : -1);
+
+	if(connected) {
+		sim_property_changed(bluez, myo->path, DEVICE_IFACE, "Connected",
+				g_variant_new_boolean(true));
+		sim_property_changed(bluez, myo->path, DEVICE_IFACE, "ServicesResolved",
+				g_variant_new_boolean(true));
+	} else {
+		sim_property_changed(bluez, myo->path, DEVICE_IFACE, "ServicesResolved",
+				g_variant_new_boolean(false));
+		sim_property_changed(bluez, myo->path, DEVICE_IFACE, "Connected",
+				g_variant_new_boolean(false));
+	}
+}
+
+static void sim_notify(SimBluez *bluez, SimChar *chr, const void *value, gsize len) {
+	sim_property_changed(bluez, chr->path, GATT_CHARACTERISTIC_IFACE, "Value",
+			g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, value, len, sizeof(uint8_t)));
+}
+
+static GVariant* sim_adapter_property(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *name, GError **error,
+		gpointer user_data)
+{
+	if(strcmp(name, "Address") == 0) {
+		return g_variant_new_string("00:00:00:00:00:00");
+	} else if(strcmp(name, "Powered") == 0) {
+		return g_variant_new_boolean(true);
+	}
+	return NULL;
+}
+
+static GVariant* sim_device_property(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *name, GError **error,
+		gpointer user_data)
+{
+	SimMyo *myo = (SimMyo*) user_data;
+
+	if(strcmp(name, "Address") == 0) {
+		return g_variant_new_string(myo->address);
+	} else if(strcmp(name, "AddressType") == 0) {
+		return g_variant_new_string("public");
+	} else if(strcmp(name, "Alias") == 0) {
+		return g_variant_new_string(myo->alias);
+	} else if(strcmp(name, "UUIDs") == 0) {
+		return g_variant_new_strv(&SERVICE_UUIDS[1], 1);
+	} else if(strcmp(name, "Adapter") == 0) {
+		return g_variant_new_object_path(SIM_ADAPTER_PATH);
+	} else if(strcmp(name, "Connected") == 0 || strcmp(name, "ServicesResolved") == 0) {
+		return g_variant_new_boolean(myo->connected);
+	} else if(strcmp(name, "RSSI") == 0) {
+		return g_variant_new_int16(-50);
+	}
+	return NULL;
+}
+
+static GVariant* sim_service_property(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *name, GError **error,
+		gpointer user_data)
+{
+	SimService *serv = (SimService*) user_data;
+
+	if(strcmp(name, "UUID") == 0) {
+		return g_variant_new_string(serv->UUID);
+	} else if(strcmp(name, "Device") == 0) {
+		return g_variant_new_object_path(serv->myo->path);
+	} else if(strcmp(name, "Primary") == 0) {
+		return g_variant_new_boolean(true);
+	}
+	return NULL;
+}
+
+static GVariant* sim_char_property(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *name, GError **error,
+		gpointer user_data)
+{
+	SimChar *chr = (SimChar*) user_data;
+
+	if(strcmp(name, "UUID") == 0) {
+		return g_variant_new_string(CHARS[chr - chr->myo->chars].UUID);
+	} else if(strcmp(name, "Service") == 0) {
+		return g_variant_new_object_path(chr->myo->services[chr->service].path);
+	} else if(strcmp(name, "Value") == 0) {
+		return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, NULL, 0, sizeof(uint8_t));
+	} else if(strcmp(name, "Notifying") == 0) {
+		return g_variant_new_boolean(chr->notifying);
+	}
+	return NULL;
+}
+
+static void sim_adapter_method(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *method, GVariant *params,
+		GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	//every myo is known from the start, there is nothing to find
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void sim_device_method(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *method, GVariant *params,
+		GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	SimMyo *myo = (SimMyo*) user_data;
+
+	sim_set_connected(myo->bluez, myo, strcmp(method, "Connect") == 0);
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void sim_char_method(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *method, GVariant *params,
+		GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	SimChar *chr = (SimChar*) user_data;
+	myohw_fw_version_t version = {1, 5, 1970, 2};
+	myohw_fw_info_t info;
+	uint8_t battery = 100;
+	const void *value = NULL;
+	gsize len = 0;
+
+	if(!chr->myo->connected) {
+		g_dbus_method_invocation_return_dbus_error(invocation, "org.bluez.Error.NotConnected",
+				"Not Connected");
+		return;
+	}
+
+	if(strcmp(method, "ReadValue") == 0) {
+		switch(chr - chr->myo->chars) {
+			case CHAR_VERSION:
+				value = &version;
+				len = sizeof(version);
+				break;
+			case CHAR_INFO:
+				memset(&info, 0, sizeof(info));
+				value = &info;
+				len = sizeof(info);
+				break;
+			case CHAR_BATTERY:
+				value = &battery;
+				len = sizeof(battery);
+				break;
+		}
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(@ay)",
+				g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, value, len, sizeof(uint8_t))));
+		return;
+	}
+
+	if(strcmp(method, "StartNotify") == 0 || strcmp(method, "StopNotify") == 0) {
+		chr->notifying = strcmp(method, "StartNotify") == 0;
+		sim_property_changed(chr->myo->bluez, chr->path, GATT_CHARACTERISTIC_IFACE, "Notifying",
+				g_variant_new_boolean(chr->notifying));
+	}
+	//commands are accepted and otherwise ignored, the myos always stream
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static void sim_add_object(GVariantBuilder *objects, GDBusNodeInfo *node, const gchar *path,
+		const gchar *iface, GDBusInterfaceGetPropertyFunc get_property, gpointer user_data)
+{
+	GDBusInterfaceInfo *info = g_dbus_node_info_lookup_interface(node, iface);
+	GVariantBuilder interfaces, properties;
+	GVariant *value;
+	int i;
+
+	g_variant_builder_init(&properties, G_VARIANT_TYPE("a{sv}"));
+	for(i = 0; info->properties[i] != NULL; i++) {
+		value = get_property(NULL, NULL, path, iface, info->properties[i]->name, NULL, user_data);
+		g_variant_builder_add(&properties, "{sv}", info->properties[i]->name, value);
+	}
+	g_variant_builder_init(&interfaces, G_VARIANT_TYPE("a{sa{sv}}"));
+	g_variant_builder_add(&interfaces, "{sa{sv}}", iface, &properties);
+	g_variant_builder_add(objects, "{oa{sa{sv}}}", path, &interfaces);
+}
+
+static void sim_manager_method(GDBusConnection *connection, const gchar *sender,
+		const gchar *path, const gchar *iface, const gchar *method, GVariant *params,
+		GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	SimBluez *bluez = (SimBluez*) user_data;
+	GVariantBuilder objects;
+	SimMyo *myo;
+	int i, j;
+
+	g_variant_builder_init(&objects, G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+	sim_add_object(&objects, bluez->node, SIM_ADAPTER_PATH, ADAPTER_IFACE,
+			sim_adapter_property, bluez);
+	for(i = 0; i < bluez->num_myos; i++) {
+		myo = &bluez->myos[i];
+		sim_add_object(&objects, bluez->node, myo->path, DEVICE_IFACE, sim_device_property, myo);
+		for(j = 0; j < SIM_NUM_SERVICES; j++) {
+			sim_add_object(&objects, bluez->node, myo->services[j].path, GATT_SERVICE_IFACE,
+					sim_service_property, &myo->services[j]);
+		}
+		for(j = 0; j < SIM_NUM_CHARS; j++) {
+			sim_add_object(&objects, bluez->node, myo->chars[j].path, GATT_CHARACTERISTIC_IFACE,
+					sim_char_property, &myo->chars[j]);
+		}
+	}
+
+	g_dbus_method_invocation_return_value(invocation, g_variant_new("(a{oa{sa{sv}}})", &objects));
+}
+
+static const GDBusInterfaceVTable MANAGER_VTABLE = {sim_manager_method, NULL, NULL};
+static const GDBusInterfaceVTable ADAPTER_VTABLE = {sim_adapter_method, sim_adapter_property, NULL};
+static const GDBusInterfaceVTable DEVICE_VTABLE = {sim_device_method, sim_device_property, NULL};
+static const GDBusInterfaceVTable SERVICE_VTABLE = {NULL, sim_service_property, NULL};
+static const GDBusInterfaceVTable CHAR_VTABLE = {sim_char_method, sim_char_property, NULL};
+
+static bool sim_register(SimBluez *bluez, const gchar *path, const gchar *iface,
+		const GDBusInterfaceVTable *vtable, gpointer user_data)
+{
+	GError *error = NULL;
+	guint id;
+
+	id = g_dbus_connection_register_object(bluez->connection, path,
+			g_dbus_node_info_lookup_interface(bluez->node, iface), vtable, user_data, NULL, &error);
+	if(id == 0) {
+		fprintf(stderr, "Registering %s on %s failed: %s\n", iface, path, error->message);
+		g_clear_error(&error);
+		return false;
+	}
+	g_array_append_val(bluez->registrations, id);
+	return true;
+}
+
+static bool sim_export(SimBluez *bluez) {
+	SimMyo *myo;
+	bool ok;
+	int i, j;
+
+	ok = sim_register(bluez, "/", "org.freedesktop.DBus.ObjectManager", &MANAGER_VTABLE, bluez) &&
+			sim_register(bluez, SIM_ADAPTER_PATH, ADAPTER_IFACE, &ADAPTER_VTABLE, bluez);
+	for(i = 0; ok && i < bluez->num_myos; i++) {
+		myo = &bluez->myos[i];
+		ok = sim_register(bluez, myo->path, DEVICE_IFACE, &DEVICE_VTABLE, myo);
+		for(j = 0; ok && j < SIM_NUM_SERVICES; j++) {
+			ok = sim_register(bluez, myo->services[j].path, GATT_SERVICE_IFACE, &SERVICE_VTABLE,
+					&myo->services[j]);
+		}
+		for(j = 0; ok && j < SIM_NUM_CHARS; j++) {
+			ok = sim_register(bluez, myo->chars[j].path, GATT_CHARACTERISTIC_IFACE, &CHAR_VTABLE,
+					&myo->chars[j]);
+		}
+	}
+
+	return ok;
+}
+
+//Only once everything is exported, so the library never sees half a bluez
+static bool sim_own_name(SimBluez *bluez) {
+	GVariant *reply;
+	GError *error = NULL;
+	guint32 result;
+
+	reply = g_dbus_connection_call_sync(bluez->connection, "org.freedesktop.DBus",
+			"/org/freedesktop/DBus", "org.freedesktop.DBus", "RequestName",
+			g_variant_new("(su)", "org.bluez", 4), G_VARIANT_TYPE("(u)"),
+			G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	if(reply == NULL) {
+		fprintf(stderr, "Requesting org.bluez failed: %s\n", error->message);
+		g_clear_error(&error);
+		return false;
+	}
+	g_variant_get(reply, "(u)", &result);
+	g_variant_unref(reply);
+
+	//1 is DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER
+	if(result != 1) {
+		fprintf(stderr, "org.bluez is already owned on this bus\n");
+		return false;
+	}
+	return true;
+}
+
+static gboolean sim_emg_tick(gpointer user_data) {
+	SimBluez *bluez = (SimBluez*) user_data;
+	//8 16-bit values and the moving mask
+	uint8_t value[17];
+	SimSent *sent;
+	SimMyo *myo;
+	int i, j;
+
+	for(i = 0; i < bluez->num_myos; i++) {
+		myo = &bluez->myos[i];
+		if(!myo->connected || !myo->chars[CHAR_EMG].notifying) {
+			continue;
+		}
+
+		//recorded before it goes out, the library may deliver it right away
+		g_mutex_lock(&myo->lock);
+		sent = &myo->sent[myo->seq % SIM_SENT_RING];
+		for(j = 0; j < 8; j++) {
+			sent->emg[j] = (int16_t) g_rand_int_range(bluez->noise, -128, 128);
+			value[2 * j] = (uint8_t) sent->emg[j];
+			value[2 * j + 1] = (uint8_t) ((uint16_t) sent->emg[j] >> 8);
+		}
+		value[16] = 0;
+		sent->at = g_get_monotonic_time();
+		myo->seq++;
+		g_mutex_unlock(&myo->lock);
+
+		sim_notify(bluez, &myo->chars[CHAR_EMG], value, sizeof(value));
+		g_atomic_int_inc(&myo->emg_sent);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean sim_imu_tick(gpointer user_data) {
+	SimBluez *bluez = (SimBluez*) user_data;
+	myohw_imu_data_t imu;
+	SimMyo *myo;
+	int i;
+
+	memset(&imu, 0, sizeof(imu));
+	imu.orientation.w = MYOHW_ORIENTATION_SCALE;
+
+	for(i = 0; i < bluez->num_myos; i++) {
+		myo = &bluez->myos[i];
+		if(myo->connected && myo->chars[CHAR_IMU].notifying) {
+			sim_notify(bluez, &myo->chars[CHAR_IMU], &imu, sizeof(imu));
+			g_atomic_int_inc(&myo->imu_sent);
+		}
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+//Poses as the myo's own classifier would report them
+static gboolean sim_arm_tick(gpointer user_data) {
+	SimBluez *bluez = (SimBluez*) user_data;
+	myohw_classifier_event_t event;
+	SimMyo *myo;
+	int i;
+
+	for(i = 0; i < bluez->num_myos; i++) {
+		myo = &bluez->myos[i];
+		if(!myo->connected || !myo->chars[CHAR_CLASSIFIER].notifying) {
+			continue;
+		}
+		memset(&event, 0, sizeof(event));
+		event.type = myohw_classifier_event_pose;
+		event.pose = (uint16_t) g_rand_int_range(bluez->noise, myohw_pose_rest,
+				myohw_pose_double_tap + 1);
+		sim_notify(bluez, &myo->chars[CHAR_CLASSIFIER], &event, sizeof(event));
+		g_atomic_int_inc(&myo->arm_sent);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void sim_add_timer(SimBluez *bluez, guint interval_ms, GSourceFunc func) {
+	GSource *source;
+
+	source = g_timeout_source_new(interval_ms);
+	g_source_set_callback(source, func, bluez, NULL);
+	g_source_attach(source, bluez->context);
+	g_source_unref(source);
+}
+
+static gboolean sim_drop_tick(gpointer user_data);
+
+//Anywhere from half to one and a half disconnect intervals from now
+static void sim_drop_schedule(SimBluez *bluez) {
+	guint ms = bluez->disconnect_s * 1000;
+
+	sim_add_timer(bluez, g_rand_int_range(bluez->rand, ms / 2, ms + ms / 2 + 1), sim_drop_tick);
+}
+
+//Drops a connected myo picked at random, the library is expected to connect
+//it again
+static gboolean sim_drop_tick(gpointer user_data) {
+	SimBluez *bluez = (SimBluez*) user_data;
+	SimMyo *myo;
+	int i, first;
+
+	first = g_rand_int_range(bluez->rand, 0, bluez->num_myos);
+	for(i = 0; i < bluez->num_myos; i++) {
+		myo = &bluez->myos[(first + i) % bluez->num_myos];
+		if(myo->connected) {
+			sim_set_connected(bluez, myo, false);
+			g_atomic_int_inc(&bluez->drops);
+			break;
+		}
+	}
+
+	sim_drop_schedule(bluez);
+	return G_SOURCE_REMOVE;
+}
+
+static void sim_started(SimBluez *bluez, int state) {
+	g_mutex_lock(&bluez->lock);
+	bluez->state = state;
+	g_cond_signal(&bluez->started);
+	g_mutex_unlock(&bluez->lock);
+}
+
+static gpointer sim_thread(gpointer user_data) {
+	SimBluez *bluez = (SimBluez*) user_data;
+	GError *error = NULL;
+
+	g_main_context_push_thread_default(bluez->context);
+
+	bluez->connection = g_dbus_connection_new_for_address_sync(bluez->address,
+			G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+			G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION, NULL, NULL, &error);
+	if(bluez->connection == NULL) {
+		fprintf(stderr, "Connecting the fake bluez failed: %s\n", error->message);
+		g_clear_error(&error);
+		sim_started(bluez, -1);
+		g_main_context_pop_thread_default(bluez->context);
+		return NULL;
+	}
+
+	if(!sim_export(bluez) || !sim_own_name(bluez)) {
+		sim_started(bluez, -1);
+		g_main_context_pop_thread_default(bluez->context);
+		return NULL;
+	}
+
+	sim_add_timer(bluez, 1000 / MYO_EMG_NOTIFY_RATE, sim_emg_tick);
+	sim_add_timer(bluez, 1000 / MYO_IMU_RATE, sim_imu_tick);
+	sim_add_timer(bluez, SIM_CLASSIFIER_MS, sim_arm_tick);
+	if(bluez->disconnect_s > 0) {
+		sim_drop_schedule(bluez);
+	}
+
+	sim_started(bluez, 1);
+	g_main_loop_run(bluez->loop);
+
+	g_main_context_pop_thread_default(bluez->context);
+	return NULL;
+}
+
+static void sim_init_myo(SimBluez *bluez, SimMyo *myo, int index) {
+	int i;
+
+	myo->bluez = bluez;
+	g_snprintf(myo->address, sizeof(myo->address), "C8:2F:84:00:00:%02X", index);
+	g_snprintf(myo->alias, sizeof(myo->alias), "Soak Myo %d", index);
+	myo->path = g_strdup_printf(SIM_ADAPTER_PATH "/dev_C8_2F_84_00_00_%02X", index);
+	g_mutex_init(&myo->lock);
+
+	for(i = 0; i < SIM_NUM_SERVICES; i++) {
+		myo->services[i].myo = myo;
+		myo->services[i].UUID = SERVICE_UUIDS[i];
+		myo->services[i].path = g_strdup_printf("%s/service%04x", myo->path, 0x10 * (i + 1));
+	}
+	for(i = 0; i < SIM_NUM_CHARS; i++) {
+		myo->chars[i].myo = myo;
+		myo->chars[i].service = CHARS[i].service;
+		myo->chars[i].path = g_strdup_printf("%s/char%04x",
+				myo->services[CHARS[i].service].path, 0x10 * (CHARS[i].service + 1) + i + 1);
+	}
+}
+
+static int sim_start(SimBluez *bluez, const char *address, int num_myos, unsigned int disconnect_s,
+		guint32 seed)
+{
+	GError *error = NULL;
+	int i;
+
+	bluez->address = g_strdup(address);
+	bluez->num_myos = num_myos;
+	bluez->disconnect_s = disconnect_s;
+	bluez->seed = seed;
+	bluez->rand = g_rand_new_with_seed(seed);
+	bluez->noise = g_rand_new_with_seed(seed + 1);
+	for(i = 0; i < num_myos; i++) {
+		sim_init_myo(bluez, &bluez->myos[i], i);
+	}
+	bluez->registrations = g_array_new(false, false, sizeof(guint));
+	bluez->context = g_main_context_new();
+	bluez->loop = g_main_loop_new(bluez->context, false);
+	g_mutex_init(&bluez->lock);
+	g_cond_init(&bluez->started);
+
+	bluez->node = g_dbus_node_info_new_for_xml(INTROSPECTION, &error);
+	if(bluez->node == NULL) {
+		fprintf(stderr, "Bad introspection data: %s\n", error->message);
+		g_clear_error(&error);
+		return MYOBLUEZ_ERROR;
+	}
+
+	bluez->thread = g_thread_new("fake-bluez", sim_thread, bluez);
+
+	g_mutex_lock(&bluez->lock);
+	while(bluez->state == 0) {
+		g_cond_wait(&bluez->started, &bluez->lock);
+	}
+	g_mutex_unlock(&bluez->lock);
+
+	return bluez->state > 0 ? MYOBLUEZ_OK : MYOBLUEZ_ERROR;
+}
+
+static gboolean quit_loop(gpointer user_data) {
+	g_main_loop_quit((GMainLoop*) user_data);
+	return G_SOURCE_REMOVE;
+}
+
+static void sim_stop(SimBluez *bluez) {
+	SimMyo *myo;
+	guint i;
+	int j;
+
+	if(bluez->thread != NULL) {
+		g_main_context_invoke(bluez->context, quit_loop, bluez->loop);
+		g_thread_join(bluez->thread);
+	}
+
+	for(i = 0; bluez->connection != NULL && i < bluez->registrations->len; i++) {
+		g_dbus_connection_unregister_object(bluez->connection,
+				g_array_index(bluez->registrations, guint, i));
+	}
+	g_array_free(bluez->registrations, true);
+	if(bluez->connection != NULL) {
+		g_object_unref(bluez->connection);
+	}
+	g_main_loop_unref(bluez->loop);
+	g_main_context_unref(bluez->context);
+	if(bluez->node != NULL) {
+		g_dbus_node_info_unref(bluez->node);
+	}
+	g_mutex_clear(&bluez->lock);
+	g_cond_clear(&bluez->started);
+	g_rand_free(bluez->rand);
+	g_rand_free(bluez->noise);
+
+	for(i = 0; i < (guint) bluez->num_myos; i++) {
+		myo = &bluez->myos[i];
+		for(j = 0; j < SIM_NUM_SERVICES; j++) {
+			g_free(myo->services[j].path);
+		}
+		for(j = 0; j < SIM_NUM_CHARS; j++) {
+			g_free(myo->chars[j].path);
+		}
+		g_free(myo->path);
+		g_mutex_clear(&myo->lock);
+	}
+	g_free(bluez->address);
+}
+
+/* the library under test, in the main thread */
+
+//Finds the sample among what the fake sent from index from on, samples come
+//in order so only whatever was skipped over is lost
+static bool sim_sent_find(SimMyo *myo, uint32_t from, const int16_t *emg, uint32_t *seq,
+		gint64 *at)
+{
+	bool found = false;
+	uint32_t s;
+
+	g_mutex_lock(&myo->lock);
+	//older ones have been overwritten already
+	if(myo->seq - from > SIM_SENT_RING) {
+		from = myo->seq - SIM_SENT_RING;
+	}
+	for(s = from; s != myo->seq && !found; s++) {
+		if(memcmp(myo->sent[s % SIM_SENT_RING].emg, emg, sizeof(myo->sent[0].emg)) == 0) {
+			*seq = s;
+			*at = myo->sent[s % SIM_SENT_RING].at;
+			found = true;
+		}
+	}
+	g_mutex_unlock(&myo->lock);
+
+	return found;
+}
+
+static void soak_emg_cb(myobluez_myo_t myo, const int16_t *emg, uint8_t moving, void *user_data) {
+	SoakSlot *slot = (SoakSlot*) user_data;
+	gint64 sent, latency;
+	uint32_t seq;
+
+	slot->emg++;
+	if(slot->sim == NULL || !sim_sent_find(slot->sim, slot->next_seq, emg, &seq, &sent)) {
+		slot->unknown++;
+		return;
+	}
+
+	latency = CLAMP(g_get_monotonic_time() - sent, 0, SOAK_LATENCY_MAX_US);
+	soak.latency[latency]++;
+	soak.num_latencies++;
+
+	slot->lost += seq - slot->next_seq;
+	slot->next_seq = seq + 1;
+}
+
+static void soak_imu_cb(myobluez_myo_t myo, const myohw_imu_data_t *data, void *user_data) {
+	((SoakSlot*) user_data)->imu++;
+}
+
+static void soak_arm_cb(myobluez_myo_t myo, const myohw_classifier_event_t *event,
+		void *user_data)
+{
+	((SoakSlot*) user_data)->arm++;
+}
+
+//The fake names them Soak Myo <index>
+static SimMyo* soak_sim_myo(myobluez_myo_t myo) {
+	char name[25];
+	int index;
+
+	if(myo_get_name(myo, name) <= 0 || sscanf(name, "Soak Myo %d", &index) != 1 ||
+			index < 0 || index >= soak.bluez.num_myos) {
+		return NULL;
+	}
+	return &soak.bluez.myos[index];
+}
+
+static int soak_init(myobluez_myo_t myo) {
+	SoakSlot *slot = NULL;
+	int i;
+
+	//init is retried after a failure, the slot stays
+	for(i = 0; i < soak.num_slots && slot == NULL; i++) {
+		if(soak.slots[i].myo == myo) {
+			slot = &soak.slots[i];
+		}
+	}
+	if(slot == NULL) {
+		slot = &soak.slots[soak.num_slots++];
+		slot->myo = myo;
+	}
+	if(slot->sim == NULL) {
+		slot->sim = soak_sim_myo(myo);
+	}
+
+	if(!slot->registered) {
+		if(myo_emg_cb_add(myo, soak_emg_cb, slot) != MYOBLUEZ_OK ||
+				myo_imu_cb_add(myo, soak_imu_cb, slot) != MYOBLUEZ_OK ||
+				myo_arm_cb_add(myo, soak_arm_cb, slot) != MYOBLUEZ_OK) {
+			myo_emg_cb_remove(myo, soak_emg_cb, slot);
+			myo_imu_cb_remove(myo, soak_imu_cb, slot);
+			return MYOBLUEZ_ERROR;
+		}
+		slot->registered = true;
+	}
+
+	if(myo_EMG_notify_enable(myo, true) != MYOBLUEZ_OK ||
+			myo_IMU_notify_enable(myo, true) != MYOBLUEZ_OK ||
+			myo_arm_indicate_enable(myo, true) != MYOBLUEZ_OK) {
+		return MYOBLUEZ_ERROR;
+	}
+
+	return myo_update_enable(myo, myohw_emg_mode_send_emg, myohw_imu_mode_send_data,
+			myohw_classifier_mode_enabled);
+}
+
+//Nearest rank over the latency bins, in us
+static long latency_percentile(double p) {
+	uint64_t rank, seen = 0;
+	long i;
+
+	if(soak.num_latencies == 0) {
+		return 0;
+	}
+	rank = (uint64_t) (p * (soak.num_latencies - 1)) + 1;
+	for(i = 0; i <= SOAK_LATENCY_MAX_US; i++) {
+		seen += soak.latency[i];
+		if(seen >= rank) {
+			return i;
+		}
+	}
+	return SOAK_LATENCY_MAX_US;
+}
+
+static uint64_t emg_received() {
+	uint64_t total = 0;
+	int i;
+
+	for(i = 0; i < soak.num_slots; i++) {
+		total += soak.slots[i].emg;
+	}
+	return total;
+}
+
+static gboolean soak_report(gpointer user_data) {
+	MyoBluezResources resources;
+	gint64 now = g_get_monotonic_time();
+	uint64_t emg = emg_received();
+	double elapsed = (now - soak.last_report) / (double) G_USEC_PER_SEC;
+
+	myobluez_get_resources(&resources);
+	printf("soak %4.0fs  %2d/%d myos  emg %6.1f/s of %d/s  latency p50 %.2fms p99 %.2fms"
+			"  rss %ldkB  objects %d handlers %d sources %d\n",
+			(now - soak.start) / (double) G_USEC_PER_SEC,
+			g_atomic_int_get(&soak.bluez.connected), soak.bluez.num_myos,
+			(emg - soak.last_emg) / elapsed,
+			g_atomic_int_get(&soak.bluez.connected) * MYO_EMG_NOTIFY_RATE,
+			latency_percentile(0.5) / 1000.0, latency_percentile(0.99) / 1000.0,
+			rss_kb(), resources.objects, resources.signal_handlers, resources.sources);
+
+	//after the first report everything has been set up, growth from here on
+	//is what the run itself costs
+	if(soak.rss_start == 0) {
+		soak.rss_start = rss_kb();
+	}
+	soak.last_emg = emg;
+	soak.last_report = now;
+
+	return G_SOURCE_CONTINUE;
+}
+
+static int soak_start_ctxs(int num_myos) {
+	MyoDiscovery discovery;
+	GError *error = NULL;
+	int i, n;
+
+	for(i = 0; i * SOAK_MYOS_PER_CTX < num_myos; i++) {
+		n = MIN(num_myos - i * SOAK_MYOS_PER_CTX, SOAK_MYOS_PER_CTX);
+		//each context only takes its own myos
+		soak.allowlists[i] = g_new0(gchar*, n + 1);
+		for(n = n - 1; n >= 0; n--) {
+			soak.allowlists[i][n] = g_strdup(soak.bluez.myos[i * SOAK_MYOS_PER_CTX + n].address);
+		}
+		discovery.target = MIN(num_myos - i * SOAK_MYOS_PER_CTX, SOAK_MYOS_PER_CTX);
+		discovery.rssi = 0;
+		discovery.allowlist = (const char *const *) soak.allowlists[i];
+
+		soak.ctxs[i] = myobluez_ctx_new();
+		soak.num_ctxs++;
+		myobluez_ctx_set_cache(soak.ctxs[i], false);
+		if(myobluez_ctx_set_discovery(soak.ctxs[i], &discovery) != MYOBLUEZ_OK ||
+				myobluez_ctx_start(soak.ctxs[i], soak_init, &error) != MYOBLUEZ_OK) {
+			fprintf(stderr, "Starting context %d failed%s%s\n", i,
+					error != NULL ? ": " : "", error != NULL ? error->message : "");
+			g_clear_error(&error);
+			return MYOBLUEZ_ERROR;
+		}
+	}
+
+	return MYOBLUEZ_OK;
+}
+
+static void soak_free_ctxs() {
+	int i;
+
+	for(i = 0; i < soak.num_ctxs; i++) {
+		myobluez_ctx_free(soak.ctxs[i]);
+		g_strfreev(soak.allowlists[i]);
+	}
+	soak.num_ctxs = 0;
+
+	//let go of whatever the freed contexts still had in flight
+	while(g_main_context_iteration(NULL, false));
+}
+
+//Returns how many checks failed
+static int soak_summary() {
+	MyoBluezStats stats, total;
+	MyoBluezResources resources;
+	uint64_t sent = 0, imu_sent = 0, arm_sent = 0, imu = 0, arm = 0, lost = 0, unknown = 0;
+	uint64_t emg = emg_received();
+	long rss_end = rss_kb();
+	const uint64_t *from;
+	uint64_t *to;
+	size_t k;
+	int i, failed = 0;
+
+	memset(&total, 0, sizeof(total));
+	for(i = 0; i < soak.num_ctxs; i++) {
+		myobluez_ctx_get_stats(soak.ctxs[i], &stats);
+		from = (const uint64_t*) &stats;
+		to = (uint64_t*) &total;
+		for(k = 0; k < sizeof(MyoBluezStats) / sizeof(uint64_t); k++) {
+			to[k] += from[k];
+		}
+	}
+	for(i = 0; i < soak.bluez.num_myos; i++) {
+		sent += g_atomic_int_get(&soak.bluez.myos[i].emg_sent);
+		imu_sent += g_atomic_int_get(&soak.bluez.myos[i].imu_sent);
+		arm_sent += g_atomic_int_get(&soak.bluez.myos[i].arm_sent);
+	}
+	for(i = 0; i < soak.num_slots; i++) {
+		imu += soak.slots[i].imu;
+		arm += soak.slots[i].arm;
+		lost += soak.slots[i].lost;
+		unknown += soak.slots[i].unknown;
+	}
+
+	printf("soak: %d myos for %us, %d disconnects injected, seed %u\n", soak.bluez.num_myos,
+			soak.seconds, g_atomic_int_get(&soak.bluez.drops), soak.bluez.seed);
+	printf("soak: emg %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " delivered, %"
+			G_GUINT64_FORMAT " lost in flight, %" G_GUINT64_FORMAT " never sent, %.1f/s\n",
+			emg, sent, lost, unknown, emg / (double) MAX(soak.seconds, 1));
+	printf("soak: imu %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " delivered\n", imu, imu_sent);
+	printf("soak: classifier %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " delivered\n",
+			arm, arm_sent);
+	printf("soak: latency p50 %.2fms p90 %.2fms p99 %.2fms p99.9 %.2fms max %.2fms\n",
+			latency_percentile(0.5) / 1000.0, latency_percentile(0.9) / 1000.0,
+			latency_percentile(0.99) / 1000.0, latency_percentile(0.999) / 1000.0,
+			latency_percentile(1.0) / 1000.0);
+	printf("soak: connects %" G_GUINT64_FORMAT " disconnects %" G_GUINT64_FORMAT
+			" failures %" G_GUINT64_FORMAT "\n",
+			total.connects, total.disconnects, total.connect_failures);
+	//the fake bluez runs in this process too, so this is an upper bound
+	printf("soak: cpu %.2fs user+sys, %.1fus per delivered sample\n", soak.cpu_s,
+			emg > 0 ? soak.cpu_s * G_USEC_PER_SEC / emg : 0.0);
+	printf("soak: rss %ldkB after setup, %ldkB at the end\n", soak.rss_start, rss_end);
+
+	if(sent == 0 || emg < SOAK_MIN_DELIVERED * sent) {
+		printf("soak: FAIL too little EMG delivered\n");
+		failed++;
+	}
+	if(unknown > 0) {
+		printf("soak: FAIL EMG delivered that was never sent\n");
+		failed++;
+	}
+	if(arm_sent == 0 || arm < SOAK_MIN_DELIVERED * arm_sent) {
+		printf("soak: FAIL too few classifier events delivered\n");
+		failed++;
+	}
+	//shorter runs never get to a report, there is nothing to compare to
+	if(soak.rss_start > 0 && rss_end - soak.rss_start > SOAK_MAX_RSS_GROWTH_KB) {
+		printf("soak: FAIL rss grew by %ldkB\n", rss_end - soak.rss_start);
+		failed++;
+	}
+
+	soak_free_ctxs();
+	myobluez_get_resources(&resources);
+	printf("soak: after free contexts %d objects %d handlers %d sources %d\n",
+			resources.contexts, resources.objects, resources.signal_handlers, resources.sources);
+	if(resources.contexts != 0 || resources.objects != 0 || resources.signal_handlers != 0 ||
+			resources.sources != 0) {
+		printf("soak: FAIL resources leaked\n");
+		failed++;
+	}
+
+	return failed;
+}
+
+static double cpu_seconds(const struct rusage *from, const struct rusage *to) {
+	return (to->ru_utime.tv_sec - from->ru_utime.tv_sec) +
+			(to->ru_stime.tv_sec - from->ru_stime.tv_sec) +
+			((to->ru_utime.tv_usec - from->ru_utime.tv_usec) +
+			(to->ru_stime.tv_usec - from->ru_stime.tv_usec)) / 1e6;
+}
+
+int main(int argc, char **argv) {
+	const char *address = getenv("MYOBLUEZ_BUS_ADDRESS");
+	unsigned int disconnect_s = 5;
+	guint32 seed = g_random_int();
+	struct rusage start, end;
+	int num_myos = 4, failed;
+
+	if(argc > 5) {
+		fprintf(stderr, "Usage: %s [myos] [seconds] [mean disconnect interval in seconds, "
+				"0 for never] [seed]\n", argv[0]);
+		return 1;
+	}
+	if(address == NULL) {
+		//never the system bus, the real bluez would be in the way
+		fprintf(stderr, "MYOBLUEZ_BUS_ADDRESS has to point at a private bus, see make soak\n");
+		return 1;
+	}
+
+	soak.seconds = 60;
+	if(argc > 1) {
+		num_myos = CLAMP(atoi(argv[1]), 1, SOAK_MAX_MYOS);
+	}
+	if(argc > 2) {
+		soak.seconds = MAX(atoi(argv[2]), 1);
+	}
+	if(argc > 3) {
+		disconnect_s = MAX(atoi(argv[3]), 0);
+	}
+	if(argc > 4) {
+		seed = (guint32) strtoul(argv[4], NULL, 10);
+	}
+	//to run the same disconnects again
+	printf("soak: seed %u\n", seed);
+
+	if(sim_start(&soak.bluez, address, num_myos, disconnect_s, seed) != MYOBLUEZ_OK) {
+		sim_stop(&soak.bluez);
+		return 1;
+	}
+
+	soak.loop = g_main_loop_new(NULL, false);
+	soak.start = soak.last_report = g_get_monotonic_time();
+	if(soak_start_ctxs(num_myos) != MYOBLUEZ_OK) {
+		soak_free_ctxs();
+		g_main_loop_unref(soak.loop);
+		sim_stop(&soak.bluez);
+		return 1;
+	}
+
+	g_timeout_add_seconds(SOAK_REPORT_S, soak_report, NULL);
+	g_timeout_add_seconds(soak.seconds, quit_loop, soak.loop);
+	getrusage(RUSAGE_SELF, &start);
+	g_main_loop_run(soak.loop);
+	getrusage(RUSAGE_SELF, &end);
+	soak.cpu_s = cpu_seconds(&start, &end);
+
+	failed = soak_summary();
+	g_main_loop_unref(soak.loop);
+	sim_stop(&soak.bluez);
+
+	return failed == 0 ? 0 : 1;
+}
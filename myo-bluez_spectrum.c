@@ -0,0 +1,162 @@
+#include <math.h>
+#include <float.h>
+
+#include "myo-bluez.h"
+#include "myo-bluez_spectrum.h"
+
+#define BIN_HZ ((float) MYO_EMG_RATE / MYO_SPECTRUM_WINDOW)
+#define NYQUIST_HZ (MYO_EMG_RATE / 2.0f)
+//below this is mostly motion artifact
+#define LOW_HZ 10.0f
+//float rounding in the recursion walks off, the spectrum is recomputed
+//from the window this often, about 5s
+#define SDFT_RESYNC (8 * MYO_SPECTRUM_WINDOW)
+
+void myo_spectrum_config_default(MyoSpectrumConfig *config) {
+	int i;
+
+	memset(config, 0, sizeof(MyoSpectrumConfig));
+	config->hop = MYO_SPECTRUM_DEFAULT_HOP;
+	config->num_bands = 3;
+	for(i = 0; i < config->num_bands; i++) {
+		config->bands[i][0] = LOW_HZ + (NYQUIST_HZ - LOW_HZ) * i / config->num_bands;
+		config->bands[i][1] = LOW_HZ + (NYQUIST_HZ - LOW_HZ) * (i + 1) / config->num_bands;
+	}
+	//the last bin sits right on the top edge
+	config->bands[config->num_bands - 1][1] = NYQUIST_HZ + BIN_HZ;
+}
+
+void myo_spectrum_init(MyoSpectrum *spectrum, const MyoSpectrumConfig *config) {
+	int k;
+
+	memset(spectrum, 0, sizeof(MyoSpectrum));
+	spectrum->config = *config;
+	spectrum->config.hop = MAX(spectrum->config.hop, 1);
+	spectrum->config.num_bands = CLAMP(spectrum->config.num_bands, 0, MYO_SPECTRUM_MAX_BANDS);
+
+	for(k = 0; k < MYO_SPECTRUM_WINDOW; k++) {
+		spectrum->cos[k] = cosf(2.0f * (float) M_PI * k / MYO_SPECTRUM_WINDOW);
+		spectrum->sin[k] = sinf(2.0f * (float) M_PI * k / MYO_SPECTRUM_WINDOW);
+	}
+}
+
+//X_k = W_k (X_k + x_new - x_old), W_k = e^(2 pi i k / N)
+static void spectrum_slide(MyoSpectrum *spectrum, const int16_t *sample) {
+	float u[MYO_SPECTRUM_CHANNELS], re;
+	int16_t *old = spectrum->history[spectrum->head];
+	int k, i;
+
+	for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+		u[i] = sample[i] - old[i];
+	}
+	memcpy(old, sample, sizeof(spectrum->history[0]));
+	spectrum->head = (spectrum->head + 1) % MYO_SPECTRUM_WINDOW;
+
+	for(k = 0; k < MYO_SPECTRUM_BINS; k++) {
+		const float c = spectrum->cos[k], s = spectrum->sin[k];
+		float *xr = spectrum->re[k], *xi = spectrum->im[k];
+
+		for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+			re = xr[i] + u[i];
+			xr[i] = c * re - s * xi[i];
+			xi[i] = s * re + c * xi[i];
+		}
+	}
+}
+
+//Plain DFT of the window, oldest sample first, same phase as the recursion
+static void spectrum_resync(MyoSpectrum *spectrum) {
+	const int16_t *x;
+	int k, m, i, w;
+
+	memset(spectrum->re, 0, sizeof(spectrum->re));
+	memset(spectrum->im, 0, sizeof(spectrum->im));
+
+	for(m = 0; m < MYO_SPECTRUM_WINDOW; m++) {
+		x = spectrum->history[(spectrum->head + m) % MYO_SPECTRUM_WINDOW];
+		for(k = 0; k < MYO_SPECTRUM_BINS; k++) {
+			//e^(-2 pi i k m / N)
+			w = (k * m) % MYO_SPECTRUM_WINDOW;
+			for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+				spectrum->re[k][i] += x[i] * spectrum->cos[w];
+				spectrum->im[k][i] -= x[i] * spectrum->sin[w];
+			}
+		}
+	}
+}
+
+void myo_spectrum_features(const MyoSpectrum *spectrum, MyoSpectrumFeatures *out) {
+	const MyoSpectrumConfig *config = &spectrum->config;
+	const float n2 = (float) MYO_SPECTRUM_WINDOW * MYO_SPECTRUM_WINDOW;
+	float power[MYO_SPECTRUM_BINS][MYO_SPECTRUM_CHANNELS];
+	float weighted[MYO_SPECTRUM_CHANNELS], cum[MYO_SPECTRUM_CHANNELS], half, f, scale;
+	bool found[MYO_SPECTRUM_CHANNELS];
+	int k, i, b;
+
+	memset(out->total, 0, sizeof(out->total));
+	memset(out->bands, 0, sizeof(out->bands));
+	memset(weighted, 0, sizeof(weighted));
+
+	//one sided power without DC, the bins between DC and Nyquist count twice
+	for(k = 1; k < MYO_SPECTRUM_BINS; k++) {
+		scale = (k == MYO_SPECTRUM_WINDOW / 2 ? 1.0f : 2.0f) / n2;
+		f = k * BIN_HZ;
+		for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+			power[k][i] = scale * (spectrum->re[k][i] * spectrum->re[k][i] +
+					spectrum->im[k][i] * spectrum->im[k][i]);
+			out->total[i] += power[k][i];
+			weighted[i] += f * power[k][i];
+		}
+		for(b = 0; b < config->num_bands; b++) {
+			if(f < config->bands[b][0] || f >= config->bands[b][1]) {
+				continue;
+			}
+			for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+				out->bands[b][i] += power[k][i];
+			}
+		}
+	}
+
+	for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+		out->mean[i] = out->total[i] > 0.0f ? weighted[i] / out->total[i] : 0.0f;
+		out->median[i] = 0.0f;
+		cum[i] = 0.0f;
+		found[i] = out->total[i] <= 0.0f;
+	}
+
+	//a bin's power is spread evenly over its width, a lone tone lands on
+	//its center
+	for(k = 1; k < MYO_SPECTRUM_BINS; k++) {
+		for(i = 0; i < MYO_SPECTRUM_CHANNELS; i++) {
+			half = 0.5f * out->total[i];
+			if(!found[i] && cum[i] + power[k][i] >= half) {
+				out->median[i] = (k - 0.5f) * BIN_HZ +
+						BIN_HZ * (half - cum[i]) / MAX(power[k][i], FLT_MIN);
+				found[i] = true;
+			}
+			cum[i] += power[k][i];
+		}
+	}
+}
+
+bool myo_spectrum_push(MyoSpectrum *spectrum, const int16_t *sample, int64_t timestamp,
+		MyoSpectrumFeatures *out)
+{
+	spectrum_slide(spectrum, sample);
+	if(spectrum->count < MYO_SPECTRUM_WINDOW) {
+		spectrum->count++;
+	}
+	if(++spectrum->since_resync == SDFT_RESYNC) {
+		spectrum->since_resync = 0;
+		spectrum_resync(spectrum);
+	}
+
+	if(++spectrum->since_hop < spectrum->config.hop || spectrum->count < MYO_SPECTRUM_WINDOW) {
+		return false;
+	}
+	spectrum->since_hop = 0;
+
+	myo_spectrum_features(spectrum, out);
+	out->timestamp = timestamp;
+	return true;
+}
@@ -0,0 +1,283 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "myo-bluez_trace.h"
+
+#define RING_MASK (MYOBLUEZ_TRACE_RING_SIZE - 1)
+#define DUMP_CHUNK 64
+
+typedef struct TraceRing {
+	struct TraceRing *next;
+	uint32_t head;
+	uint8_t thread;
+	myobluez_trace_event_t events[MYOBLUEZ_TRACE_RING_SIZE];
+} TraceRing;
+
+volatile int myobluez_trace_enabled;
+
+//every ring ever created, pushed lock-free and never removed so a dump can
+//still see events from threads that have exited
+static TraceRing *rings;
+static uint32_t num_threads;
+
+static __thread TraceRing *thread_ring;
+
+static const char *trace_names[TRACE_NUM_EVENTS] = {
+	"none",
+	"myo_lookup",
+	"connect",
+	"connected",
+	"connect_failed",
+	"disconnected",
+	"services_resolved",
+	"init_dispatch",
+	"imu_notify",
+	"arm_notify",
+	"emg_notify",
+	"gesture",
+	"adapt",
+	"discovery",
+	"budget"
+};
+
+static TraceRing* trace_ring_new() {
+	TraceRing *ring;
+
+	ring = calloc(1, sizeof(TraceRing));
+	if(ring == NULL) {
+		return NULL;
+	}
+	ring->thread = (uint8_t) __atomic_fetch_add(&num_threads, 1, __ATOMIC_RELAXED);
+
+	ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&rings, &ring->next, ring, true,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	return ring;
+}
+
+void myobluez_trace_emit(myobluez_trace_id_t id, uint8_t myo, const uint32_t *args) {
+	TraceRing *ring = thread_ring;
+	myobluez_trace_event_t *event;
+	struct timespec now;
+	uint32_t head;
+
+	if(ring == NULL) {
+		ring = thread_ring = trace_ring_new();
+		if(ring == NULL) {
+			return;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	//only this thread writes to the ring, readers detect torn events by
+	//checking seq before and after copying
+	head = ring->head;
+	event = &ring->events[head & RING_MASK];
+	__atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	event->timestamp = (uint64_t) now.tv_sec * 1000000000ull + now.tv_nsec;
+	event->id = id;
+	event->myo = myo;
+	event->thread = ring->thread;
+	memcpy(event->args, args, sizeof(event->args));
+
+	__atomic_store_n(&event->seq, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void myobluez_trace_enable(bool enable) {
+	myobluez_trace_enabled = enable;
+}
+
+const char* myobluez_trace_name(uint16_t id) {
+	if(id >= TRACE_NUM_EVENTS) {
+		return "unknown";
+	}
+	return trace_names[id];
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+	const char *pos = buf;
+	ssize_t written;
+
+	while(len > 0) {
+		written = write(fd, pos, len);
+		//another signal may land during a dump from a handler
+		if(written < 0 && errno == EINTR) {
+			continue;
+		}
+		if(written <= 0) {
+			return -1;
+		}
+		pos += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+//Reads until len bytes are in, a pipe hands them out in pieces. Returns how
+//many there were, less only at the end of the stream, or -1
+static ssize_t read_all(int fd, void *buf, size_t len) {
+	char *pos = buf;
+	size_t total = 0;
+	ssize_t got;
+
+	while(total < len) {
+		got = read(fd, pos + total, len - total);
+		if(got < 0 && errno == EINTR) {
+			continue;
+		}
+		if(got < 0) {
+			return -1;
+		}
+		if(got == 0) {
+			break;
+		}
+		total += got;
+	}
+
+	return total;
+}
+
+int myobluez_trace_dump(int fd) {
+	myobluez_trace_header_t header;
+	myobluez_trace_event_t chunk[DUMP_CHUNK];
+	myobluez_trace_event_t *event;
+	TraceRing *ring;
+	uint32_t i, head, seq;
+	int n;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MYOBLUEZ_TRACE_MAGIC, sizeof(header.magic));
+	header.version = MYOBLUEZ_TRACE_VERSION;
+	header.event_size = sizeof(myobluez_trace_event_t);
+	//rings keep changing while we dump, so the reader goes until EOF
+	header.num_events = 0;
+
+	if(write_all(fd, &header, sizeof(header)) != 0) {
+		return -1;
+	}
+
+	for(ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		i = head > MYOBLUEZ_TRACE_RING_SIZE ? head - MYOBLUEZ_TRACE_RING_SIZE : 0;
+		n = 0;
+
+		for(; i != head; i++) {
+			event = &ring->events[i & RING_MASK];
+			seq = __atomic_load_n(&event->seq, __ATOMIC_ACQUIRE);
+			if(seq != i + 1) {
+				//already overwritten
+				continue;
+			}
+			chunk[n] = *event;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(&event->seq, __ATOMIC_RELAXED) != seq) {
+				continue;
+			}
+
+			if(++n == DUMP_CHUNK) {
+				if(write_all(fd, chunk, sizeof(chunk)) != 0) {
+					return -1;
+				}
+				n = 0;
+			}
+		}
+
+		if(n > 0 && write_all(fd, chunk, n * sizeof(myobluez_trace_event_t)) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int trace_event_cmp(const void *a, const void *b) {
+	const myobluez_trace_event_t *ea = a, *eb = b;
+
+	if(ea->timestamp != eb->timestamp) {
+		return ea->timestamp < eb->timestamp ? -1 : 1;
+	}
+	return (int) ea->thread - (int) eb->thread;
+}
+
+int myobluez_trace_decode(int fd, FILE *out) {
+	myobluez_trace_header_t header;
+	myobluez_trace_event_t *events, *tmp;
+	size_t num_events, max_events, i;
+	ssize_t got;
+
+	if(read_all(fd, &header, sizeof(header)) != sizeof(header) ||
+			memcmp(header.magic, MYOBLUEZ_TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "Not a myo-bluez trace\n");
+		return -1;
+	}
+	if(header.version != MYOBLUEZ_TRACE_VERSION ||
+			header.event_size != sizeof(myobluez_trace_event_t)) {
+		fprintf(stderr, "Unsupported trace version %u\n", header.version);
+		return -1;
+	}
+
+	num_events = 0;
+	max_events = MYOBLUEZ_TRACE_RING_SIZE;
+	events = malloc(max_events * sizeof(myobluez_trace_event_t));
+	if(events == NULL) {
+		return -1;
+	}
+
+	for(;;) {
+		if(num_events == max_events) {
+			max_events *= 2;
+			tmp = realloc(events, max_events * sizeof(myobluez_trace_event_t));
+			if(tmp == NULL) {
+				free(events);
+				return -1;
+			}
+			events = tmp;
+		}
+
+		got = read_all(fd, &events[num_events], sizeof(myobluez_trace_event_t));
+		if(got < 0) {
+			perror("Reading trace");
+			free(events);
+			return -1;
+		}
+		if(got != sizeof(myobluez_trace_event_t)) {
+			//a dump cut off mid record keeps what came before
+			if(got > 0) {
+				fprintf(stderr, "Trace ends in a partial event\n");
+			}
+			break;
+		}
+		num_events++;
+	}
+
+	//interleave the per thread rings
+	qsort(events, num_events, sizeof(myobluez_trace_event_t), trace_event_cmp);
+
+	for(i = 0; i < num_events; i++) {
+		fprintf(out, "%llu.%09llu t%u ",
+				(unsigned long long) events[i].timestamp / 1000000000ull,
+				(unsigned long long) events[i].timestamp % 1000000000ull,
+				events[i].thread);
+		if(events[i].myo == MYOBLUEZ_TRACE_NO_MYO) {
+			fprintf(out, "-    ");
+		} else {
+			fprintf(out, "myo%u ", events[i].myo);
+		}
+		fprintf(out, "%-18s %u %u %u %u\n",
+				myobluez_trace_name(events[i].id),
+				events[i].args[0], events[i].args[1],
+				events[i].args[2], events[i].args[3]);
+	}
+
+	free(events);
+	return 0;
+}
@@ -0,0 +1,32 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "myo-bluez_trace.h"
+
+int main(int argc, char **argv) {
+	int fd, ret;
+
+	if(argc > 2) {
+		fprintf(stderr, "Usage: %s [trace file]\n", argv[0]);
+		return 1;
+	}
+
+	if(argc == 2) {
+		fd = open(argv[1], O_RDONLY);
+		if(fd < 0) {
+			perror(argv[1]);
+			return 1;
+		}
+	} else {
+		fd = STDIN_FILENO;
+	}
+
+	ret = myobluez_trace_decode(fd, stdout);
+
+	if(fd != STDIN_FILENO) {
+		close(fd);
+	}
+
+	return ret == 0 ? 0 : 1;
+}